@@ -26,6 +26,10 @@
 #include <picknik_main/manipulation_data.h>
 #include <picknik_main/perception_interface.h>
 #include <picknik_main/remote_control.h>
+#include <picknik_main/health_monitor.h>
+#include <picknik_main/order_scheduler.h>
+#include <picknik_main/order_runner.h>
+#include <picknik_main/grasp_memory.h>
 
 // Picknik Msgs
 #include <picknik_msgs/FindObjectsAction.h>
@@ -64,10 +68,17 @@ public:
 
   /**
    * \brief Check if all communication is properly active
+   * \param remove_from_shelf - also move the robot out of collision and back within its bounds
    * \return true on success
    */
   bool checkSystemReady(bool remove_from_shelf = true);
 
+  /**
+   * \brief Show the shelf as a wall and wait until the robot state is out of collision and within
+   *        its joint bounds
+   */
+  void removeFromShelf();
+
   /**
    * \brief Load the shelf and products
    * \param shelf to focus on. rest of shelves will be disabled
@@ -86,7 +97,8 @@ public:
                           std::size_t num_orders = 0);
 
   /**
-   * \brief Main program runner
+   * \brief Run orders in the sequence expected to score the most before the time limit,
+   *        re-planned after each one
    * \param Which product in the order to skip ahead to
    * \param jump_to - which step in manipulation to start at
    * \param num_orders - how many products to pick from the order, 0 = all
@@ -94,11 +106,44 @@ public:
    */
   bool runOrder(std::size_t order_start = 0, std::size_t jump_to = 0, std::size_t num_orders = 0);
 
+  /**
+   * \brief One try of an order chosen by the scheduler, for OrderRunner
+   * \param scheduler_id - id of the order in order_scheduler_
+   * \return true on success
+   */
+  bool attemptOrder(std::size_t scheduler_id, OrderStrategy strategy);
+
+  /**
+   * \brief Learn from a try and clean up the planning scene for the next one, for OrderRunner
+   * \param requeued - the product stays in the scene for the retry
+   */
+  void finishOrder(std::size_t scheduler_id, bool success, bool requeued);
+
   /**
    * \brief Grasp object once we know the pose
    * \return true on success
    */
-  bool graspObjectPipeline(WorkOrder order, bool verbose, std::size_t jump_to = 0);
+  bool graspObjectPipeline(WorkOrder order, bool verbose, std::size_t jump_to = 0,
+                           OrderStrategy strategy = ORDER_STRATEGY_DEFAULT);
+
+  /**
+   * \brief Move grasps that succeeded more often than they failed on this product to the front,
+   *        most successful first, keeping the generated order for the rest
+   */
+  void preferRememberedGrasps(WorkOrder& work_order,
+                              std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates);
+
+  /**
+   * \brief Drop the grasps that failed on earlier tries of this order, unless that leaves none
+   */
+  void removeFailedGrasps(WorkOrder& work_order,
+                          std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates);
+
+  /**
+   * \brief Pose of a grasp relative to the product it is for, how GraspMemory stores it
+   */
+  Eigen::Affine3d getProductToGrasp(WorkOrder& work_order,
+                                    const moveit_grasps::GraspCandidatePtr& grasp_candidate);
 
   /**
    * \brief Generate a discretized array of possible pre-grasps and save into experience database
@@ -278,6 +323,12 @@ public:
    */
   bool placeObjectInGoalBin(JointModelGroup* arm_jmg);
 
+  /**
+   * \brief Lower into goal bin from the dropoff position
+   * \return true on success
+   */
+  bool lowerIntoGoalBin(JointModelGroup* arm_jmg);
+
   /**
    * \brief Lift from goal bin
    * \return true on success
@@ -487,6 +538,24 @@ private:
   // Allow loading and saving trajectories to file
   TrajectoryIOPtr trajectory_io_;
 
+  // Watches controllers, perception and joint states once the first system check passed
+  HealthMonitorPtr health_monitor_;
+
+  // Order sequence of the running runOrder()
+  OrderSchedulerPtr order_scheduler_;
+  std::vector<std::size_t> scheduler_to_order_;  // index into orders_ by scheduler id
+  std::size_t order_jump_to_;                   // step the first try of each order starts at
+
+  // Grasps that worked before for each product, kept across runs
+  GraspMemoryPtr grasp_memory_;
+  std::string grasp_memory_file_;
+  Eigen::Affine3d chosen_product_to_grasp_;  // grasp picked in step 3 of the running order
+  bool grasp_chosen_;
+  bool grasp_attempted_;  // the chosen grasp was closed on the product
+
+  // Grasps, relative to the product, that failed on earlier tries, by product collision name
+  std::map<std::string, EigenSTL::vector_Affine3d> failed_grasps_;
+
 };  // end class
 
 }  // end namespace
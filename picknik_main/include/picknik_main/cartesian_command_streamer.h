@@ -0,0 +1,121 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Send cartesian end effector targets to the robot at a fixed rate from one thread,
+           regardless of which thread or how irregularly they are produced
+*/
+
+#ifndef PICKNIK_MAIN__CARTESIAN_COMMAND_STREAMER
+#define PICKNIK_MAIN__CARTESIAN_COMMAND_STREAMER
+
+// ROS
+#include <ros/ros.h>
+#include <geometry_msgs/Pose.h>
+#include <cartesian_msgs/CartesianCommand.h>
+
+// Boost
+#include <boost/thread.hpp>
+#include <boost/lockfree/queue.hpp>
+
+// C++
+#include <atomic>
+#include <chrono>
+
+namespace picknik_main
+{
+/**
+ * \brief Producers push targets into a lock-free queue. Every tick the streaming thread drains the
+ *        queue, publishes only the newest target (older ones are stale and counted as coalesced)
+ *        and sleeps until the next tick's deadline. Ticks without a new target publish nothing.
+ *        A tick still running when the next one is due counts as a missed deadline and the
+ *        schedule restarts from then rather than bursting to catch up
+ */
+class CartesianCommandStreamer
+{
+public:
+  /**
+   * \brief Constructor
+   * \param topic - where CartesianCommand messages are published
+   * \param rate - hz
+   */
+  CartesianCommandStreamer(const std::string& topic, double rate);
+
+  /**
+   * \brief Destructor
+   */
+  ~CartesianCommandStreamer();
+
+  /**
+   * \brief Queue a target, safe to call from any thread
+   * \param duration - seconds the robot should take to reach it
+   * \return false if the queue is full
+   */
+  bool push(const geometry_msgs::Pose& pose, double duration);
+
+  /**
+   * \brief Stop the streaming thread, targets still queued are dropped
+   */
+  void stop();
+
+  /**
+   * \brief Show rate, jitter, latency and deadline statistics
+   */
+  void printStats() const;
+
+  std::size_t getPublishedCount() const { return published_; }
+  std::size_t getCoalescedCount() const { return coalesced_; }
+  std::size_t getMissedDeadlineCount() const { return missed_deadlines_; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  // Trivially copyable so it can go in a lock-free queue
+  struct Target
+  {
+    double position_[3];
+    double orientation_[4];  // x, y, z, w
+    double duration_;
+    int64_t enqueue_nsec_;  // steady clock
+  };
+
+  /** \brief Body of the streaming thread */
+  void streamThread();
+
+  static int64_t toNSec(Clock::time_point time);
+
+  ros::NodeHandle nh_;
+  ros::Publisher cartesian_command_pub_;
+  cartesian_msgs::CartesianCommand cartesian_command_msg_;  // only used by the streaming thread
+
+  Clock::duration period_;
+  boost::lockfree::queue<Target> targets_;
+
+  boost::thread stream_thread_;
+  std::atomic<bool> running_;
+
+  // Statistics
+  std::atomic<std::size_t> ticks_;
+  std::atomic<std::size_t> published_;
+  std::atomic<std::size_t> coalesced_;
+  std::atomic<std::size_t> dropped_;
+  std::atomic<std::size_t> missed_deadlines_;
+  std::atomic<int64_t> jitter_sum_nsec_;
+  std::atomic<int64_t> jitter_max_nsec_;
+  std::atomic<int64_t> latency_sum_nsec_;
+  std::atomic<int64_t> latency_max_nsec_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<CartesianCommandStreamer> CartesianCommandStreamerPtr;
+
+}  // end namespace
+
+#endif
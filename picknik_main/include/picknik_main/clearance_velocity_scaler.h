@@ -0,0 +1,106 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Slow a trajectory down only where it passes close to the shelf or products, or while
+           carrying a product, instead of running the whole motion at the slowest safe speed
+*/
+
+#ifndef PICKNIK_MAIN__CLEARANCE_VELOCITY_SCALER
+#define PICKNIK_MAIN__CLEARANCE_VELOCITY_SCALER
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace picknik_main
+{
+/**
+ * \brief A trajectory is time parameterized at the free space velocity scaling, then every
+ *        segment is stretched so that it runs at a scaling between the caller's base scaling, at
+ *        or closer than near_distance to the world, and the free space scaling, at or beyond
+ *        far_distance. While a product is attached the free space scaling is multiplied by
+ *        payload_scaling, but never below the base. Scaling is treated as proportional to speed,
+ *        which holds for velocity limited segments. Neighbouring segments are slowed so speed ramps
+ *        between bands, then velocities and accelerations are recomputed from the new timing and
+ *        segments around any waypoint over its acceleration limit are slowed further
+ */
+class ClearanceVelocityScaler
+{
+public:
+  /** \brief Seconds of the retimed trajectory by how close it was to obstacles */
+  struct Breakdown
+  {
+    double original_duration_;  // as parameterized, before retiming
+    double near_duration_;      // at the base scaling
+    double between_duration_;
+    double free_duration_;  // at the free space scaling
+    bool payload_;
+  };
+
+  /**
+   * \brief Constructor
+   * \param near_distance - meters from the world at or below which the base scaling is used
+   * \param far_distance - meters from the world at or above which the free space scaling is used
+   * \param free_space_scaling - velocity scaling far from everything
+   * \param payload_scaling - multiplies the free space scaling while a product is attached
+   * \param stride - waypoints between clearance checks, the ones skipped take the smaller
+   *        clearance of the checked waypoints on either side
+   */
+  ClearanceVelocityScaler(double near_distance, double far_distance, double free_space_scaling,
+                          double payload_scaling, std::size_t stride);
+
+  /**
+   * \brief Velocity scaling to time parameterize at before retime()
+   */
+  double getPlanningScaling(double base_scaling) const;
+
+  /**
+   * \brief Stretch the segments of a trajectory that come close to the world
+   * \param scene - world to measure clearance against, its current state decides the payload
+   * \param planned_scaling - scaling the trajectory was parameterized at
+   * \param base_scaling - scaling to use near obstacles
+   * \return false if the trajectory is too short or has no group to retime, or does not start and
+   *         end at rest
+   */
+  bool retime(robot_trajectory::RobotTrajectory& trajectory,
+              const planning_scene::PlanningScene& scene, double planned_scaling,
+              double base_scaling, Breakdown& breakdown) const;
+
+private:
+  /**
+   * \brief Set the segment durations and recompute velocities and accelerations to match
+   * \param durations - seconds from the previous waypoint, the first is ignored
+   * \param acceleration_ratio - per waypoint, largest acceleration over its limit
+   * \return largest acceleration_ratio
+   */
+  double applyDurations(robot_trajectory::RobotTrajectory& trajectory,
+                        const std::vector<double>& durations,
+                        std::vector<double>& acceleration_ratio) const;
+
+  double near_distance_;
+  double far_distance_;
+  double free_space_scaling_;
+  double payload_scaling_;
+  std::size_t stride_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<ClearanceVelocityScaler> ClearanceVelocityScalerPtr;
+
+}  // end namespace
+
+#endif
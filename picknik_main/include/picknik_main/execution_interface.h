@@ -41,12 +41,17 @@
 
 // ROS
 #include <ros/ros.h>
-#include <cartesian_msgs/CartesianCommand.h>
 
 // PickNik
 #include <picknik_main/visuals.h>
 #include <picknik_main/remote_control.h>
 #include <picknik_main/manipulation_data.h>
+#include <picknik_main/state_snapshot.h>
+#include <picknik_main/trajectory_logger.h>
+#include <picknik_main/latency_stats.h>
+#include <picknik_main/settle_detector.h>
+#include <picknik_main/grasp_settle_detector.h>
+#include <picknik_main/cartesian_command_streamer.h>
 
 // MoveIt
 #include <moveit_grasps/grasp_data.h>
@@ -80,7 +85,8 @@ public:
                      bool fake_execution);
 
   /**
-   * \brief Execute a desired cartesian end effector pose
+   * \brief Execute a desired cartesian end effector pose. Queued and sent at the next tick of the
+   *        command streamer, a newer pose sent before then replaces it
    * \param pose
    * \return true on success
    */
@@ -106,6 +112,13 @@ public:
    */
   bool checkExecutionManager();
 
+  /**
+   * \brief Quiet check for the health monitor that every joint of the arm group in use still has
+   *        an active controller. Does not load the execution manager or switch controllers
+   * \return false if any does not, or the execution manager is not loaded yet
+   */
+  bool checkControllersActive();
+
   /**
    * \brief Ensure controllers are ready and in correct state
    * \return true on success
@@ -124,13 +137,39 @@ public:
    */
   moveit::core::RobotStatePtr getCurrentState();
 
+  /**
+   * \brief Latest joint positions from the state monitor, readable without locking the scene
+   */
+  StateSnapshotPtr getStateSnapshot() { return state_snapshot_; }
+
+  /**
+   * \brief Timing of every phase of every motion, see Manipulation for where planning is measured
+   */
+  LatencyStatsPtr getLatencyStats() { return latency_stats_; }
+
+  /**
+   * \brief Signals when the joint states show the robot at rest, NULL without a state monitor
+   */
+  SettleDetectorPtr getSettleDetector() { return settle_detector_; }
+
+  /**
+   * \brief Signals when the end effector joints show a stable grip, NULL without a state monitor
+   */
+  GraspSettleDetectorPtr getGraspSettleDetector() { return grasp_settle_detector_; }
+
+  /**
+   * \brief Lock-free path to the robot's cartesian controller, poses must already be converted to
+   *        what Blue expects, see executePose()
+   */
+  CartesianCommandStreamerPtr getCartesianCommandStreamer() { return cartesian_command_streamer_; }
+
 private:
+  /** \brief Track changes to the scene that a joint state snapshot would not capture */
+  void sceneUpdateCallback(planning_scene_monitor::PlanningSceneMonitor::SceneUpdateType type);
+
   bool checkTrajectoryController(ros::ServiceClient &service_client,
                                  const std::string &hardware_name, bool has_ee = false);
 
-  bool saveTrajectory(const moveit_msgs::RobotTrajectory &trajectory_msg,
-                      const std::string &file_name);
-
   bool getFilePath(std::string &file_path, const std::string &file_name) const;
 
   // Show more visual and console output, with general slower run time.
@@ -151,6 +190,17 @@ private:
   // Allocated memory for robot state
   moveit::core::RobotStatePtr current_state_;
 
+  // Lock-free copy of the joint states, and whether the scene has changed in other ways since
+  StateSnapshotPtr state_snapshot_;
+  std::vector<double> snapshot_positions_;
+  std::atomic<bool> scene_changed_;
+
+  // Watches the same joint states for the robot coming to rest
+  SettleDetectorPtr settle_detector_;
+
+  // Watches only the end effector joints for the grip becoming stable
+  GraspSettleDetectorPtr grasp_settle_detector_;
+
   // A shared node handle
   ros::NodeHandle nh_;
 
@@ -161,8 +211,17 @@ private:
   ros::ServiceClient zaber_list_controllers_client_;
   ros::ServiceClient kinova_list_controllers_client_;
 
-  cartesian_msgs::CartesianCommand cartesian_command_msg_;
-  ros::Publisher cartesian_command_pub_;
+  CartesianCommandStreamerPtr cartesian_command_streamer_;
+
+  // Background saving of executed trajectories
+  TrajectoryLoggerPtr trajectory_logger_;
+
+  // Phase timing, and the trajectory sent but not yet waited for
+  LatencyStatsPtr latency_stats_;
+  bool execution_pending_;
+  double execution_start_time_;
+  double execution_duration_;
+  std::string execution_motion_type_;
 
   // Unit testing mode - do not actually execute trajectories
   bool unit_testing_enabled_;
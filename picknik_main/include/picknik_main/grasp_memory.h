@@ -0,0 +1,140 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Remember which grasps worked for each type of product, across orders and runs, so that
+           they can be tried before any others
+*/
+
+#ifndef PICKNIK_MAIN__GRASP_MEMORY
+#define PICKNIK_MAIN__GRASP_MEMORY
+
+// ROS
+#include <ros/ros.h>
+
+// Eigen
+#include <Eigen/Geometry>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+// C++
+#include <map>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+/**
+ * \brief Grasps are stored as the pose of the grasp in the product's frame, keyed by product name,
+ *        so they carry over to any pose of the same product. A grasp is added the first time it
+ *        succeeds and after that counts its successes and failures. Two grasps are the same if
+ *        they are within position_tolerance and angle_tolerance of each other. Safe to use from
+ *        the pipeline and the lookahead thread at once
+ */
+class GraspMemory
+{
+public:
+  struct RememberedGrasp
+  {
+    Eigen::Affine3d product_to_grasp_;
+    std::size_t successes_;
+    std::size_t failures_;
+  };
+
+  /**
+   * \brief Constructor
+   * \param position_tolerance - meters
+   * \param angle_tolerance - radians
+   */
+  GraspMemory(double position_tolerance, double angle_tolerance);
+
+  /**
+   * \brief Replace the memory with the contents of a file
+   * \return false if the file could not be read, the memory is then empty
+   */
+  bool load(const std::string& file_path);
+
+  /**
+   * \brief Write every remembered grasp to a file
+   */
+  bool save(const std::string& file_path) const;
+
+  /**
+   * \brief Find a grasp that is worth trying before unknown ones, one that has succeeded more
+   *        often than it failed so its rate beats the 0.5 assumed for a grasp never tried
+   * \param rank - 0 for the product's most successful grasp
+   * \return false if the grasp is not remembered or has not done better than chance
+   */
+  bool findProvenGrasp(const std::string& product, const Eigen::Affine3d& product_to_grasp,
+                       std::size_t& rank) const;
+
+  /**
+   * \brief Order the candidate grasps of a product so the proven ones, see findProvenGrasp(), come
+   *        first, most successful first. The rest keep the order they were generated in
+   * \param order - indices into product_to_grasps, in the order to try them
+   * \return how many proven grasps were put first
+   */
+  std::size_t orderGrasps(const std::string& product,
+                          const EigenSTL::vector_Affine3d& product_to_grasps,
+                          std::vector<std::size_t>& order) const;
+
+  /**
+   * \brief Count the outcome of a grasp, adding it if it succeeded and is new
+   */
+  void recordResult(const std::string& product, const Eigen::Affine3d& product_to_grasp,
+                    bool success);
+
+  /**
+   * \brief Count how long generating and ordering the grasp candidates took. Planning to the
+   *        chosen grasp is not included
+   * \param proven - whether a proven grasp was put first
+   */
+  void recordTimeToChooseGrasp(double seconds, bool proven);
+
+  /**
+   * \brief Whether two grasps of the same product are within the tolerances of each other
+   */
+  bool isSameGrasp(const Eigen::Affine3d& a_product_to_grasp,
+                   const Eigen::Affine3d& b_product_to_grasp) const;
+
+  /** \brief Grasps per product and how long choosing one took, with and without a proven one */
+  void printStats() const;
+
+private:
+  typedef std::vector<RememberedGrasp> Grasps;
+
+  /** \brief Most successful first, with one success and one failure assumed for every grasp */
+  static bool compareGrasps(const RememberedGrasp& a, const RememberedGrasp& b);
+
+  /** \brief Index into grasps of a match, or grasps.size() */
+  std::size_t findMatch(const Grasps& grasps, const Eigen::Affine3d& product_to_grasp) const;
+
+  double position_tolerance_;
+  double angle_tolerance_;
+
+  mutable boost::mutex memory_mutex_;
+  std::map<std::string, Grasps> grasps_;  // sorted by compareGrasps()
+
+  // Time to choose a grasp, sum and count, with and without a proven grasp
+  double hit_time_;
+  std::size_t hits_;
+  double miss_time_;
+  std::size_t misses_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<GraspMemory> GraspMemoryPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,103 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Decide from end effector joint states, and optionally the tactile sensor, when a grip
+           has stopped changing, so that a pick only waits as long as the product needs
+*/
+
+#ifndef PICKNIK_MAIN__GRASP_SETTLE_DETECTOR
+#define PICKNIK_MAIN__GRASP_SETTLE_DETECTOR
+
+// ROS
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+
+// Boost
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// C++
+#include <map>
+
+namespace picknik_main
+{
+/**
+ * \brief A grip is settled once, for a full window that began after waitForGrasp() was called, no
+ *        finger joint has moved further than position_threshold and no reported finger effort has
+ *        changed by more than effort_threshold, and the extra check (e.g. tactile) also passes.
+ *        Fingers stalled against a product count as settled even though they never reach the
+ *        commanded posture
+ */
+class GraspSettleDetector
+{
+public:
+  /**
+   * \brief Condition besides the joint states that must hold before the grip counts as settled
+   * \param since - only data newer than this may be used
+   * \return true if settled, or if there is no data to judge by
+   */
+  typedef boost::function<bool(const ros::Time& since)> SettleCheck;
+
+  /**
+   * \brief Constructor
+   * \param variable_names - end effector joints to watch, others in the messages are ignored
+   * \param position_threshold - radians or meters
+   * \param effort_threshold - only checked for messages that have efforts
+   * \param window - seconds without change before the grip counts as settled
+   */
+  GraspSettleDetector(const std::vector<std::string>& variable_names, double position_threshold,
+                      double effort_threshold, double window);
+
+  /**
+   * \brief Feed a joint state message, called from the state monitor's callback
+   */
+  void update(const sensor_msgs::JointStateConstPtr& joint_state);
+
+  /**
+   * \brief Block until the grip is settled, re-checked on every joint state message
+   * \param max_wait - seconds, e.g. the fixed wait this replaces
+   * \param check - NULL to use the joint states only
+   * \param time_to_settle - seconds from the call until settled, max_wait on timeout
+   * \return false on timeout
+   */
+  bool waitForGrasp(double max_wait, const SettleCheck& check, double& time_to_settle);
+
+  ros::Duration getWindow() const { return window_; }
+
+private:
+  // Lookup from joint state name to index in our arrays
+  std::map<std::string, std::size_t> variable_indices_;
+
+  // Criteria
+  double position_threshold_;
+  double effort_threshold_;
+  ros::Duration window_;
+
+  // Only accessed from the joint state callback
+  std::vector<double> positions_;
+  std::vector<double> efforts_;
+  std::vector<double> window_start_positions_;
+  std::vector<double> window_start_efforts_;
+
+  // Guards the stamps, signalled on every message
+  boost::mutex stamp_mutex_;
+  boost::condition_variable update_condition_;
+  ros::Time window_start_stamp_;
+  ros::Time latest_stamp_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<GraspSettleDetector> GraspSettleDetectorPtr;
+
+}  // end namespace
+
+#endif
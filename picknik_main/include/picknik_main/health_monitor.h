@@ -0,0 +1,131 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Keep track of whether the controllers, perception and joint states are alive from a
+           background thread, so that asking if the system is ready costs nothing
+*/
+
+#ifndef PICKNIK_MAIN__HEALTH_MONITOR
+#define PICKNIK_MAIN__HEALTH_MONITOR
+
+// ROS
+#include <ros/ros.h>
+
+// PickNik
+#include <picknik_main/state_snapshot.h>
+
+// Boost
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+// C++
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+/**
+ * \brief Checks are run one after another on the monitor thread at a fixed rate and their results
+ *        cached. Joint states are watched by how often the snapshot is updated rather than by
+ *        message stamps. A subsystem going down or coming back is logged the moment it is seen
+ */
+class HealthMonitor
+{
+public:
+  /**
+   * \brief A check that may block briefly, e.g. on a service call
+   * \return true if the subsystem is fine
+   */
+  typedef boost::function<bool()> CheckFunction;
+
+  /**
+   * \brief Constructor
+   * \param rate - hz that the checks are run at
+   */
+  HealthMonitor(double rate);
+
+  /**
+   * \brief Destructor
+   */
+  ~HealthMonitor();
+
+  /**
+   * \brief Add a subsystem to poll, only before start()
+   */
+  void addCheck(const std::string& name, const CheckFunction& check);
+
+  /**
+   * \brief Fail once the snapshot has not been updated for the timeout, only before start()
+   * \param timeout - seconds
+   */
+  void watchJointStates(StateSnapshotPtr state_snapshot, double timeout);
+
+  /**
+   * \brief Run every check once on the calling thread, then keep checking in the background
+   * \return result of the first round
+   */
+  bool start();
+
+  bool isStarted() const { return started_; }
+
+  /**
+   * \brief Result of the latest round of checks, does not block
+   */
+  bool isHealthy() const { return healthy_.load(std::memory_order_acquire); }
+
+  /**
+   * \brief Output every subsystem's state to console
+   */
+  void printStatus() const;
+
+private:
+  struct Check
+  {
+    std::string name_;
+    CheckFunction check_;
+    bool healthy_;
+    std::size_t failures_;
+    ros::WallTime last_change_;
+  };
+
+  /** \brief Body of the monitor thread */
+  void monitorThread();
+
+  /** \brief Run every check once and publish the result */
+  bool checkAll();
+
+  /** \brief Joint state watchdog */
+  bool checkJointStates();
+
+  ros::WallDuration period_;
+
+  // Only touched by the monitor thread once started, printStatus() reads under the mutex
+  mutable boost::mutex checks_mutex_;
+  std::vector<Check> checks_;
+
+  StateSnapshotPtr state_snapshot_;
+  double joint_state_timeout_;
+  std::size_t last_update_count_;
+  ros::WallTime last_update_time_;
+
+  std::atomic<bool> healthy_;
+  std::atomic<bool> running_;
+  bool started_;
+  boost::thread monitor_thread_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<HealthMonitor> HealthMonitorPtr;
+
+}  // end namespace
+
+#endif
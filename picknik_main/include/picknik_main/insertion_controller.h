@@ -0,0 +1,267 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Run the insertion control loop on its own thread, optionally with real-time priority,
+           reading tactile data and writing poses without locks or I/O
+*/
+
+#ifndef PICKNIK_MAIN__INSERTION_CONTROLLER
+#define PICKNIK_MAIN__INSERTION_CONTROLLER
+
+// ROS
+#include <ros/ros.h>
+
+// PickNik
+#include <picknik_main/tactile_feedback.h>
+#include <picknik_main/cartesian_command_streamer.h>
+
+// Eigen
+#include <Eigen/Geometry>
+
+// Boost
+#include <boost/thread.hpp>
+
+// C++
+#include <atomic>
+#include <chrono>
+
+namespace picknik_main
+{
+/** \brief One straight line insertion or retraction, all poses precomputed by the caller */
+struct InsertionGoal
+{
+  InsertionGoal();
+
+  // Start pose of the finger tips in the world frame
+  Eigen::Affine3d world_to_tool_;
+
+  // Constant transforms so the loop never touches the robot state: the commanded pose is
+  // base_to_world_ * world_to_tool * tool_to_command_
+  Eigen::Affine3d base_to_world_;
+  Eigen::Affine3d tool_to_command_;
+
+  double distance_;       // meters along the tool z axis
+  bool direction_in_;     // false to move out
+  std::size_t num_steps_;
+  double step_duration_;  // seconds, the loop period
+  double command_duration_;  // seconds the robot is given to reach each pose
+
+  // Rotate about the tool y axis in response to sheer torque, see computeInsertionRotation
+  bool use_tactile_;
+  double torque_min_;
+  double torque_max_;
+  double torque_scale_;
+  double correction_pause_;  // seconds to hold position after a correction
+
+  // Take steps between min and max size depending on how much contact the sensor reports,
+  // instead of num_steps_ equal steps. Contact is full at either the force or the torque given
+  bool adaptive_step_;
+  double min_step_;  // meters
+  double max_step_;  // meters
+  double contact_force_;
+  double contact_torque_;
+
+  // Seconds after which a tactile sample is too old to act on, it then counts as full contact
+  double max_sample_age_;
+};
+
+/**
+ * \brief The per tick logic of a goal: choose the step size, move along the tool z axis, rotate in
+ *        response to sheer torque and hold after a correction. Has no timing or I/O, so offline
+ *        replay runs exactly what the control loop runs
+ */
+class InsertionStepper
+{
+public:
+  /**
+   * \brief Constructor
+   */
+  InsertionStepper();
+
+  /**
+   * \brief Start a goal from its start pose
+   */
+  void reset(const InsertionGoal& goal);
+
+  /**
+   * \brief True once the full distance has been travelled
+   */
+  bool isDone() const;
+
+  /**
+   * \brief True if step() makes use of tactile data, otherwise it can always be given NULL
+   */
+  bool needsTactile() const;
+
+  /**
+   * \brief Advance one tick
+   * \param sample - newest tactile data, NULL if none has arrived
+   * \param now - time of this tick, in the clock of the sample stamps
+   * \return true if the pose moved and should be commanded, false while holding after a correction
+   */
+  bool step(const TactileSample* sample, const ros::Time& now);
+
+  const Eigen::Affine3d& getPose() const { return world_to_tool_; }
+  std::size_t getSteps() const { return steps_; }
+  std::size_t getCorrections() const { return corrections_; }
+  std::size_t getStaleSamples() const { return stale_samples_; }
+  std::size_t getHoldTicks() const { return held_ticks_; }
+  double getTravelled() const { return travelled_; }
+  double getNetRotation() const { return net_rotation_; }
+  double getMaxRotation() const { return max_rotation_; }
+
+private:
+  /**
+   * \brief Distance to move this tick when stepping adaptively
+   * \param sample - newest tactile data, NULL if none has arrived
+   * \param previous_step - steps only grow gradually so free space motion ramps up smoothly
+   */
+  double getAdaptiveStep(const TactileSample* sample, double previous_step) const;
+
+  InsertionGoal goal_;
+  bool adaptive_step_;
+  Eigen::Vector3d rotated_direction_;
+  double fixed_step_;
+  double step_distance_;
+  std::size_t pause_ticks_;
+  std::size_t hold_ticks_;
+
+  Eigen::Affine3d world_to_tool_;
+  std::size_t steps_;
+  std::size_t corrections_;
+  std::size_t stale_samples_;  // ticks where the newest sample was too old
+  std::size_t held_ticks_;     // ticks spent holding after corrections
+  double travelled_;
+  double net_rotation_;  // radians about the tool y axis
+  double max_rotation_;  // largest single correction
+};
+
+/**
+ * \brief A single control thread waits for goals. While a goal runs it wakes on absolute deadlines,
+ *        reads the newest tactile sample from the lock-free ring, pushes the pose to the lock-free
+ *        cartesian command queue and records period and wake up jitter in fixed histograms. The
+ *        loop does no logging, allocation or visualization
+ */
+class InsertionController
+{
+public:
+  /**
+   * \brief Constructor
+   * \param priority - SCHED_FIFO priority of the control thread, 0 for normal scheduling
+   * \param cpu - core to pin the control thread to, -1 for any
+   */
+  InsertionController(TactileFeedbackPtr tactile_feedback,
+                      CartesianCommandStreamerPtr cartesian_command_streamer, int priority,
+                      int cpu);
+
+  /**
+   * \brief Destructor
+   */
+  ~InsertionController();
+
+  /**
+   * \brief Start a goal on the control thread
+   * \return false if one is already running
+   */
+  bool start(const InsertionGoal& goal);
+
+  /**
+   * \brief Block until the running goal finishes or the timeout passes
+   * \return true if finished
+   */
+  bool waitForCompletion(double timeout);
+
+  /**
+   * \brief Ask the running goal to stop at its next step
+   */
+  void cancel();
+
+  /**
+   * \brief Keep the running goal where it is until released, then carry on with the rest of it
+   */
+  void setHold(bool hold);
+
+  /**
+   * \brief Only valid once the goal has finished
+   * \param world_to_tool - pose the goal ended at
+   * \return number of steps that were corrected from tactile data
+   */
+  std::size_t getResult(Eigen::Affine3d& world_to_tool) const;
+
+  /**
+   * \brief Period and jitter of the last goal
+   */
+  void printStats() const;
+
+private:
+  // Linear histogram, fixed size so it can be filled from the control loop
+  struct Histogram
+  {
+    static const std::size_t NUM_BINS = 200;
+
+    void reset(double bin_width);
+    void add(double value);
+    double getPercentile(double fraction) const;
+
+    double bin_width_;
+    std::size_t bins_[NUM_BINS + 1];  // last bin is overflow
+    std::size_t count_;
+    double sum_;
+    double max_;
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+  /** \brief Body of the control thread */
+  void controlThread();
+
+  /** \brief Apply scheduling settings from within the control thread */
+  void configureThread();
+
+  /** \brief One goal, runs on the control thread */
+  void runGoal();
+
+  /** \brief Send a pose to the robot, lock-free */
+  void command(const Eigen::Affine3d& world_to_tool);
+
+  TactileFeedbackPtr tactile_feedback_;
+  CartesianCommandStreamerPtr cartesian_command_streamer_;
+  int priority_;
+  int cpu_;
+
+  // Hand off of goals, never held while the loop runs
+  boost::mutex goal_mutex_;
+  boost::condition_variable goal_condition_;
+  bool goal_pending_;
+  bool goal_done_;
+  bool shutdown_;
+  InsertionGoal goal_;
+
+  std::atomic<bool> cancel_;
+  std::atomic<bool> hold_;
+  boost::thread control_thread_;
+
+  // Results, only touched by the control thread while a goal runs
+  InsertionStepper stepper_;
+  std::size_t missed_deadlines_;
+  double duration_;           // seconds the goal took, not counting holds
+  double baseline_duration_;  // seconds num_steps_ fixed steps and the same pauses would have taken
+  double pause_duration_;     // seconds held after corrections, part of both durations
+  Histogram period_histogram_;
+  Histogram jitter_histogram_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<InsertionController> InsertionControllerPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,124 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Record every joint state message to file, without polling the robot state
+*/
+
+#ifndef PICKNIK_MAIN__JOINT_STATE_RECORDER
+#define PICKNIK_MAIN__JOINT_STATE_RECORDER
+
+// ROS
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <sensor_msgs/JointState.h>
+
+// MoveIt
+#include <moveit/robot_state/robot_state.h>
+
+// Boost
+#include <boost/thread.hpp>
+
+// C++
+#include <atomic>
+#include <fstream>
+
+namespace picknik_main
+{
+class JointStateRecorder
+{
+public:
+  /**
+   * \brief Constructor
+   * \param topic - joint states to listen to
+   * \param initial_state - values of joints that are not in the joint state messages
+   * \param position_threshold - only record a sample once a joint has moved this far (radians or
+   *        meters) since the last recorded sample. 0 records every message
+   * \param max_interval - record a sample at least this often (seconds), even if nothing moved
+   * \param buffer_size - samples that can wait for the writer before new ones are dropped
+   */
+  JointStateRecorder(const std::string& topic, const moveit::core::RobotState& initial_state,
+                     double position_threshold, double max_interval,
+                     std::size_t buffer_size = 10000);
+
+  /**
+   * \brief Destructor
+   */
+  ~JointStateRecorder();
+
+  /**
+   * \brief Open file and begin listening. Each line is a full robot state in the format of
+   *        moveit::core::robotStateToStream() followed by the time stamp of the sample
+   * \return true on success
+   */
+  bool start(const std::string& file_path);
+
+  /**
+   * \brief Stop listening and write out any remaining samples
+   */
+  void stop();
+
+  std::size_t getReceivedCount() const { return received_; }
+  std::size_t getRecordedCount() const { return recorded_; }
+  std::size_t getDropCount() const { return dropped_; }
+
+private:
+  /** \brief Called on the recorder's own spinner thread for every joint state */
+  void jointStateCallback(const sensor_msgs::JointStateConstPtr& msg);
+
+  /** \brief Body of the background thread */
+  void writerThread();
+
+  struct Sample
+  {
+    ros::Time stamp_;
+    std::vector<double> positions_;
+  };
+
+  // Listen on a separate queue so recording neither waits on nor delays the control callbacks
+  ros::NodeHandle nh_;
+  ros::CallbackQueue callback_queue_;
+  boost::shared_ptr<ros::AsyncSpinner> spinner_;
+  ros::Subscriber joint_state_sub_;
+  std::string topic_;
+
+  // Map joint state names to robot variables
+  std::map<std::string, std::size_t> variable_indices_;
+
+  // Decimation, only accessed from the callback
+  double position_threshold_;
+  ros::Duration max_interval_;
+  std::vector<double> latest_positions_;
+  std::vector<double> last_recorded_positions_;
+  ros::Time last_recorded_stamp_;
+
+  // Ring of preallocated samples. The writer owns [head_, head_ + count_) while writing them out
+  std::vector<Sample> ring_;
+  std::size_t head_;
+  std::size_t count_;
+  boost::mutex ring_mutex_;
+  boost::condition_variable ring_condition_;
+
+  std::ofstream output_file_;
+  boost::thread writer_thread_;
+  bool running_;
+
+  // Statistics
+  std::atomic<std::size_t> received_;
+  std::atomic<std::size_t> recorded_;
+  std::atomic<std::size_t> dropped_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<JointStateRecorder> JointStateRecorderPtr;
+
+}  // end namespace
+
+#endif
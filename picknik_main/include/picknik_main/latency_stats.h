@@ -0,0 +1,115 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Histograms of how long each phase of a motion takes, from planning to the controller
+           reporting done
+*/
+
+#ifndef PICKNIK_MAIN__LATENCY_STATS
+#define PICKNIK_MAIN__LATENCY_STATS
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+// C++
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace picknik_main
+{
+class LatencyStats
+{
+public:
+  enum Phase
+  {
+    PLAN,                // motion planner
+    PARAMETERIZE,        // planning adapters and time parameterization
+    PUSH,                // handing the trajectory to the execution manager
+    CONTROLLER_LATENCY,  // time to done beyond the trajectory's own duration
+    MOTION,              // duration of the trajectory
+    SETTLE,              // robot coming to rest after the controller reported done
+    NUM_PHASES
+  };
+
+  /**
+   * \brief Constructor
+   */
+  LatencyStats();
+
+  /**
+   * \brief Label that following samples are filed under, e.g. "planned" or "cartesian"
+   */
+  void setMotionType(const std::string& motion_type);
+
+  /**
+   * \brief Add a sample of the current motion type
+   */
+  void record(Phase phase, double seconds);
+
+  /**
+   * \brief Add a sample of a motion type other than the current one, e.g. when a motion is waited
+   *        for after the label has already moved on
+   */
+  void record(const std::string& motion_type, Phase phase, double seconds);
+
+  std::string getMotionType() const;
+
+  /**
+   * \brief Seconds from a monotonic clock, for measuring phases
+   */
+  static double now();
+
+  /**
+   * \brief Count, mean, percentiles and max of every phase of every motion type
+   */
+  void printSummary(std::ostream& out = std::cout) const;
+
+  /**
+   * \brief Forget all samples
+   */
+  void reset();
+
+  static const char* getPhaseName(Phase phase);
+
+private:
+  // Log spaced bins, BINS_PER_DECADE per power of ten from MIN_SECONDS, plus under and overflow
+  static const std::size_t BINS_PER_DECADE = 10;
+  static const std::size_t NUM_DECADES = 7;
+  static const double MIN_SECONDS;
+
+  struct Histogram
+  {
+    Histogram();
+    void add(double seconds);
+    double getPercentile(double fraction) const;
+
+    std::vector<std::size_t> bins_;
+    std::size_t count_;
+    double sum_;
+    double max_;
+  };
+
+  typedef std::vector<Histogram> PhaseHistograms;
+
+  mutable boost::mutex mutex_;
+  std::string motion_type_;
+  std::map<std::string, PhaseHistograms> histograms_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<LatencyStats> LatencyStatsPtr;
+
+}  // end namespace
+
+#endif
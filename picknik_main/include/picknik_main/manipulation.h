@@ -23,10 +23,16 @@
 #include <picknik_main/remote_control.h>
 #include <picknik_main/execution_interface.h>
 #include <picknik_main/tactile_feedback.h>
+#include <picknik_main/robot_state_pool.h>
+#include <picknik_main/insertion_controller.h>
+#include <picknik_main/clearance_velocity_scaler.h>
 
 // ROS
 #include <ros/ros.h>
 
+// Boost
+#include <boost/thread/thread.hpp>
+
 // MoveIt
 #include <ompl_visual_tools/ompl_visual_tools.h>
 #include <moveit/kinematic_constraints/utils.h>
@@ -73,6 +79,11 @@ public:
                RemoteControlPtr remote_control, bool fake_execution,
                TactileFeedbackPtr tactile_feedback);
 
+  /**
+   * \brief Destructor - waits for a lookahead that is still planning
+   */
+  ~Manipulation();
+
   /**
    * \brief Choose the grasp for the object
    * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
@@ -107,6 +118,30 @@ public:
    */
   bool moveCartesianWaypointPath(JointModelGroup* arm_jmg, EigenSTL::vector_Affine3d waypoints);
 
+  /**
+   * \brief Find a path that accomplishes waypoints and execute all together
+   * \param solved_path - the joint solution that was executed, starting with the state at the
+   *        first waypoint, so it can be replayed with moveSolvedWaypointPath()
+   * \return true on success
+   */
+  bool moveCartesianWaypointPath(JointModelGroup* arm_jmg, EigenSTL::vector_Affine3d waypoints,
+                                 std::vector<moveit::core::RobotStatePtr>& solved_path);
+
+  /**
+   * \brief Check that a previously solved waypoint path is still within bounds and collision free
+   *        in the current planning scene
+   * \return true if valid
+   */
+  bool checkSolvedWaypointPath(JointModelGroup* arm_jmg,
+                               const std::vector<moveit::core::RobotStatePtr>& solved_path);
+
+  /**
+   * \brief Plan to the start of a previously solved waypoint path then execute it, without IK
+   * \return true on success
+   */
+  bool moveSolvedWaypointPath(JointModelGroup* arm_jmg,
+                              const std::vector<moveit::core::RobotStatePtr>& solved_path);
+
   /**
    * \brief Move to any pose as defined in the SRDF
    * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
@@ -312,6 +347,21 @@ public:
                                    double duration, Eigen::Affine3d& desired_world_to_tool,
                                    bool direction_in, bool& achieved_depth);
 
+  /**
+   * \brief Fill in the parts of an insertion goal common to all insertions
+   * \param goal - distance, direction and timing must already be set
+   */
+  void setupInsertionGoal(JointModelGroup* arm_jmg, const Eigen::Affine3d& world_to_tool,
+                          InsertionGoal& goal);
+
+  /**
+   * \brief Run an insertion on the control thread and wait for it. Remote stop holds the
+   *        insertion in place until the stop is cleared
+   * \param world_to_tool - set to where the insertion ended
+   * \return false if it was cancelled before reaching the full distance
+   */
+  bool runInsertion(const InsertionGoal& goal, Eigen::Affine3d& world_to_tool);
+
   /** \brief Use tactile feedback
    * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
    * \param desired_distance
@@ -395,6 +445,22 @@ public:
       moveit_msgs::RobotTrajectory& trajectory_msg, JointModelGroup* arm_jmg,
       const double& velocity_scaling_factor, bool interpolate = true);
 
+  /**
+   * \brief Velocity scaling to time parameterize a motion at, faster than base_scaling when
+   *        adaptive velocity is enabled so that retimeByClearance() can slow it where needed
+   */
+  double getPlanningScaling(double base_scaling) const;
+
+  /**
+   * \brief Slow the segments of a time parameterized trajectory that pass close to the world,
+   *        and log where its time goes. Does nothing unless adaptive velocity is enabled
+   * \param planned_scaling - from getPlanningScaling()
+   * \param base_scaling - scaling to use near obstacles
+   */
+  void retimeByClearance(robot_trajectory::RobotTrajectory& trajectory,
+                         const planning_scene::PlanningScene& scene, double planned_scaling,
+                         double base_scaling);
+
   /**
    * \brief Open both end effectors in hardware
    * \return true on success
@@ -425,6 +491,41 @@ public:
    */
   bool setEEGraspPosture(trajectory_msgs::JointTrajectory grasp_posture, JointModelGroup* arm_jmg);
 
+  /**
+   * \brief Have the next arm motion from move(), executeSavedCartesianPath() or
+   *        mergeQueuedEEPosture() also move the fingers into grasp_posture, finishing as the arm
+   *        arrives. The request is dropped after that motion whether or not it could be merged,
+   *        so follow it with the usual setEEGraspPosture(), which does nothing if the fingers are
+   *        already there
+   * \param window - seconds before the end of the arm motion that the fingers may start moving,
+   *        0 to never merge
+   */
+  void queueEEGraspPosture(const trajectory_msgs::JointTrajectory& grasp_posture,
+                           JointModelGroup* arm_jmg, double window);
+
+  /**
+   * \brief Add the queued finger motion to an arm trajectory and clear the queue. The combined
+   *        motion is checked against the planning scene and left unmerged if it is not valid
+   * \return true if merged, false if nothing was queued, the fingers could not finish in time or
+   *         the combined motion collides
+   */
+  bool mergeQueuedEEPosture(moveit_msgs::RobotTrajectory& trajectory_msg);
+
+  /** \brief Seconds of separate end effector motion avoided by merging, since startup */
+  double getEEOverlapSaved() const { return ee_overlap_saved_; }
+
+  /**
+   * \brief Plan the motion after the next one while the next move() executes, so that a later
+   *        move() from start to goal can use that plan instead of planning. The request is
+   *        dropped after the next move() whether or not it executed
+   * \param start - where the next motion is going to end
+   */
+  void queuePlanLookahead(const moveit::core::RobotStatePtr& start,
+                          const moveit::core::RobotStatePtr& goal, JointModelGroup* arm_jmg);
+
+  /** \brief Wait for a lookahead that is still planning and throw its plan away */
+  void discardPlanLookahead();
+
   /**
    * \brief Set a robot state to have an open or closed EE. Does not actually affect hardware
    * \return true on success
@@ -436,6 +537,11 @@ public:
    */
   ExecutionInterfacePtr getExecutionInterface();
 
+  /**
+   * \brief Get the recycler of robot states used in the hot paths
+   */
+  RobotStatePoolPtr getStatePool() { return state_pool_; }
+
   /**
    * \brief Attempt to fix when the robot is in collision by moving arm out of way
    * \return true on success
@@ -523,6 +629,13 @@ public:
    */
   bool waitForRobotToStop(const double& timeout);
 
+  /**
+   * \brief Wait until the end effector joints and tactile sensor show a stable grip
+   * \param max_wait - seconds, waited in full if there is no way to tell
+   * \return true if the grip settled before max_wait
+   */
+  bool waitForGrasp(double max_wait);
+
   /**
    * \brief Check if current state is in collision or out of bounds
    * \param arm_jmg - the kinematic chain of joint that should be controlled (a planning group)
@@ -603,6 +716,25 @@ public:
   }
 
 protected:
+  /**
+   * \brief Start planning the queued lookahead in the background, called once a motion executes
+   */
+  void startPlanLookahead();
+
+  /**
+   * \brief Body of the lookahead thread
+   */
+  void computePlanLookahead();
+
+  /**
+   * \brief Wait for the lookahead and hand over its plan if it is for this motion and still
+   *        collision free from where the robot is now
+   * \return false if there is no plan to use
+   */
+  bool takePlanLookahead(const moveit::core::RobotStatePtr& start,
+                         const moveit::core::RobotStatePtr& goal, JointModelGroup* arm_jmg,
+                         moveit_msgs::RobotTrajectory& trajectory_msg);
+
   // A shared node handle
   ros::NodeHandle nh_;
 
@@ -612,6 +744,9 @@ protected:
   // For executing trajectories
   ExecutionInterfacePtr execution_interface_;
 
+  // Timing of each phase of a motion, owned by the execution interface
+  LatencyStatsPtr latency_stats_;
+
   // For visualizing things in rviz
   VisualsPtr visuals_;
   ovt::OmplVisualToolsPtr ompl_visual_tools_;
@@ -621,11 +756,16 @@ protected:
   robot_model::RobotModelConstPtr robot_model_;
   planning_pipeline::PlanningPipelinePtr planning_pipeline_;
   planning_interface::PlanningContextPtr planning_context_handle_;
+  boost::mutex planning_mutex_;  // the pipeline and context are shared with the lookahead thread
 
   // Allocated memory for robot state
   moveit::core::RobotStatePtr current_state_;
   moveit::core::RobotStatePtr first_state_in_trajectory_;  // for use with generateApproachPath()
   moveit::core::RobotStatePtr teleop_state_;
+  moveit::core::RobotStatePtr teleop_ik_state_;  // scratch for solving, swapped in on success
+
+  // Reuse robot states instead of allocating new ones every loop
+  RobotStatePoolPtr state_pool_;
 
   // Robot-sepcific data for the APC
   ManipulationDataPtr config_;
@@ -636,8 +776,40 @@ protected:
   // Remote control
   RemoteControlPtr remote_control_;
 
+  // Insertion loops run on their own thread
+  InsertionControllerPtr insertion_controller_;
+
+  // Speed up motions away from the shelf and products
+  ClearanceVelocityScalerPtr clearance_velocity_scaler_;
+
   // End effector sheer force teleoperation
   TactileFeedbackPtr tactile_feedback_;
+
+  // Finger motion waiting to be merged into the next arm trajectory
+  bool ee_posture_queued_;
+  trajectory_msgs::JointTrajectory queued_ee_posture_;
+  JointModelGroup* queued_ee_arm_jmg_;
+  double queued_ee_window_;
+  double ee_overlap_saved_;
+
+  // Motion to plan while the next one executes
+  bool plan_lookahead_queued_;
+  moveit::core::RobotStatePtr queued_lookahead_start_;
+  moveit::core::RobotStatePtr queued_lookahead_goal_;
+  JointModelGroup* queued_lookahead_arm_jmg_;
+
+  // Plan for the motion after the current one, computed while the current one executes
+  moveit::core::RobotStatePtr plan_lookahead_start_;
+  moveit::core::RobotStatePtr plan_lookahead_goal_;
+  JointModelGroup* plan_lookahead_arm_jmg_;
+  moveit_msgs::RobotTrajectory plan_lookahead_trajectory_;
+  bool plan_lookahead_success_;
+  boost::thread plan_lookahead_thread_;
+
+  // Seconds of fixed grasp waiting skipped since startup, and over how many grasps
+  double grasp_wait_saved_;
+  std::size_t grasp_waits_;
+
   Eigen::Vector3d teleop_direction_;
   Eigen::Vector3d teleop_rotated_direction_;
   Eigen::Affine3d teleop_world_to_tool_;
@@ -87,6 +87,13 @@ public:
   double retreat_velocity_scaling_factor_;
   double calibration_velocity_scaling_factor_;
 
+  // Adaptive velocity, the factors above are used near obstacles
+  double free_space_velocity_scaling_factor_;
+  double payload_velocity_scaling_factor_;  // multiplies the free space factor when carrying
+  double clearance_near_distance_;
+  double clearance_far_distance_;
+  int clearance_check_stride_;
+
   // Wait variables
   double wait_before_grasp_;
   double wait_after_grasp_;
@@ -143,6 +150,14 @@ public:
   double insertion_attempt_distance_;
   double insertion_attempt_distance_scale_;
   double insertion_spiral_distance_;
+  bool insertion_adaptive_step_;
+  double insertion_step_min_;
+  double insertion_step_max_;
+  double insertion_contact_force_;
+  double insertion_contact_torque_;
+  double insertion_max_sample_age_;
+  int insertion_thread_priority_;
+  int insertion_thread_cpu_;
 
   // Automated insertion test
   double automated_insertion_distance_;
@@ -169,6 +184,72 @@ public:
 
   std::string joint_state_topic_;
 
+  // Trajectory recording decimation
+  double joint_state_record_threshold_;
+  double joint_state_record_max_interval_;
+
+  // When the robot counts as stopped
+  double settle_position_threshold_;
+  double settle_velocity_threshold_;
+  double settle_window_;
+
+  // When a grip counts as stable, the waits around grasping are the upper bound
+  double grasp_settle_position_threshold_;
+  double grasp_settle_effort_threshold_;
+  double grasp_settle_tactile_threshold_;
+  double grasp_settle_window_;
+
+  // Seconds before the end of an arm motion that the end effector may start opening for the
+  // pre-grasp or closing for the grasp, 0 to move it separately
+  double ee_open_overlap_;
+  double ee_close_overlap_;
+
+  // Hz that cartesian end effector commands are streamed at
+  double cartesian_command_rate_;
+
+  // Hz that the health monitor checks subsystems at
+  double health_check_rate_;
+
+  // Seconds without a joint state before it is considered dead
+  double joint_state_timeout_;
+
+  // Meters and radians within which a grasp matches a remembered one of the same product
+  double grasp_memory_position_tolerance_;
+  double grasp_memory_angle_tolerance_;
+
+  // Seconds in a run, and expected seconds per order before any have finished
+  double order_time_limit_;
+  double order_default_duration_;
+
+  // Chance of knocking another product out of a shared bin
+  double order_mistake_probability_;
+
+  // Tries per order, and seconds that may be spent on one order over all of them
+  int order_max_attempts_;
+  double order_time_budget_;
+
+  // Hz that interactive marker targets are commanded at
+  double teleop_rate_;
+
+  // Teleoperate with joint goals from local IK instead of cartesian commands
+  bool teleop_use_ik_;
+
+  // Hz that tactile data is drawn in rviz
+  double tactile_visualization_rate_;
+
+  // Save raw tactile data and insertion commands for offline tuning
+  bool tactile_record_;
+
+  // Noise filtering of tactile data, see tactile_filter.h
+  std::string tactile_filter_type_;
+  int tactile_filter_median_window_;
+  double tactile_filter_ema_alpha_;
+  double tactile_filter_one_euro_min_cutoff_;
+  double tactile_filter_one_euro_beta_;
+  double tactile_filter_one_euro_d_cutoff_;
+  double tactile_filter_kalman_process_noise_;
+  double tactile_filter_kalman_measurement_noise_;
+
   Eigen::Affine3d teleoperation_offset_;
 
 private:
@@ -0,0 +1,90 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Run work orders in the order the OrderScheduler chooses, on the robot or in a dry run
+*/
+
+#ifndef PICKNIK_MAIN__ORDER_RUNNER
+#define PICKNIK_MAIN__ORDER_RUNNER
+
+// PickNik
+#include <picknik_main/order_scheduler.h>
+
+// Boost
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace picknik_main
+{
+/**
+ * \brief Asks the scheduler for the next order until none are left that fit in the time left,
+ *        tries it once and reports how it went. Durations are measured on the scheduler's clock.
+ *        What a try does is up to the caller
+ */
+class OrderRunner
+{
+public:
+  /**
+   * \brief Try an order once
+   * \param order_id - id from OrderScheduler::addOrder()
+   * \param strategy - what to do differently from the last try
+   * \return true if the product was delivered
+   */
+  typedef boost::function<bool(std::size_t order_id, OrderStrategy strategy)> AttemptCallback;
+
+  /** \brief Check that the robot can keep going, before every try */
+  typedef boost::function<bool()> ReadyCallback;
+
+  /**
+   * \brief After every try, once the scheduler knows the result
+   * \param requeued - the order failed and will be tried again later
+   */
+  typedef boost::function<void(std::size_t order_id, bool success, bool requeued)> ResultCallback;
+
+  /**
+   * \brief Constructor
+   * \param scheduler - with all orders added
+   * \param ready_callback - optional
+   * \param result_callback - optional
+   */
+  OrderRunner(OrderSchedulerPtr scheduler, const AttemptCallback& attempt_callback,
+              const ReadyCallback& ready_callback = ReadyCallback(),
+              const ResultCallback& result_callback = ResultCallback());
+
+  /**
+   * \brief Start the scheduler's clock and run orders until none are left that fit
+   * \param stop_on_failure - stop after the first failed try, for debugging
+   * \return false if stopped early by a failure, the ready check or shutdown
+   */
+  bool run(bool stop_on_failure);
+
+  /** \brief Tries so far this run, including retries */
+  std::size_t getAttempts() const { return attempts_; }
+
+  /** \brief Tries that were not the first of their order */
+  std::size_t getRetries() const { return retries_; }
+
+private:
+  OrderSchedulerPtr scheduler_;
+  AttemptCallback attempt_callback_;
+  ReadyCallback ready_callback_;
+  ResultCallback result_callback_;
+
+  std::size_t attempts_;
+  std::size_t retries_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<OrderRunner> OrderRunnerPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,197 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Choose which work order to run next so that the expected score within the time limit of
+           a run is as high as possible
+*/
+
+#ifndef PICKNIK_MAIN__ORDER_SCHEDULER
+#define PICKNIK_MAIN__ORDER_SCHEDULER
+
+// ROS
+#include <ros/ros.h>
+
+// Boost
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+// C++
+#include <map>
+#include <string>
+#include <vector>
+
+namespace picknik_main
+{
+/** \brief What to do differently when retrying an order that failed */
+enum OrderStrategy
+{
+  ORDER_STRATEGY_DEFAULT = 0,
+  ORDER_STRATEGY_REPERCEIVE,   // look for the product again before grasping
+  ORDER_STRATEGY_OTHER_GRASP,  // skip the grasps that were tried before
+  ORDER_STRATEGY_OTHER_ARM,    // use the arm that was not chosen before
+  ORDER_NUM_STRATEGIES
+};
+
+/**
+ * \brief Each order's expected points come from the product's grasp success probability and
+ *        extra points (orders/items_data.csv) and the number of products in its bin. Its expected
+ *        duration comes from how long earlier orders in the same shelf row took this run, else
+ *        from any earlier order, else from a default. Every call to getNextOrder() plans again
+ *        from the time left: the set of pending orders with the highest total expected points
+ *        that fits is chosen, and the one with the most points per second among them runs next.
+ *        A failed order goes back in the queue behind every order not yet tried, with the next
+ *        strategy, until it runs out of attempts or of its own time budget, or its expected
+ *        duration no longer fits in the run
+ */
+class OrderScheduler
+{
+public:
+  /** \brief Seconds since any fixed point in time */
+  typedef boost::function<double()> Clock;
+
+  /**
+   * \brief Constructor
+   * \param time_limit - seconds for the whole run, counted from start()
+   * \param default_duration - seconds an order is expected to take before any have finished
+   * \param mistake_probability - chance of knocking another product out of a shared bin
+   * \param max_attempts - tries per order, 1 for no retries
+   * \param order_time_budget - seconds that may be spent on one order over all of its tries
+   */
+  OrderScheduler(double time_limit, double default_duration, double mistake_probability,
+                 std::size_t max_attempts, double order_time_budget);
+
+  /**
+   * \brief Load per product grasp probabilities and extra points
+   * \return false if the file could not be read. Unknown products then use the defaults
+   */
+  bool loadItemData(const std::string& file_path);
+
+  /**
+   * \brief Add an order to the pending queue
+   * \param bin_count - number of products in the bin, including this one
+   * \return id of the order, in the order added
+   */
+  std::size_t addOrder(const std::string& product, const std::string& bin, std::size_t bin_count);
+
+  /**
+   * \brief Whether a retry can use the other arm. Without it retries only alternate between
+   *        re-perceiving and another grasp. Defaults to true
+   */
+  void setDualArm(bool dual_arm);
+
+  /**
+   * \brief Measure the run with another clock than wall time, e.g. a simulated one for a dry run.
+   *        Call before start()
+   */
+  void setClock(const Clock& clock);
+
+  /**
+   * \brief Start the run clock
+   */
+  void start();
+
+  /**
+   * \brief Plan from the remaining time and choose the next order
+   * \return false if no pending order is expected to finish in time, or none are left
+   */
+  bool getNextOrder(std::size_t& order_id);
+
+  /**
+   * \brief Record how an order went, which updates the duration estimates of the rest. A failed
+   *        order is requeued if it still has attempts and time left
+   * \param duration - seconds it took
+   * \return true if the order failed and was requeued
+   */
+  bool reportResult(std::size_t order_id, bool success, double duration);
+
+  /** \brief Seconds left in the run */
+  double getRemainingTime() const;
+
+  const std::string& getProduct(std::size_t order_id) const;
+  double getExpectedPoints(std::size_t order_id) const;
+  double getGraspProbability(std::size_t order_id) const;
+  double getExpectedDuration(std::size_t order_id) const;
+
+  /** \brief How the next try of an order should be run */
+  OrderStrategy getStrategy(std::size_t order_id) const;
+
+  /** \brief Tries so far */
+  std::size_t getAttempts(std::size_t order_id) const;
+
+  static const char* getStrategyName(OrderStrategy strategy);
+
+  /** \brief Show every order with its estimates and outcome */
+  void printSummary() const;
+
+private:
+  enum OrderStatus
+  {
+    PENDING,
+    SUCCEEDED,
+    FAILED
+  };
+
+  struct Order
+  {
+    std::string product_;
+    std::string bin_;
+    std::size_t bin_count_;
+    double p_grasping_correctly_;
+    double extra_points_;
+    double expected_points_;
+    OrderStatus status_;
+    double duration_;  // seconds, over all tries
+    std::size_t attempts_;
+    OrderStrategy strategy_;
+  };
+
+  struct ItemData
+  {
+    double p_grasping_correctly_;
+    double extra_points_;
+  };
+
+  /** \brief Rows of the shelf differ in how hard they are to reach, bin_A to bin_C is row 0 */
+  static std::size_t getBinRow(const std::string& bin);
+
+  /** \brief Points for a product picked from a bin with bin_count products */
+  static double getBinPoints(std::size_t bin_count);
+
+  /**
+   * \brief Choose the pending orders with the highest total expected points that fit in time
+   * \param chosen - ids ordered by expected points per second, highest first
+   */
+  void plan(double remaining_time, std::vector<std::size_t>& chosen) const;
+
+  double time_limit_;
+  double default_duration_;
+  double mistake_probability_;
+  std::size_t max_attempts_;
+  double order_time_budget_;
+  bool dual_arm_;
+  Clock clock_;
+  double start_time_;
+
+  std::map<std::string, ItemData> item_data_;
+  std::vector<Order> orders_;
+
+  // Observed order durations this run
+  std::map<std::size_t, std::pair<double, std::size_t> > row_durations_;  // sum and count per row
+  double total_duration_;
+  std::size_t finished_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<OrderScheduler> OrderSchedulerPtr;
+
+}  // end namespace
+
+#endif
@@ -79,6 +79,11 @@ public:
    */
   bool isPerceptionReady();
 
+  /**
+   * \brief Non-blocking check that the perception server is still there, for the health monitor
+   */
+  bool isPerceptionConnected();
+
   /**
    * \brief Get the latest location of the frame on the robot from ROS
    * \param world_to_frame 4x4 matrix to fill in with transpose
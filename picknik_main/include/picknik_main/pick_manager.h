@@ -24,7 +24,9 @@
 #include <picknik_main/manipulation_data.h>
 #include <picknik_main/perception_interface.h>
 #include <picknik_main/remote_control.h>
+#include <picknik_main/health_monitor.h>
 #include <picknik_main/tactile_feedback.h>
+#include <picknik_main/teleop_worker.h>
 
 // Picknik Msgs
 #include <picknik_msgs/FindObjectsAction.h>
@@ -54,11 +56,15 @@ public:
   PickManager(bool verbose);
 
   /**
-   * \brief Check if all communication is properly active
+   * \brief Check if all communication is properly active. The first call runs the full check and
+   *        starts the health monitor, later ones only read what it found
    * \return true on success
    */
   bool checkSystemReady();
 
+  /** \brief Show where the time went in this run, by motion phase, and RobotState allocations */
+  void printStats();
+
   /**
    * \brief Test the end effectors
    * \param input - description
@@ -96,6 +102,13 @@ public:
    */
   bool testRandomValidMotions();
 
+  /**
+   * \brief Random state of a random arm that is valid, along with start
+   * \return false if the state chosen is in collision or out of bounds
+   */
+  bool chooseRandomValidGoal(const moveit::core::RobotStatePtr& start, JointModelGroup*& arm_jmg,
+                             moveit::core::RobotStatePtr& goal_state);
+
   /**
    * \brief Test moving joints to extreme limits
    * \return true on success
@@ -137,6 +150,12 @@ public:
    */
   bool playbackTrajectory();
 
+  /**
+   * \brief Save binary versions of all CSV trajectories for faster playback
+   * \return true on success
+   */
+  bool convertTrajectories();
+
   /**
    * \brief
    * \param input - description
@@ -201,8 +220,12 @@ public:
    */
   bool testGraspWidths();
 
+  /** \brief Interactive marker feedback, queued for the teleop worker */
   void processMarkerPose(const geometry_msgs::Pose& pose, bool move);
 
+  /** \brief Command the robot towards a teleop target, runs on the teleop worker thread */
+  bool executeTeleopPose(const Eigen::Affine3d& ee_pose, bool move);
+
   /** \brief Peg in hole demo */
   void insertion();
 
@@ -294,8 +317,16 @@ private:
   // Allow loading and saving trajectories to file
   TrajectoryIOPtr trajectory_io_;
 
+  // Watches controllers, perception and joint states once the first system check passed
+  HealthMonitorPtr health_monitor_;
+
   bool teleoperation_enabled_;
   Eigen::Affine3d interactive_marker_pose_;
+  // Marker feedback arrives on every spinner thread, pushes to the worker must stay in order
+  boost::mutex interactive_marker_mutex_;
+
+  // Rate limits teleop commands, only the newest marker pose is used
+  TeleopWorkerPtr teleop_worker_;
 
 };  // end class
 
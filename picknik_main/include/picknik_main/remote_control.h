@@ -54,6 +54,10 @@
 
 // Boost
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// C++
+#include <map>
 
 namespace picknik_main
 {
@@ -68,6 +72,11 @@ public:
    */
   RemoteControl(bool verbose, ros::NodeHandle nh, PickManager* parent);
 
+  /**
+   * \brief Destructor - shows how long each step waited
+   */
+  ~RemoteControl();
+
   /**
    * \brief Remote control from Rviz
    */
@@ -109,17 +118,28 @@ public:
   bool getStop();
 
   /**
-   * \brief Wait until user presses a button
+   * \brief Wait until user presses a button. Any thread can wait, every mode change wakes waiters
+   *        immediately
+   * \param file, line - call site, pass __FILE__ and __LINE__. Wait statistics are kept per site
    * \return true on success
    */
-  bool waitForNextStep(const std::string& caption = "go to next step");
-  bool waitForNextFullStep(const std::string& caption = "go to next full step");
+  bool waitForNextStep(const std::string& caption, const char* file, int line);
+  bool waitForNextFullStep(const std::string& caption, const char* file, int line);
+
+  /**
+   * \brief How often and how long each call site waited, longest total first
+   */
+  void printWaitStats();
 
   void initializeInteractiveMarkers(const geometry_msgs::Pose& pose);
 
   /** \brief Return true if remote control is waiting for user input */
-  bool isWaiting() { return is_waiting_; }
+  bool isWaiting();
+
 private:
+  /** \brief Shared by both kinds of step, full steps are only skipped in full autonomous mode */
+  bool waitForStep(const std::string& caption, const char* file, int line, bool full_step);
+
   void make6DofMarker(bool fixed, unsigned int interaction_mode, const geometry_msgs::Pose& pose,
                       bool show_6dof);
 
@@ -144,20 +164,32 @@ private:
   ros::Subscriber remote_control_;
   ros::Subscriber remote_joy_;
 
-  // Remote control
+  // Remote control, all guarded by state_mutex_
   bool is_waiting_;
   bool next_step_ready_;
   bool autonomous_;
   bool full_autonomous_;
   bool stop_;
+  boost::mutex state_mutex_;
+  boost::condition_variable state_condition_;
+
+  // Wait statistics per call site, keyed by file:line
+  struct WaitStats
+  {
+    WaitStats() : passed_(0), waited_(0), total_wait_(0), max_wait_(0) {}
+    std::string caption_;
+    std::size_t passed_;  // did not need to wait
+    std::size_t waited_;
+    double total_wait_;  // seconds
+    double max_wait_;
+  };
+  std::map<std::string, WaitStats> wait_stats_;
 
   // Interactive markers
   boost::shared_ptr<interactive_markers::InteractiveMarkerServer> imarker_server_;
   interactive_markers::MenuHandler menu_handler_;
-  bool teleoperation_ready_ = true;
 
   ros::Time throttle_time_;
-  boost::mutex interactive_mutex_;
 
 };  // end class
 
@@ -0,0 +1,90 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Recycle RobotState memory in the hot paths instead of calling new every loop
+*/
+
+#ifndef PICKNIK_MAIN__ROBOT_STATE_POOL
+#define PICKNIK_MAIN__ROBOT_STATE_POOL
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_state/robot_state.h>
+
+// Boost
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/tss.hpp>
+
+// C++
+#include <atomic>
+
+namespace picknik_main
+{
+class RobotStatePool : public boost::enable_shared_from_this<RobotStatePool>
+{
+public:
+  /**
+   * \brief Constructor
+   * \param max_free_per_thread - how many released states each thread keeps around for reuse
+   */
+  RobotStatePool(std::size_t max_free_per_thread = 64);
+
+  /**
+   * \brief Get a state that is a copy of the input, reusing released memory when possible.
+   *        The returned pointer hands its state back to the calling thread's free list when the
+   *        last reference is dropped, so it can be used anywhere a RobotStatePtr is expected
+   * \return copy of the input state
+   */
+  moveit::core::RobotStatePtr acquire(const moveit::core::RobotState& copy_from);
+
+  /** \brief Number of times a RobotState actually had to be allocated */
+  std::size_t getAllocationCount() const { return allocations_; }
+
+  /** \brief Number of states handed out, recycled or not */
+  std::size_t getAcquireCount() const { return acquisitions_; }
+
+  /** \brief Number of states currently handed out and not yet released */
+  std::size_t getOutstandingCount() const { return acquisitions_ - releases_; }
+
+  /** \brief Output allocation counters to console */
+  void printStats() const;
+
+private:
+  // Released states owned by one thread
+  struct FreeList
+  {
+    ~FreeList();
+    std::vector<moveit::core::RobotState*> states_;
+  };
+
+  /** \brief Custom deleter - returns state to pool if pool still exists, otherwise frees it */
+  static void release(boost::weak_ptr<RobotStatePool> weak_pool, moveit::core::RobotState* state);
+
+  // Each thread recycles into its own list so no locking is required
+  boost::thread_specific_ptr<FreeList> free_lists_;
+
+  std::size_t max_free_per_thread_;
+
+  // Statistics
+  std::atomic<std::size_t> allocations_;
+  std::atomic<std::size_t> acquisitions_;
+  std::atomic<std::size_t> releases_;
+
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<RobotStatePool> RobotStatePoolPtr;
+
+}  // end namespace
+
+#endif
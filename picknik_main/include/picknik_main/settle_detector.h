@@ -0,0 +1,91 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Decide from joint state messages when the robot has stopped moving, and wake waiting
+           threads the moment it does
+*/
+
+#ifndef PICKNIK_MAIN__SETTLE_DETECTOR
+#define PICKNIK_MAIN__SETTLE_DETECTOR
+
+// ROS
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+
+// Boost
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// C++
+#include <map>
+
+namespace picknik_main
+{
+/**
+ * \brief The robot is settled once, for a full window of time, no joint has moved further than
+ *        position_threshold from where it was at the start of the window and no reported velocity
+ *        exceeded velocity_threshold. Any larger motion restarts the window from that sample
+ */
+class SettleDetector
+{
+public:
+  /**
+   * \brief Constructor
+   * \param variable_names - joints to watch, others in the messages are ignored
+   * \param position_threshold - radians or meters
+   * \param velocity_threshold - only checked for messages that have velocities
+   * \param window - seconds without motion before the robot counts as settled
+   */
+  SettleDetector(const std::vector<std::string>& variable_names, double position_threshold,
+                 double velocity_threshold, double window);
+
+  /**
+   * \brief Feed a joint state message, called from the state monitor's callback
+   */
+  void update(const sensor_msgs::JointStateConstPtr& joint_state);
+
+  /**
+   * \brief Block until the robot is settled
+   * \param timeout - seconds
+   * \param time_to_settle - seconds from the call until settled, 0 if already settled
+   * \return false on timeout
+   */
+  bool waitForSettle(double timeout, double& time_to_settle);
+
+  /** \brief Whether the latest message completed a window without motion */
+  bool isSettled() const;
+
+private:
+  // Lookup from joint state name to index in our arrays
+  std::map<std::string, std::size_t> variable_indices_;
+
+  // Criteria
+  double position_threshold_;
+  double velocity_threshold_;
+  ros::Duration window_;
+
+  // Only accessed from the joint state callback
+  std::vector<double> positions_;
+  std::vector<double> window_start_positions_;
+  ros::Time window_start_stamp_;
+
+  // Guards settled_, signalled when it becomes true
+  mutable boost::mutex settled_mutex_;
+  boost::condition_variable settled_condition_;
+  bool settled_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<SettleDetector> SettleDetectorPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,151 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Follow joint trajectory controllers that play trajectories in simulated time, so that
+           offline runs take as long as they would on hardware (scaled by a real time factor)
+*/
+
+#ifndef PICKNIK_MAIN__SIMULATED_CONTROLLER
+#define PICKNIK_MAIN__SIMULATED_CONTROLLER
+
+// ROS
+#include <ros/ros.h>
+#include <actionlib/server/action_server.h>
+#include <control_msgs/FollowJointTrajectoryAction.h>
+#include <sensor_msgs/JointState.h>
+
+// MoveIt
+#include <moveit/robot_state/robot_state.h>
+
+// Boost
+#include <boost/thread.hpp>
+
+namespace picknik_main
+{
+typedef actionlib::ActionServer<control_msgs::FollowJointTrajectoryAction>
+    FollowJointTrajectoryServer;
+
+/**
+ * \brief Each update advances a simulated clock by 1/update_rate seconds and then sleeps
+ *        1/(update_rate * real_time_factor) wall seconds. Active trajectories are sampled at the
+ *        simulated time and all joints are published on joint_states. With publish_clock the
+ *        simulated time is also published on /clock, so that every node running with use_sim_time
+ *        (including MoveIt's execution timeouts) agrees on it and a factor above 1 is consistent.
+ *        A new goal replaces the active goal of the same controller, like ros_control does
+ */
+class SimulatedController
+{
+public:
+  /**
+   * \brief Constructor
+   * \param initial_state - where the robot starts, every variable of it is published
+   * \param real_time_factor - 1 is real time, 2 is twice as fast
+   * \param update_rate - simulated Hz
+   * \param publish_clock - publish the simulated time on /clock
+   */
+  SimulatedController(const moveit::core::RobotState& initial_state, double real_time_factor,
+                      double update_rate, bool publish_clock);
+
+  /**
+   * \brief Destructor
+   */
+  ~SimulatedController();
+
+  /**
+   * \brief Serve a FollowJointTrajectory action on name/action_ns for the given joints, the same
+   *        layout moveit_simple_controller_manager expects
+   * \return true on success
+   */
+  bool addController(const std::string& name, const std::string& action_ns,
+                     const std::vector<std::string>& joints);
+
+  /**
+   * \brief Begin publishing and accepting goals
+   */
+  void start();
+
+  /**
+   * \brief Abort active goals and stop the update thread
+   */
+  void stop();
+
+  /** \brief Total simulated time that any trajectory was executing */
+  double getExecutionTime() const;
+
+  double getRealTimeFactor() const { return real_time_factor_; }
+  ros::Time getSimulatedTime() const;
+
+private:
+  struct Controller
+  {
+    std::string name_;
+    std::vector<std::size_t> variable_indices_;  // of the controller's joints
+    boost::shared_ptr<FollowJointTrajectoryServer> server_;
+
+    // Active goal, indexed by the goal's joint order
+    bool active_;
+    FollowJointTrajectoryServer::GoalHandle goal_handle_;
+    trajectory_msgs::JointTrajectory trajectory_;
+    std::vector<std::size_t> goal_indices_;
+    ros::Time start_time_;
+  };
+  typedef boost::shared_ptr<Controller> ControllerPtr;
+
+  /**
+   * \brief Action server callbacks. Goal handles are only used without mutex_ held, because the
+   *        server calls in with its own lock held
+   */
+  void goalCallback(ControllerPtr controller, FollowJointTrajectoryServer::GoalHandle goal_handle);
+  void cancelCallback(ControllerPtr controller,
+                      FollowJointTrajectoryServer::GoalHandle goal_handle);
+
+  /** \brief Body of the background thread */
+  void updateThread();
+
+  /**
+   * \brief Set positions of a trajectory at a time from its start. Cubic between points that
+   *        have velocities, otherwise linear
+   * \return true if the end of the trajectory has been reached
+   */
+  bool sampleTrajectory(const Controller& controller, double time_from_start);
+
+  /** \brief Fill and send joint_states (and /clock), expects mutex_ to be held */
+  void publishState();
+
+  ros::NodeHandle nh_;
+  ros::Publisher joint_state_pub_;
+  ros::Publisher clock_pub_;
+
+  // Map joint names to published variables
+  std::map<std::string, std::size_t> variable_indices_;
+
+  // Settings
+  double real_time_factor_;
+  ros::Duration period_;
+  bool publish_clock_;
+
+  // Guards everything below
+  mutable boost::mutex mutex_;
+  std::vector<ControllerPtr> controllers_;
+  ros::Time simulated_time_;
+  ros::Duration execution_time_;
+  sensor_msgs::JointState joint_state_msg_;
+
+  boost::thread update_thread_;
+  bool running_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<SimulatedController> SimulatedControllerPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,93 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Latest joint positions published by the state monitor, readable without the scene lock
+*/
+
+#ifndef PICKNIK_MAIN__STATE_SNAPSHOT
+#define PICKNIK_MAIN__STATE_SNAPSHOT
+
+// ROS
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+
+// Boost
+#include <boost/thread/mutex.hpp>
+
+// C++
+#include <atomic>
+#include <map>
+#include <memory>
+
+namespace picknik_main
+{
+/**
+ * \brief Seqlock around a flat array of joint positions. There is a single writer at a time (the
+ *        joint state callback) and any number of readers. Readers never block the writer, they
+ *        just retry if a write happened during their copy
+ */
+class StateSnapshot
+{
+public:
+  /**
+   * \brief Constructor
+   * \param variable_names - order of the robot's variables, e.g. RobotModel::getVariableNames()
+   * \param initial_positions - value of every variable before any joint state arrives
+   */
+  StateSnapshot(const std::vector<std::string>& variable_names,
+                const std::vector<double>& initial_positions);
+
+  /**
+   * \brief Publish new values from a joint state message. Joints not in the robot are ignored and
+   *        joints not in the message keep their previous value
+   */
+  void update(const sensor_msgs::JointStateConstPtr& joint_state);
+
+  /**
+   * \brief Copy the latest snapshot
+   * \param positions - resized to the variable count, only allocates the first time
+   * \param stamp - time of the joint state that produced these positions
+   * \return false if no joint state has been received yet
+   */
+  bool read(std::vector<double>& positions, ros::Time& stamp) const;
+
+  /** \brief Number of joint state messages published so far */
+  std::size_t getUpdateCount() const { return sequence_.load(std::memory_order_acquire) / 2; }
+
+  /** \brief Number of reads that had to retry because a write happened at the same time */
+  std::size_t getReadRetries() const { return read_retries_.load(std::memory_order_relaxed); }
+
+  std::size_t getVariableCount() const { return variable_count_; }
+
+private:
+  std::size_t variable_count_;
+
+  // Lookup from joint state name to index in our array
+  std::map<std::string, std::size_t> variable_indices_;
+
+  // Odd while a write is in progress
+  std::atomic<std::size_t> sequence_;
+
+  std::unique_ptr<std::atomic<double>[]> positions_;
+  std::atomic<int64_t> stamp_nsec_;
+
+  // Only one thread may write at a time, readers never take this
+  boost::mutex write_mutex_;
+
+  mutable std::atomic<std::size_t> read_retries_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<StateSnapshot> StateSnapshotPtr;
+
+}  // end namespace
+
+#endif
@@ -22,34 +22,20 @@
 // PickNik
 #include <picknik_main/namespaces.h>
 #include <picknik_main/manipulation_data.h>
+#include <picknik_main/tactile_ring.h>
+#include <picknik_main/tactile_filter.h>
+#include <picknik_main/tactile_recording.h>
 
 // Visual Tools
 #include <rviz_visual_tools/rviz_visual_tools.h>
 
+// Boost
+#include <boost/thread.hpp>
+
 namespace picknik_main
 {
 static const std::string ATTACH_FRAME = "finger_sensor_pad";
 
-/** \brief Names of data sent from Gelsight to rest of BLUE
-           NOTE: this is copied from
-           gelsight/include/gelsight/image_processing.hpp
- */
-enum EndEffectorData
-{
-  SHEER_FORCE = 0,
-  LINE_CENTER_X,
-  LINE_CENTER_Y,
-  LINE_EIGEN_VEC_X,
-  LINE_EIGEN_VEC_Y,
-  LINE_EIGEN_VAL,
-  SHEER_DISPLACEMENT_X,
-  SHEER_DISPLACEMENT_Y,
-  SHEER_TORQUE,
-  IMAGE_HEIGHT,
-  IMAGE_WIDTH,
-  ALWAYS_AT_END  // for counting array size
-};
-
 class TactileFeedback
 {
 public:
@@ -58,12 +44,65 @@ public:
    */
   TactileFeedback(ManipulationDataPtr config);
 
+  /**
+   * \brief Destructor
+   */
+  ~TactileFeedback();
+
   /** \brief Send command to remote sensor to reset itself */
   void recalibrateTactileSensor();
 
-  double getSheerTheta() { return sheer_theta_; };
-  double getSheerForce() { return end_effector_data_cached_[SHEER_FORCE]; };
-  double getSheerTorque() { return end_effector_data_cached_[SHEER_TORQUE]; };
+  /** \brief Values of the newest sample, 0 before any data has arrived */
+  double getSheerTheta() { return getLatestValue(ALWAYS_AT_END); };
+  double getSheerForce() { return getLatestValue(SHEER_FORCE); };
+  double getSheerTorque() { return getLatestValue(SHEER_TORQUE); };
+
+  /**
+   * \brief Copy the newest sample
+   * \return false if no data has arrived yet
+   */
+  bool getLatestSample(TactileSample& sample) const { return tactile_ring_->getLatest(sample); }
+
+  /**
+   * \brief Copy up to count of the newest samples, oldest first
+   * \return false if no data has arrived yet
+   */
+  bool getSampleWindow(std::size_t count, std::vector<TactileSample>& samples) const
+  {
+    return tactile_ring_->getWindow(count, samples);
+  }
+
+  /**
+   * \brief Whether the sheer force has stayed within threshold for the newest window of samples,
+   *        all taken after since. Only call from one thread at a time
+   * \return true without any samples newer than since, e.g. no sensor attached
+   */
+  bool isSheerForceSteady(const ros::Time& since, const ros::Duration& window, double threshold);
+
+  /**
+   * \brief Filter, record and store one sensor message. Called by the subscriber, replay runs its
+   *        own TactileFilter with the same settings instead
+   * \param data - ALWAYS_AT_END raw values
+   */
+  void addSample(const ros::Time& stamp, const double* data);
+
+  /**
+   * \brief Save a pose sent to the robot alongside the tactile data, if recording
+   */
+  void recordCommand(const Eigen::Affine3d& pose, double duration);
+
+  /**
+   * \brief How far to rotate the tool about its y axis in response to a sheer torque
+   * \param sheer_torque - filtered sensor value, 0 is the calibrated position
+   * \return false if the torque is too small to react to, in which case rotation is 0
+   */
+  static bool computeInsertionRotation(double sheer_torque, double torque_min, double torque_max,
+                                       double torque_scale, double& rotation);
+
+  /** \brief Noise filter applied to every sample before it is stored */
+  TactileFilterPtr getFilter() { return tactile_filter_; }
+
+  /** \brief Called on the subscriber thread after every sample, keep it short */
   void setEndEffectorDataCallback(std::function<void()> function)
   {
     end_effector_data_callback_ = function;
@@ -72,13 +111,22 @@ public:
 private:
   void dataCallback(const std_msgs::Float64MultiArray::ConstPtr& msg);
 
-  void displayLineDirection();
+  /** \brief A data field of the newest sample, ALWAYS_AT_END for the sheer theta */
+  double getLatestValue(std::size_t field);
+
+  /** \brief Angle of the sheer displacement from the center of the sensor */
+  static double computeSheerTheta(const TactileSample& sample);
+
+  /** \brief Draw the newest sample at a low rate, off the control path */
+  void visualizationThread();
 
-  void displaySheerForce();
+  void displayLineDirection(const TactileSample& sample);
+
+  void displaySheerForce(const TactileSample& sample);
 
   void publishUpdatedLine(geometry_msgs::Point& pt1, geometry_msgs::Point& pt2);
 
-  void convertPixelToMeters(geometry_msgs::Pose& pose, int height, int width);
+  static void convertPixelToMeters(geometry_msgs::Pose& pose, int height, int width);
 
   // A shared node handle
   ros::NodeHandle nh_;
@@ -89,14 +137,27 @@ private:
   // Publish commands to re-calibrate sensor
   ros::Publisher tactile_calibration_pub_;
 
-  double sheer_theta_;
-  std::vector<double> end_effector_data_cached_;
+  // History of samples, lock-free for readers
+  TactileRingPtr tactile_ring_;
+
+  // Reused by isSheerForceSteady()
+  std::vector<TactileSample> steady_samples_;
+
+  // Reduce noise before controllers see the data, only used on the subscriber thread
+  TactileFilterPtr tactile_filter_;
+  std::atomic<bool> reset_filter_;
+
+  // Raw data and commands for offline tuning, only when enabled
+  TactileRecorderPtr tactile_recorder_;
 
   // Allow a callback to be added whenever new end effector data is recieved
   std::function<void()> end_effector_data_callback_;
 
   // Show data
   rviz_visual_tools::RvizVisualToolsPtr visual_tools_;
+  double visualization_rate_;
+  boost::thread visualization_thread_;
+  std::atomic<bool> running_;
 
 };  // end class
 
@@ -0,0 +1,136 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Per channel noise filtering of tactile sensor data before controllers react to it
+*/
+
+#ifndef PICKNIK_MAIN__TACTILE_FILTER
+#define PICKNIK_MAIN__TACTILE_FILTER
+
+// ROS
+#include <ros/ros.h>
+
+// PickNik
+#include <picknik_main/tactile_ring.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+// C++
+#include <atomic>
+
+namespace picknik_main
+{
+enum TactileFilterType
+{
+  TACTILE_FILTER_NONE = 0,
+  TACTILE_FILTER_MEDIAN,    // rejects spikes, delays by half the window
+  TACTILE_FILTER_EMA,       // exponential moving average, fixed smoothing
+  TACTILE_FILTER_ONE_EURO,  // smooths when still, follows quickly when the signal moves
+  TACTILE_FILTER_KALMAN     // constant value model, noise variances set the smoothing
+};
+
+/** \brief Settings shared by all channels, unused ones are ignored */
+struct TactileFilterSettings
+{
+  TactileFilterSettings();
+
+  TactileFilterType type_;
+  int median_window_;             // samples, odd, at most TactileFilter::MAX_MEDIAN_WINDOW
+  double ema_alpha_;              // 0 -> 1, weight of the newest sample
+  double one_euro_min_cutoff_;    // hz
+  double one_euro_beta_;          // cutoff increase per unit of signal speed
+  double one_euro_d_cutoff_;      // hz, for the speed estimate
+  double kalman_process_noise_;   // variance per second
+  double kalman_measurement_noise_;  // variance
+};
+
+/**
+ * \brief Filters every data channel of a sample independently. State is fixed size so filtering
+ *        never allocates, and the cost of every sample is measured. The image size channels are
+ *        passed through untouched. Only call from one thread at a time
+ */
+class TactileFilter
+{
+public:
+  static const std::size_t MAX_MEDIAN_WINDOW = 15;
+
+  /**
+   * \brief Constructor
+   */
+  TactileFilter(const TactileFilterSettings& settings);
+
+  /**
+   * \brief Convert a name from the config file
+   * \return false if the name is unknown
+   */
+  static bool parseType(const std::string& name, TactileFilterType& type);
+
+  /**
+   * \brief Filter the data of a sample in place
+   */
+  void filter(TactileSample& sample);
+
+  /**
+   * \brief Forget history, e.g. after the sensor has been recalibrated
+   */
+  void reset();
+
+  /**
+   * \brief Samples of delay the filter adds to a step change, roughly
+   */
+  double getLatencySamples() const;
+
+  /**
+   * \brief Show the per sample cost
+   */
+  void printStats() const;
+
+  std::size_t getSampleCount() const { return samples_; }
+  double getMeanCostNSec() const { return samples_ ? double(cost_sum_nsec_) / samples_ : 0.0; }
+  int64_t getMaxCostNSec() const { return cost_max_nsec_; }
+
+private:
+  double filterMedian(std::size_t channel, double value);
+  double filterEMA(std::size_t channel, double value);
+  double filterOneEuro(std::size_t channel, double value, double dt);
+  double filterKalman(std::size_t channel, double value, double dt);
+
+  /** \brief Whether a channel holds a measurement rather than a constant */
+  static bool isFiltered(std::size_t channel);
+
+  TactileFilterSettings settings_;
+
+  bool initialized_;
+  ros::Time last_stamp_;
+
+  // Median, circular window per channel
+  double median_history_[ALWAYS_AT_END][MAX_MEDIAN_WINDOW];
+  std::size_t median_count_;
+  std::size_t median_next_;
+
+  // EMA, one euro and kalman estimates
+  double estimate_[ALWAYS_AT_END];
+  double derivative_[ALWAYS_AT_END];  // one euro
+  double variance_[ALWAYS_AT_END];    // kalman
+
+  // Statistics, read from other threads
+  std::atomic<std::size_t> samples_;
+  std::atomic<int64_t> cost_sum_nsec_;
+  std::atomic<int64_t> cost_max_nsec_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<TactileFilter> TactileFilterPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,160 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Record raw tactile data and commanded poses to a compact binary file, and play it back
+           at any speed so that insertion tuning can be done offline
+*/
+
+#ifndef PICKNIK_MAIN__TACTILE_RECORDING
+#define PICKNIK_MAIN__TACTILE_RECORDING
+
+// ROS
+#include <ros/ros.h>
+
+// PickNik
+#include <picknik_main/tactile_ring.h>
+
+// Eigen
+#include <Eigen/Geometry>
+
+// Boost
+#include <boost/thread.hpp>
+#include <boost/lockfree/queue.hpp>
+
+// C++
+#include <atomic>
+#include <fstream>
+#include <functional>
+
+namespace picknik_main
+{
+enum TactileRecordType
+{
+  TACTILE_RECORD_SAMPLE = 0,  // values_ are the raw sensor data
+  TACTILE_RECORD_COMMAND = 1  // values_ are x, y, z, qx, qy, qz, qw, duration
+};
+
+static const std::size_t TACTILE_COMMAND_VALUES = 8;
+
+/** \brief One entry of a recording, trivially copyable so it can go in a lock-free queue */
+struct TactileRecord
+{
+  uint8_t type_;
+  int64_t stamp_nsec_;
+  double values_[ALWAYS_AT_END];
+
+  std::size_t getValueCount() const
+  {
+    return type_ == TACTILE_RECORD_COMMAND ? TACTILE_COMMAND_VALUES : ALWAYS_AT_END;
+  }
+};
+
+/**
+ * \brief Producers on any thread push records into a lock-free queue, a background thread
+ *        writes them out in batches so the sensor and control loops never touch the disk
+ */
+class TactileRecorder
+{
+public:
+  /**
+   * \brief Constructor - truncates the file and starts the writer thread
+   */
+  TactileRecorder(const std::string& file_path);
+
+  /**
+   * \brief Destructor - writes anything still queued then stops the writer thread
+   */
+  ~TactileRecorder();
+
+  /**
+   * \brief Queue one raw sensor message
+   * \param data - ALWAYS_AT_END values, before any filtering
+   */
+  void recordSample(const ros::Time& stamp, const double* data);
+
+  /**
+   * \brief Queue one pose sent to the robot
+   */
+  void recordCommand(const ros::Time& stamp, const Eigen::Affine3d& pose, double duration);
+
+  /** \brief Output counters to console */
+  void printStats() const;
+
+  /**
+   * \brief Load a whole recording
+   * \return false if the file could not be opened or is not a tactile recording
+   */
+  static bool readFile(const std::string& file_path, std::vector<TactileRecord>& records);
+
+  /** \brief Unpack a command record */
+  static void getCommandPose(const TactileRecord& record, Eigen::Affine3d& pose, double& duration);
+
+private:
+  void push(const TactileRecord& record);
+
+  /** \brief Body of the background thread */
+  void writerThread();
+
+  /** \brief Write everything queued so far */
+  void drain();
+
+  std::ofstream output_file_;
+  std::string file_path_;
+
+  boost::lockfree::queue<TactileRecord> queue_;
+  boost::thread writer_thread_;
+  std::atomic<bool> running_;
+
+  // Statistics
+  std::atomic<std::size_t> recorded_;
+  std::atomic<std::size_t> dropped_;
+  std::atomic<std::size_t> written_bytes_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<TactileRecorder> TactileRecorderPtr;
+
+/**
+ * \brief Plays a recording back with the original spacing between records, scaled by a speed
+ *        factor. Runs on the calling thread
+ */
+class TactileReplay
+{
+public:
+  typedef std::function<void(const ros::Time& stamp, const double* data)> SampleCallback;
+  typedef std::function<void(const ros::Time& stamp, const Eigen::Affine3d& pose,
+                             double duration)> CommandCallback;
+
+  /**
+   * \brief Constructor
+   */
+  TactileReplay(const std::vector<TactileRecord>& records);
+
+  /**
+   * \brief Feed every record to the callbacks
+   * \param speed - multiple of real time, 0 or less to not wait at all
+   * \param sample_callback - required
+   * \param command_callback - may be empty
+   * \return false if interrupted by ros shutdown
+   */
+  bool play(double speed, const SampleCallback& sample_callback,
+            const CommandCallback& command_callback = CommandCallback());
+
+  /** \brief Seconds between the first and last record */
+  double getDuration() const;
+
+private:
+  const std::vector<TactileRecord>& records_;
+};  // end class
+
+}  // end namespace
+
+#endif
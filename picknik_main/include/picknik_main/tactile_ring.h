@@ -0,0 +1,121 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Lock-free history of tactile sensor samples, written by the sensor callback and read by
+           any number of control and visualization threads
+*/
+
+#ifndef PICKNIK_MAIN__TACTILE_RING
+#define PICKNIK_MAIN__TACTILE_RING
+
+// ROS
+#include <ros/ros.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+// C++
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace picknik_main
+{
+/** \brief Names of data sent from Gelsight to rest of BLUE
+           NOTE: this is copied from
+           gelsight/include/gelsight/image_processing.hpp
+ */
+enum EndEffectorData
+{
+  SHEER_FORCE = 0,
+  LINE_CENTER_X,
+  LINE_CENTER_Y,
+  LINE_EIGEN_VEC_X,
+  LINE_EIGEN_VEC_Y,
+  LINE_EIGEN_VAL,
+  SHEER_DISPLACEMENT_X,
+  SHEER_DISPLACEMENT_Y,
+  SHEER_TORQUE,
+  IMAGE_HEIGHT,
+  IMAGE_WIDTH,
+  ALWAYS_AT_END  // for counting array size
+};
+
+/** \brief One message from the sensor plus values derived from it */
+struct TactileSample
+{
+  ros::Time stamp_;
+  double data_[ALWAYS_AT_END];
+  double sheer_theta_;  // radians
+};
+
+/**
+ * \brief Single writer ring that overwrites its oldest samples. Readers never block the writer or
+ *        each other: they copy, then check that the writer did not lap the samples they copied
+ *        in the meantime, and retry if it did
+ */
+class TactileRing
+{
+public:
+  /**
+   * \brief Constructor
+   * \param capacity - samples of history kept, rounded up to a power of two
+   */
+  TactileRing(std::size_t capacity);
+
+  /**
+   * \brief Add a sample, only ever call from one thread at a time
+   */
+  void push(const TactileSample& sample);
+
+  /**
+   * \brief Copy the newest sample
+   * \return false if nothing has been pushed yet
+   */
+  bool getLatest(TactileSample& sample) const;
+
+  /**
+   * \brief Copy up to count of the newest samples, oldest first
+   * \param samples - resized to the number copied
+   * \return false if nothing has been pushed yet
+   */
+  bool getWindow(std::size_t count, std::vector<TactileSample>& samples) const;
+
+  /** \brief Total samples ever pushed */
+  std::size_t getPushCount() const { return write_count_.load(std::memory_order_acquire); }
+
+  std::size_t getCapacity() const { return capacity_; }
+
+private:
+  struct Slot
+  {
+    std::atomic<int64_t> stamp_nsec_;
+    std::atomic<double> data_[ALWAYS_AT_END];
+    std::atomic<double> sheer_theta_;
+  };
+
+  /** \brief Copy out of a slot without synchronization, validated by the caller */
+  void readSlot(std::size_t index, TactileSample& sample) const;
+
+  std::size_t capacity_;
+  std::size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Index of the next sample to be written
+  std::atomic<std::size_t> write_count_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<TactileRing> TactileRingPtr;
+
+}  // end namespace
+
+#endif
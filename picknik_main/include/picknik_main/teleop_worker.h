@@ -0,0 +1,115 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Turn interactive marker feedback into robot commands on one thread at a bounded rate,
+           always working on the newest target
+*/
+
+#ifndef PICKNIK_MAIN__TELEOP_WORKER
+#define PICKNIK_MAIN__TELEOP_WORKER
+
+// ROS
+#include <ros/ros.h>
+
+// Eigen
+#include <Eigen/Geometry>
+
+// Boost
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+// C++
+#include <chrono>
+
+namespace picknik_main
+{
+/**
+ * \brief Marker callbacks only overwrite a single pending target and return. The worker thread
+ *        wakes when one is pending, waits out the rest of its period if the last command was too
+ *        recent, then takes the newest target and hands it to the callback. Targets replaced before
+ *        the worker got to them are counted as dropped. The time from receiving a target to the
+ *        callback returning is the marker to command latency
+ */
+class TeleopWorker
+{
+public:
+  /**
+   * \brief Solve and send one target
+   * \param world_to_ee - desired end effector pose in the world frame
+   * \param move - false to only visualize
+   * \return false if it could not be reached
+   */
+  typedef boost::function<bool(const Eigen::Affine3d& world_to_ee, bool move)> CommandCallback;
+
+  /**
+   * \brief Constructor - starts the worker thread
+   * \param rate - hz, most targets to hand to the callback, throws std::invalid_argument if not
+   *        positive
+   */
+  TeleopWorker(const CommandCallback& callback, double rate);
+
+  /**
+   * \brief Destructor - a pending target is discarded
+   */
+  ~TeleopWorker();
+
+  /**
+   * \brief Replace the pending target, safe to call from any thread. A pending request to move is
+   *        kept even if the newer target is only for visualization
+   */
+  void push(const Eigen::Affine3d& world_to_ee, bool move);
+
+  /**
+   * \brief Show counts and latency
+   */
+  void printStats() const;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * \brief Reject rates that do not give a finite period
+   * \return rate
+   */
+  static double checkRate(double rate);
+
+  /** \brief Body of the worker thread */
+  void workerThread();
+
+  CommandCallback callback_;
+  Clock::duration period_;
+
+  // Latest value wins slot
+  mutable boost::mutex target_mutex_;
+  boost::condition_variable target_condition_;
+  bool pending_;
+  bool shutdown_;
+  Eigen::Affine3d world_to_ee_;
+  bool move_;
+  Clock::time_point receive_time_;
+
+  boost::thread worker_thread_;
+
+  // Statistics, guarded by target_mutex_
+  std::size_t received_;
+  std::size_t dropped_;
+  std::size_t commanded_;
+  std::size_t failed_;
+  double latency_sum_;  // seconds
+  double latency_max_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<TeleopWorker> TeleopWorkerPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,134 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Binary, column-major trajectory file that is memory mapped for instant playback
+*/
+
+#ifndef PICKNIK_MAIN__TRAJECTORY_FILE
+#define PICKNIK_MAIN__TRAJECTORY_FILE
+
+// ROS
+#include <ros/ros.h>
+#include <moveit_msgs/RobotTrajectory.h>
+
+// MoveIt
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+
+namespace picknik_main
+{
+/**
+ * \brief File layout, host byte order:
+ *          header: magic, version, robot model hash, velocity scaling factor, source hash,
+ *                  joint count, point count, size of name block
+ *          name block: group name then each joint name, each prefixed by a uint16 length, padded
+ *                      to 8 bytes
+ *          columns: time from start for every point, then per joint all positions, all
+ *                   velocities, all accelerations
+ *        The timing is what the iterative parabolic smoother produced for the stored velocity
+ *        scaling factor, so playback at that speed needs no further processing
+ */
+class TrajectoryFile
+{
+public:
+  /**
+   * \brief Constructor
+   */
+  TrajectoryFile();
+
+  /**
+   * \brief Destructor - unmaps the file
+   */
+  ~TrajectoryFile();
+
+  /**
+   * \brief Write a time-parameterized trajectory of one planning group
+   * \param source_hash - hashFile() of the file the trajectory was made from, 0 if none
+   * \return true on success
+   */
+  static bool write(const std::string& file_path,
+                    const robot_trajectory::RobotTrajectory& robot_trajectory,
+                    double velocity_scaling_factor, uint64_t source_hash = 0);
+
+  /**
+   * \brief Memory map a file. Previously returned column pointers become invalid
+   * \return true on success
+   */
+  bool load(const std::string& file_path);
+
+  /**
+   * \brief Create a message that can be sent to the execution interface
+   */
+  void getTrajectoryMsg(moveit_msgs::RobotTrajectory& trajectory_msg) const;
+
+  /**
+   * \brief Identify a robot by its name and the names and limits of every variable, so that a file
+   *        recorded with a different URDF is not played back
+   */
+  static uint64_t hashRobotModel(const moveit::core::RobotModel& robot_model);
+
+  /**
+   * \brief Stable 64-bit hash (FNV-1a) of raw bytes, can be chained by passing in a previous hash
+   */
+  static uint64_t hashData(const void* data, std::size_t size,
+                           uint64_t hash = 14695981039346656037ULL);
+
+  /**
+   * \brief hashData() of the contents of a file
+   * \return false if the file could not be read
+   */
+  static bool hashFile(const std::string& file_path, uint64_t& hash);
+
+  uint64_t getRobotModelHash() const { return robot_model_hash_; }
+  double getVelocityScalingFactor() const { return velocity_scaling_factor_; }
+  uint64_t getSourceHash() const { return source_hash_; }
+  const std::string& getGroupName() const { return group_name_; }
+  const std::vector<std::string>& getJointNames() const { return joint_names_; }
+  std::size_t getPointCount() const { return num_points_; }
+
+  // Columns
+  const double* getTimes() const { return times_; }
+  const double* getPositions(std::size_t joint) const { return positions_ + joint * num_points_; }
+  const double* getVelocities(std::size_t joint) const { return velocities_ + joint * num_points_; }
+  const double* getAccelerations(std::size_t joint) const
+  {
+    return accelerations_ + joint * num_points_;
+  }
+
+private:
+  /** \brief Release the current mapping */
+  void unload();
+
+  // Memory mapping
+  void* mapped_data_;
+  std::size_t mapped_size_;
+
+  // Header
+  uint64_t robot_model_hash_;
+  double velocity_scaling_factor_;
+  uint64_t source_hash_;
+  std::string group_name_;
+  std::vector<std::string> joint_names_;
+  std::size_t num_points_;
+
+  // Pointers into the mapped file
+  const double* times_;
+  const double* positions_;
+  const double* velocities_;
+  const double* accelerations_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<TrajectoryFile> TrajectoryFilePtr;
+
+}  // end namespace
+
+#endif
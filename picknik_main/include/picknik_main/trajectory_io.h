@@ -65,6 +65,52 @@ public:
   bool playbackTrajectoryFromFile(const std::string& file_name, JointModelGroup* arm_jmg,
                                   double velocity_scaling_factor);
 
+  /**
+   * \brief Parse a CSV of robot states then interpolate and time-parameterize it
+   * \param robot_traj - resulting trajectory
+   * \return true on success
+   */
+  bool loadTrajectoryFromCSV(const std::string& file_name, JointModelGroup* arm_jmg,
+                             double velocity_scaling_factor,
+                             robot_trajectory::RobotTrajectoryPtr& robot_traj);
+
+  /**
+   * \brief Memory map a binary trajectory, re-timing it only if saved for a different speed
+   * \param csv_hash - TrajectoryFile::hashFile() of the CSV it should have been made from, 0 to
+   *        accept any
+   * \param trajectory_msg - resulting trajectory
+   * \return false if the file is missing, out of date, or was made for a different robot or
+   *         planning group
+   */
+  bool loadTrajectoryFromBinary(const std::string& file_name, JointModelGroup* arm_jmg,
+                                double velocity_scaling_factor, uint64_t csv_hash,
+                                moveit_msgs::RobotTrajectory& trajectory_msg);
+
+  /**
+   * \brief Save the binary version of a CSV trajectory next to it
+   * \return true on success
+   */
+  bool convertCSVToBinary(const std::string& file_name, JointModelGroup* arm_jmg,
+                          double velocity_scaling_factor);
+
+  /**
+   * \brief Write a binary trajectory back out as CSV of robot states
+   * \return true on success
+   */
+  bool convertBinaryToCSV(const std::string& binary_file_name, const std::string& file_name);
+
+  /**
+   * \brief Convert every CSV of robot states in the trajectories folder. Other CSVs, such as
+   *        waypoint files, are skipped
+   * \return true on success
+   */
+  bool convertAllCSVToBinary(JointModelGroup* arm_jmg, double velocity_scaling_factor);
+
+  /**
+   * \brief Location of the binary version of a CSV trajectory
+   */
+  std::string getBinaryFilePath(const std::string& file_path) const;
+
   /**
    * \brief Read a waypoint trajectory from CSV and execute on robot
    * \param file_name - location of file
@@ -76,6 +122,20 @@ public:
   bool playbackWaypointsFromFile(const std::string& file_name, JointModelGroup* arm_jmg,
                                  double velocity_scaling_factor);
 
+  /**
+   * \brief Location of the cached joint solution of a waypoint file, unique to the file contents,
+   *        robot model, planning group and region the arm is starting from
+   */
+  std::string getWaypointCachePath(const std::string& file_name, const std::string& file_contents,
+                                   JointModelGroup* arm_jmg);
+
+  /**
+   * \brief Load a joint solution saved by playbackWaypointsFromFile()
+   * \return false if missing or made for a different robot
+   */
+  bool loadSolvedWaypointPath(const std::string& file_name, JointModelGroup* arm_jmg,
+                              std::vector<moveit::core::RobotStatePtr>& solved_path);
+
   /**
    * \brief Read a trajectory from CSV and execute on robot state by state
    * \param file_name - location of file
@@ -109,6 +169,12 @@ public:
    */
   bool getFilePath(std::string& file_path, const std::string& file_name) const;
 
+  /**
+   * \brief Whether a CSV holds robot states, i.e. its first line has one number per variable of
+   *        the robot model
+   */
+  bool isRobotStateCSV(const std::string& file_name) const;
+
 private:
   // A shared node handle
   ros::NodeHandle nh_;
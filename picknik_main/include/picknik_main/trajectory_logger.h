@@ -0,0 +1,121 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Save executed trajectories to disk on a background thread in a compact binary format
+*/
+
+#ifndef PICKNIK_MAIN__TRAJECTORY_LOGGER
+#define PICKNIK_MAIN__TRAJECTORY_LOGGER
+
+// ROS
+#include <ros/ros.h>
+#include <moveit_msgs/RobotTrajectory.h>
+
+// Boost
+#include <boost/thread.hpp>
+
+// C++
+#include <atomic>
+#include <deque>
+#include <fstream>
+
+namespace picknik_main
+{
+/**
+ * \brief One trajectory as stored in the log file. Values are flattened point by point, i.e.
+ *        positions_[point * joint_names_.size() + joint]
+ */
+struct TrajectoryLogRecord
+{
+  std::string name_;
+  std::vector<std::string> joint_names_;
+  bool has_velocities_;
+  bool has_accelerations_;
+  std::vector<double> times_;
+  std::vector<double> positions_;
+  std::vector<double> velocities_;
+  std::vector<double> accelerations_;
+};
+
+class TrajectoryLogger
+{
+public:
+  /**
+   * \brief Constructor - opens the log file and starts the writer thread
+   * \param file_path - binary file all trajectories are appended to
+   * \param max_buffered_bytes - trajectories are dropped rather than queued beyond this
+   */
+  TrajectoryLogger(const std::string& file_path, std::size_t max_buffered_bytes);
+
+  /**
+   * \brief Destructor - writes anything still queued then stops the writer thread
+   */
+  ~TrajectoryLogger();
+
+  /**
+   * \brief Encode a trajectory and queue it for writing. Never touches the disk
+   * \param name - used as the file name when exporting to CSV
+   * \return false if the trajectory was dropped because the buffer is full
+   */
+  bool log(const std::string& name, const moveit_msgs::RobotTrajectory& trajectory_msg);
+
+  /** \brief Number of trajectories that did not fit in the buffer */
+  std::size_t getDropCount() const { return dropped_; }
+
+  /** \brief Number of trajectories written to disk */
+  std::size_t getWriteCount() const { return written_; }
+
+  /** \brief Output counters to console */
+  void printStats() const;
+
+  /**
+   * \brief Read the next trajectory out of a log file
+   * \return false at end of file or on a corrupt record
+   */
+  static bool readRecord(std::istream& input, TrajectoryLogRecord& record);
+
+  /**
+   * \brief Write a record in the same CSV layout the trajectory analysis scripts expect
+   * \return true on success
+   */
+  static bool writeCSV(const TrajectoryLogRecord& record, std::ostream& output);
+
+private:
+  /** \brief Body of the background thread */
+  void writerThread();
+
+  std::ofstream output_file_;
+  std::string file_path_;
+
+  // Encoded trajectories waiting to be written, and emptied buffers kept for reuse
+  std::deque<std::vector<char>*> queue_;
+  std::vector<std::vector<char>*> free_buffers_;
+  std::size_t queued_bytes_;
+  std::size_t max_buffered_bytes_;
+
+  boost::mutex queue_mutex_;
+  boost::condition_variable queue_condition_;
+  boost::thread writer_thread_;
+  bool shutdown_;
+
+  // Statistics
+  std::atomic<std::size_t> logged_;
+  std::atomic<std::size_t> dropped_;
+  std::atomic<std::size_t> written_;
+  std::atomic<std::size_t> written_bytes_;
+};  // end class
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<TrajectoryLogger> TrajectoryLoggerPtr;
+
+}  // end namespace
+
+#endif
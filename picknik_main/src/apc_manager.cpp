@@ -27,6 +27,10 @@
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 
+// C++
+#include <algorithm>
+#include <limits>
+
 namespace picknik_main
 {
 APCManager::APCManager(bool verbose, std::string order_file_path, bool autonomous,
@@ -37,6 +41,9 @@ APCManager::APCManager(bool verbose, std::string order_file_path, bool autonomou
   , skip_homing_step_(true)
   , next_dropoff_location_(0)
   , order_file_path_(order_file_path)
+  , order_jump_to_(0)
+  , grasp_chosen_(false)
+  , grasp_attempted_(false)
 {
   // Warn of fake modes
   if (fake_perception)
@@ -133,11 +140,45 @@ APCManager::APCManager(bool verbose, std::string order_file_path, bool autonomou
   // Allow collisions between frame of robot and floor
   allowCollisions(config_->right_arm_);  // jaco-specific
 
+  // Load health monitor, started by the first checkSystemReady()
+  health_monitor_.reset(new HealthMonitor(config_->health_check_rate_));
+  health_monitor_->addCheck("controllers",
+                            boost::bind(&ExecutionInterface::checkControllersActive,
+                                        manipulation_->getExecutionInterface()));
+  if (!fake_perception_)
+    health_monitor_->addCheck("perception", boost::bind(&PerceptionInterface::isPerceptionConnected,
+                                                        perception_interface_));
+  StateSnapshotPtr state_snapshot = manipulation_->getExecutionInterface()->getStateSnapshot();
+  if (state_snapshot)
+    health_monitor_->watchJointStates(state_snapshot, config_->joint_state_timeout_);
+
+  // Load grasps that worked in earlier runs
+  grasp_memory_.reset(new GraspMemory(config_->grasp_memory_position_tolerance_,
+                                      config_->grasp_memory_angle_tolerance_));
+  grasp_memory_file_ = package_path_ + "/orders/grasp_memory.csv";
+  grasp_memory_->load(grasp_memory_file_);
+
   ROS_INFO_STREAM_NAMED("apc_manager", "APCManager Ready.");
 }
 
 bool APCManager::checkSystemReady(bool remove_from_shelf)
 {
+  // After the first full check, the monitor has already been keeping track in the background
+  if (health_monitor_->isStarted())
+  {
+    if (!health_monitor_->isHealthy())
+    {
+      ROS_ERROR_STREAM_NAMED("apc_manager", "System is not healthy");
+      health_monitor_->printStatus();
+      return false;
+    }
+
+    // Fixing the robot state is not a health check, it still runs every time
+    if (remove_from_shelf)
+      removeFromShelf();
+    return true;
+  }
+
   std::cout << std::endl;
   std::cout << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
@@ -174,22 +215,9 @@ bool APCManager::checkSystemReady(bool remove_from_shelf)
     perception_interface_->isPerceptionReady();
   }
 
-  // Choose which planning group to use
-  JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
-
   // Check robot state valid
   if (remove_from_shelf)
-  {
-    planning_scene_manager_->displayShelfAsWall();  // Reduce collision model to simple wall that
-                                                    // prevents Robot from hitting shelf
-    while (ros::ok() && !manipulation_->fixCurrentCollisionAndBounds(arm_jmg))
-    {
-      // Show the current state just for the heck of it
-      publishCurrentState();
-
-      ros::Duration(0.5).sleep();
-    }
-  }
+    removeFromShelf();
 
   // Check robot calibrated
   // TODO
@@ -200,11 +228,35 @@ bool APCManager::checkSystemReady(bool remove_from_shelf)
   // Check end effectors calibrated
   // TODO
 
+  // Keep watching from now on
+  if (!health_monitor_->start())
+  {
+    ROS_FATAL_STREAM_NAMED("apc_manager", "Health monitor found a problem");
+    health_monitor_->printStatus();
+    return false;
+  }
+
   ROS_INFO_STREAM_NAMED("apc_manager", "System ready check COMPLETE");
   std::cout << "-------------------------------------------------------" << std::endl;
   return true;
 }
 
+void APCManager::removeFromShelf()
+{
+  // Choose which planning group to use
+  JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
+
+  planning_scene_manager_->displayShelfAsWall();  // Reduce collision model to simple wall that
+                                                  // prevents Robot from hitting shelf
+  while (ros::ok() && !manipulation_->fixCurrentCollisionAndBounds(arm_jmg))
+  {
+    // Show the current state just for the heck of it
+    publishCurrentState();
+
+    ros::Duration(0.5).sleep();
+  }
+}
+
 // Mode 1
 bool APCManager::mainOrderProcessor(std::size_t order_start, std::size_t jump_to,
                                     std::size_t num_orders)
@@ -217,7 +269,12 @@ bool APCManager::mainOrderProcessor(std::size_t order_start, std::size_t jump_to
   if (fake_perception_)
     createRandomProductPoses();
 
-  return runOrder(order_start, jump_to, num_orders);
+  bool result = runOrder(order_start, jump_to, num_orders);
+
+  // Show where the time went, whether or not all orders succeeded
+  manipulation_->getExecutionInterface()->getLatencyStats()->printSummary();
+
+  return result;
 }
 
 bool APCManager::runOrder(std::size_t order_start, std::size_t jump_to, std::size_t num_orders)
@@ -226,66 +283,107 @@ bool APCManager::runOrder(std::size_t order_start, std::size_t jump_to, std::siz
   if (num_orders == 0)
     num_orders = orders_.size();
 
-  // Grasps things
+  // Estimate every order up front, the scheduler decides what runs next
+  order_scheduler_.reset(new OrderScheduler(
+      config_->order_time_limit_, config_->order_default_duration_,
+      config_->order_mistake_probability_, config_->order_max_attempts_,
+      config_->order_time_budget_));
+  order_scheduler_->setDualArm(config_->dual_arm_);
+  order_scheduler_->loadItemData(package_path_ + "/orders/items_data.csv");
+  scheduler_to_order_.clear();
   for (std::size_t i = order_start; i < num_orders; ++i)
   {
-    if (!ros::ok())
-      return false;
+    order_scheduler_->addOrder(orders_[i].product_->getName(), orders_[i].bin_->getName(),
+                               orders_[i].bin_->getProducts().size());
+    scheduler_to_order_.push_back(i);
+  }
+  order_jump_to_ = jump_to;
 
-    std::cout << std::endl << MOVEIT_CONSOLE_COLOR_BROWN;
-    std::cout << "=======================================================" << std::endl;
-    std::cout << "Starting order " << i << std::endl;
-    std::cout << "=======================================================";
-    std::cout << MOVEIT_CONSOLE_COLOR_RESET << std::endl;
+  // Grasps things
+  OrderRunner runner(order_scheduler_, boost::bind(&APCManager::attemptOrder, this, _1, _2),
+                     boost::bind(&APCManager::checkSystemReady, this, true),
+                     boost::bind(&APCManager::finishOrder, this, _1, _2, _3));
+  if (!runner.run(!config_->isEnabled("super_auto")))
+    return false;
 
-    // Check every product if system is still ready
-    if (!checkSystemReady())
-      return false;
+  statusPublisher("Finished");
 
-    // Clear old grasp markers
-    visuals_->grasp_markers_->deleteAllMarkers();
+  // Show experience database results
+  manipulation_->printExperienceLogs();
 
-    WorkOrder& work_order = orders_[i];
+  // Show which grasps have been learned and what they saved
+  grasp_memory_->printStats();
 
-    if (!graspObjectPipeline(work_order, verbose_, jump_to))
-    {
-      ROS_WARN_STREAM_NAMED("apc_manager", "An error occured in last product order.");
+  return true;
+}
 
-      if (!config_->isEnabled("super_auto"))
-      {
-        // remote_control_->setAutonomous(false);
-        // remote_control_->setFullAutonomous(false);
-        // remote_control_->waitForNextStep();
-        ROS_ERROR_STREAM_NAMED("apc_manager",
-                               "Shutting down for debug purposes only (it could continue on)");
-        return false;
-      }
-    }
+bool APCManager::attemptOrder(std::size_t scheduler_id, OrderStrategy strategy)
+{
+  const std::size_t i = scheduler_to_order_[scheduler_id];
 
-    ROS_INFO_STREAM_NAMED("apc_manager", "Cleaning up planning scene");
+  std::cout << std::endl << MOVEIT_CONSOLE_COLOR_BROWN;
+  std::cout << "=======================================================" << std::endl;
+  std::cout << "Starting order " << i << std::endl;
+  std::cout << "=======================================================";
+  std::cout << MOVEIT_CONSOLE_COLOR_RESET << std::endl;
 
-    // Unattach from EE
-    visuals_->visual_tools_->cleanupACO(
-        work_order.product_->getCollisionName());  // use unique name
-    // Delete from planning scene the product
-    visuals_->visual_tools_->cleanupCO(work_order.product_->getCollisionName());  // use unique name
+  // Clear old grasp markers
+  visuals_->grasp_markers_->deleteAllMarkers();
 
-    // Reset markers for next loop
-    visuals_->visual_tools_->deleteAllMarkers();
+  // Retries always run the whole pipeline
+  const std::size_t jump_to = order_scheduler_->getAttempts(scheduler_id) ? 0 : order_jump_to_;
+  grasp_chosen_ = false;
+  grasp_attempted_ = false;
+  return graspObjectPipeline(orders_[i], verbose_, jump_to, strategy);
+}
+
+void APCManager::finishOrder(std::size_t scheduler_id, bool success, bool requeued)
+{
+  WorkOrder& work_order = orders_[scheduler_to_order_[scheduler_id]];
 
-    // Show shelf with remaining products
-    visuals_->visualizeDisplayShelf(shelf_);
+  // Only a grasp that was closed on the product says anything about the grasp
+  if (grasp_attempted_)
+  {
+    grasp_memory_->recordResult(work_order.product_->getName(), chosen_product_to_grasp_, success);
+    grasp_memory_->save(grasp_memory_file_);
   }
+  // A retry with another grasp skips this one
+  if (!success && grasp_chosen_)
+    failed_grasps_[work_order.product_->getCollisionName()].push_back(chosen_product_to_grasp_);
 
-  statusPublisher("Finished");
+  if (!success)
+    ROS_WARN_STREAM_NAMED("apc_manager", "An error occured in last product order.");
 
-  // Show experience database results
-  manipulation_->printExperienceLogs();
+  ROS_INFO_STREAM_NAMED("apc_manager", "Cleaning up planning scene");
 
-  return true;
+  // Unattach from EE
+  visuals_->visual_tools_->cleanupACO(work_order.product_->getCollisionName());  // use unique name
+  if (requeued)
+  {
+    // The retry plans against the product where it was last seen, fake perception only
+    // recreates it for a reperceive
+    const Eigen::Affine3d world_to_bin =
+        picknik_main::transform(work_order.bin_->getBottomRight(), shelf_->getBottomRight());
+    work_order.product_->createCollisionBodies(world_to_bin);
+  }
+  else
+  {
+    // Delete from planning scene the product
+    visuals_->visual_tools_->cleanupCO(work_order.product_->getCollisionName());  // use unique name
+  }
+
+  // Reset markers for next loop
+  visuals_->visual_tools_->deleteAllMarkers();
+
+  // Show shelf with remaining products
+  visuals_->visualizeDisplayShelf(shelf_);
+
+  // Once the first order warmed it up, orders should need no new allocations
+  manipulation_->getStatePool()->printStats();
 }
 
-bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::size_t jump_to)
+bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::size_t jump_to,
+                                     OrderStrategy strategy)
 {
   // Error check
   if (!work_order.product_ || !work_order.bin_)
@@ -297,19 +395,26 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
   JointModelGroup* arm_jmg;
   bool execute_trajectory = true;
 
+  if (strategy != ORDER_STRATEGY_DEFAULT)
+    ROS_INFO_STREAM_NAMED("apc_manager", "Retrying with strategy "
+                                             << OrderScheduler::getStrategyName(strategy));
+
   moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
 
   // Variables
   std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
-  moveit::core::RobotStatePtr pre_grasp_state(
-      new moveit::core::RobotState(*current_state));  // Allocate robot states
-  moveit::core::RobotStatePtr the_grasp_state(
-      new moveit::core::RobotState(*current_state));  // Allocate robot states
+  moveit::core::RobotStatePtr pre_grasp_state =
+      manipulation_->getStatePool()->acquire(*current_state);  // Allocate robot states
+  moveit::core::RobotStatePtr the_grasp_state =
+      manipulation_->getStatePool()->acquire(*current_state);  // Allocate robot states
   moveit_msgs::RobotTrajectory approach_trajectory_msg;
 
   const moveit::core::JointModel* joint = robot_model_->getJointModel("jaco2_joint_finger_1");
   double max_finger_joint_limit = manipulation_->getMaxJointLimit(joint);
 
+  // End effector motion hidden inside arm motions during this pick
+  const double ee_overlap_saved_start = manipulation_->getEEOverlapSaved();
+
   if (!remote_control_->getAutonomous())
   {
     visuals_->start_state_->publishRobotState(current_state, rvt::GREEN);
@@ -323,7 +428,7 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
   {
     if (!remote_control_->getAutonomous())
     {
-      remote_control_->waitForNextStep();
+      remote_control_->waitForNextStep("go to next step", __FILE__, __LINE__);
     }
     else
     {
@@ -373,6 +478,8 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
             return false;
           }
         }
+        else if (strategy == ORDER_STRATEGY_REPERCEIVE)
+          perceiveObjectFake(work_order);
 
         break;
 
@@ -387,22 +494,43 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         // Choose which arm to use
         arm_jmg =
             manipulation_->chooseArm(work_order.product_->getWorldPose(shelf_, work_order.bin_));
+        if (strategy == ORDER_STRATEGY_OTHER_ARM)
+          arm_jmg = arm_jmg == config_->left_arm_ ? config_->right_arm_ : config_->left_arm_;
 
         // Allow fingers to touch object
         manipulation_->allowFingerTouch(work_order.product_->getCollisionName(), arm_jmg);
 
         // Generate and chose grasp
-        if (!manipulation_->chooseGrasp(work_order, arm_jmg, grasp_candidates, verbose))
         {
-          ROS_ERROR_STREAM_NAMED("apc_manager", "No grasps found");
+          const double grasp_start_time = LatencyStats::now();
+          if (!manipulation_->chooseGrasp(work_order, arm_jmg, grasp_candidates, verbose))
+          {
+            ROS_ERROR_STREAM_NAMED("apc_manager", "No grasps found");
 
-          return false;
+            return false;
+          }
+          preferRememberedGrasps(work_order, grasp_candidates);
+
+          // Skip the grasps that failed on earlier tries of this order
+          if (strategy == ORDER_STRATEGY_OTHER_GRASP)
+            removeFailedGrasps(work_order, grasp_candidates);
+
+          std::size_t rank;
+          grasp_memory_->recordTimeToChooseGrasp(
+              LatencyStats::now() - grasp_start_time,
+              grasp_memory_->findProvenGrasp(
+                  work_order.product_->getName(),
+                  getProductToGrasp(work_order, grasp_candidates.front()), rank));
         }
 
         // Get the pre and post grasp states
         grasp_candidates.front()->getPreGraspState(pre_grasp_state);
         grasp_candidates.front()->getGraspStateOpen(the_grasp_state);
 
+        // Remember which grasp this order went with
+        chosen_product_to_grasp_ = getProductToGrasp(work_order, grasp_candidates.front());
+        grasp_chosen_ = true;
+
         // Visualize
         visuals_->start_state_->publishRobotState(pre_grasp_state, rvt::GREEN);
         visuals_->goal_state_->publishRobotState(the_grasp_state, rvt::ORANGE);
@@ -446,9 +574,12 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         // collision with wall
         // planning_scene_manager_->displayShelfAsWall();
 
-        // Set end effector to correct width
-        if (!manipulation_->setEEGraspPosture(grasp_candidates.front()->grasp_.pre_grasp_posture,
-                                              arm_jmg))
+        // Set end effector to correct width, during the end of the move if allowed
+        if (config_->ee_open_overlap_ > 0)
+          manipulation_->queueEEGraspPosture(grasp_candidates.front()->grasp_.pre_grasp_posture,
+                                             arm_jmg, config_->ee_open_overlap_);
+        else if (!manipulation_->setEEGraspPosture(
+                     grasp_candidates.front()->grasp_.pre_grasp_posture, arm_jmg))
         {
           ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to set EE to correct grasp posture");
           return false;
@@ -465,6 +596,14 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
           ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to plan to pre-grasp position");
           return false;
         }
+
+        // Does nothing if the end effector already opened during the move
+        if (!manipulation_->setEEGraspPosture(grasp_candidates.front()->grasp_.pre_grasp_posture,
+                                              arm_jmg))
+        {
+          ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to set EE to correct grasp posture");
+          return false;
+        }
         break;
 
       // #################################################################################################################
@@ -497,6 +636,10 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         //   return false;
         // }
 
+        // Close the end effector as the approach ends, only if allowed, otherwise when grasping
+        manipulation_->queueEEGraspPosture(grasp_datas_[arm_jmg]->grasp_posture_, arm_jmg,
+                                           config_->ee_close_overlap_);
+
         // Execute straight forward
         if (!manipulation_->executeSavedCartesianPath(grasp_candidates.front(),
                                                       moveit_grasps::APPROACH))
@@ -505,10 +648,15 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
           return false;
         }
 
-        // Wait
-        ROS_INFO_STREAM_NAMED("apc_manager", "Waiting " << config_->wait_before_grasp_
-                                                        << " seconds before grasping");
-        ros::Duration(config_->wait_after_grasp_).sleep();
+        // Wait for the arm to come to rest, at most the old fixed wait
+        {
+          const double wait_start = LatencyStats::now();
+          manipulation_->waitForRobotToStop(config_->wait_before_grasp_);
+          ROS_INFO_STREAM_NAMED("apc_manager", "Waited "
+                                                   << LatencyStats::now() - wait_start << " of "
+                                                   << config_->wait_before_grasp_
+                                                   << " seconds before grasping");
+        }
 
         break;
 
@@ -533,9 +681,9 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         if (!attachProduct(work_order.product_, arm_jmg))
           ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to attach collision object");
 
-        ROS_INFO_STREAM_NAMED("apc_manager", "Waiting " << config_->wait_after_grasp_
-                                                        << " seconds after grasping");
-        ros::Duration(config_->wait_after_grasp_).sleep();
+        // Wait for the grip to stabilize, at most the old fixed wait
+        manipulation_->waitForGrasp(config_->wait_after_grasp_);
+        grasp_attempted_ = true;
 
         break;
 
@@ -601,12 +749,15 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
         // Set planning scene
         // planning_scene_manager_->displayShelfAsWall();
 
-        if (!placeObjectInGoalBin(arm_jmg))
+        if (!moveToDropOffPosition(arm_jmg))
         {
-          ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to move object to goal bin");
+          ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to plan to goal bin");
           return false;
         }
 
+        if (!lowerIntoGoalBin(arm_jmg))
+          return false;
+
         break;
 
       // #################################################################################################################
@@ -634,6 +785,10 @@ bool APCManager::graspObjectPipeline(WorkOrder work_order, bool verbose, std::si
       default:
         ROS_INFO_STREAM_NAMED("apc_manager",
                               "Manipulation pipeline finished, pat yourself on the back!");
+        ROS_INFO_STREAM_NAMED("apc_manager", "Overlapping end effector and arm motion saved "
+                                                 << manipulation_->getEEOverlapSaved() -
+                                                        ee_overlap_saved_start
+                                                 << " seconds this pick");
 
         // Remove product from shelf
         shelf_->deleteProduct(work_order.bin_, work_order.product_);
@@ -757,15 +912,15 @@ bool APCManager::calibrateShelf()
   ROS_INFO_STREAM_NAMED("apc_manager", "Visualize shelf");
 
   // Save first state
-  remote_control_->waitForNextStep("to move to state 1");
+  remote_control_->waitForNextStep("to move to state 1", __FILE__, __LINE__);
   visuals_->start_state_->publishRobotState(manipulation_->getCurrentState(), rvt::GREEN);
 
   // Save second state
-  remote_control_->waitForNextStep("to move to state 2");
+  remote_control_->waitForNextStep("to move to state 2", __FILE__, __LINE__);
   visuals_->goal_state_->publishRobotState(manipulation_->getCurrentState(), rvt::ORANGE);
 
   // Save third state
-  remote_control_->waitForNextStep("to move to state 3");
+  remote_control_->waitForNextStep("to move to state 3", __FILE__, __LINE__);
   visuals_->visual_tools_->publishRobotState(manipulation_->getCurrentState(), rvt::PURPLE);
 
   ROS_INFO_STREAM_NAMED("apc_manager", "Now update with keyboard calibration");
@@ -940,7 +1095,7 @@ bool APCManager::testShelfLocation()
       continue;
     }
 
-    remote_control_->waitForNextStep();
+    remote_control_->waitForNextStep("go to next step", __FILE__, __LINE__);
   }  // end for
 
   ROS_INFO_STREAM_NAMED("apc_manager", "Done testing shelf location");
@@ -1136,7 +1291,8 @@ bool APCManager::testRandomValidMotions()
       moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
 
       // Create goal
-      moveit::core::RobotStatePtr goal_state(new moveit::core::RobotState(*current_state));
+      moveit::core::RobotStatePtr goal_state =
+          manipulation_->getStatePool()->acquire(*current_state);
 
       // Choose arm
       JointModelGroup* arm_jmg = config_->right_arm_;
@@ -1212,7 +1368,7 @@ bool APCManager::testCameraPositions()
 
     // Wait before going to next bin
     ros::Duration(1.0).sleep();
-    remote_control_->waitForNextStep("percieve next bin");
+    remote_control_->waitForNextStep("percieve next bin", __FILE__, __LINE__);
   }
 
   ROS_INFO_STREAM_NAMED("apc_manager", "Done moving to each bin");
@@ -1298,8 +1454,8 @@ bool APCManager::testGraspGenerator()
 
   // Variables
   moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
-  moveit::core::RobotStatePtr the_grasp_state(
-      new moveit::core::RobotState(*current_state));  // Allocate robot states
+  moveit::core::RobotStatePtr the_grasp_state =
+      manipulation_->getStatePool()->acquire(*current_state);  // Allocate robot states
   Eigen::Affine3d global_object_pose;
   JointModelGroup* arm_jmg;
   std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
@@ -1454,7 +1610,7 @@ bool APCManager::testJointLimits()
   moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
 
   // Create goal
-  moveit::core::RobotStatePtr goal_state(new moveit::core::RobotState(*current_state));
+  moveit::core::RobotStatePtr goal_state = manipulation_->getStatePool()->acquire(*current_state);
 
   // Setup data
   std::vector<double> joint_position;
@@ -1591,7 +1747,7 @@ bool APCManager::testPerceptionComm(std::size_t bin_id)
       }
     }
 
-    remote_control_->waitForNextStep("request perception again");
+    remote_control_->waitForNextStep("request perception again", __FILE__, __LINE__);
   }
 
   return true;
@@ -1652,7 +1808,7 @@ bool APCManager::testPerceptionCommEach()
       }
     }
 
-    remote_control_->waitForNextStep("request perception again");
+    remote_control_->waitForNextStep("request perception again", __FILE__, __LINE__);
   }
 
   return true;
@@ -1838,6 +1994,11 @@ bool APCManager::placeObjectInGoalBin(JointModelGroup* arm_jmg)
     return false;
   }
 
+  return lowerIntoGoalBin(arm_jmg);
+}
+
+bool APCManager::lowerIntoGoalBin(JointModelGroup* arm_jmg)
+{
   // Drop down
   bool up = false;
   if (!manipulation_->executeVerticlePath(arm_jmg, config_->place_goal_down_distance_desired_,
@@ -1865,6 +2026,70 @@ bool APCManager::liftFromGoalBin(JointModelGroup* arm_jmg)
   return true;
 }
 
+void APCManager::preferRememberedGrasps(
+    WorkOrder& work_order, std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates)
+{
+  if (!config_->isEnabled("grasp_memory"))
+    return;
+
+  // Move grasps that have worked more often than not to the front, by how well they worked. The
+  // rest keep the order they were generated in
+  const std::string& product_name = work_order.product_->getName();
+  EigenSTL::vector_Affine3d product_to_grasps;
+  product_to_grasps.reserve(grasp_candidates.size());
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+    product_to_grasps.push_back(getProductToGrasp(work_order, grasp_candidates[i]));
+
+  std::vector<std::size_t> order;
+  const std::size_t proven = grasp_memory_->orderGrasps(product_name, product_to_grasps, order);
+  if (!proven)
+    return;
+
+  std::vector<moveit_grasps::GraspCandidatePtr> ordered;
+  ordered.reserve(order.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    ordered.push_back(grasp_candidates[order[i]]);
+  grasp_candidates.swap(ordered);
+
+  ROS_INFO_STREAM_NAMED("apc_manager", "Trying " << proven << " proven grasps of " << product_name
+                                                 << " first");
+}
+
+void APCManager::removeFailedGrasps(WorkOrder& work_order,
+                                   std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates)
+{
+  const EigenSTL::vector_Affine3d& failed_grasps =
+      failed_grasps_[work_order.product_->getCollisionName()];
+  std::vector<moveit_grasps::GraspCandidatePtr> remaining;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    const Eigen::Affine3d product_to_grasp = getProductToGrasp(work_order, grasp_candidates[i]);
+    bool failed = false;
+    for (std::size_t j = 0; j < failed_grasps.size() && !failed; ++j)
+      failed = grasp_memory_->isSameGrasp(failed_grasps[j], product_to_grasp);
+    if (!failed)
+      remaining.push_back(grasp_candidates[i]);
+  }
+
+  // Better to try a failed grasp again than none at all
+  if (remaining.empty())
+  {
+    ROS_WARN_STREAM_NAMED("apc_manager", "Every grasp has failed before, trying them again");
+    return;
+  }
+  ROS_INFO_STREAM_NAMED("apc_manager", "Skipping " << grasp_candidates.size() - remaining.size()
+                                                   << " grasps that failed before");
+  grasp_candidates.swap(remaining);
+}
+
+Eigen::Affine3d APCManager::getProductToGrasp(
+    WorkOrder& work_order, const moveit_grasps::GraspCandidatePtr& grasp_candidate)
+{
+  const Eigen::Affine3d product_pose = work_order.product_->getWorldPose(shelf_, work_order.bin_);
+  return product_pose.inverse() *
+         visuals_->visual_tools_->convertPose(grasp_candidate->grasp_.grasp_pose.pose);
+}
+
 bool APCManager::moveToStartPosition(JointModelGroup* arm_jmg, bool check_validity)
 {
   return manipulation_->moveToStartPosition(arm_jmg, check_validity);
@@ -2351,8 +2576,8 @@ bool APCManager::gotoPose(const std::string& pose_name)
 // Mode 25
 bool APCManager::testIKSolver()
 {
-  moveit::core::RobotStatePtr goal_state(
-      new moveit::core::RobotState(*manipulation_->getCurrentState()));
+  moveit::core::RobotStatePtr goal_state =
+      manipulation_->getStatePool()->acquire(*manipulation_->getCurrentState());
 
   JointModelGroup* arm_jmg = config_->right_arm_;
   Eigen::Affine3d ee_pose = Eigen::Affine3d::Identity();
@@ -2398,7 +2623,7 @@ bool APCManager::unitTestPerceptionComm()
   ROS_INFO_STREAM_NAMED("apc_manager", "FIRST ENSURE THAT SERVER IS OFF");
   std::cout << "-------------------------------------------------------" << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
-  remote_control_->waitForNextStep("start with perception server off");
+  remote_control_->waitForNextStep("start with perception server off", __FILE__, __LINE__);
 
   // Test if connected
   if (perception_interface_->isPerceptionReady())
@@ -2406,7 +2631,7 @@ bool APCManager::unitTestPerceptionComm()
     ROS_ERROR_STREAM_NAMED("apc_manager", "Reports perception is ready when it should not!");
   }
 
-  remote_control_->waitForNextStep("Now start perception server");
+  remote_control_->waitForNextStep("Now start perception server", __FILE__, __LINE__);
 
   // Test if connected
   if (!perception_interface_->isPerceptionReady())
@@ -2498,8 +2723,8 @@ bool APCManager::testPlanningSimple()
   JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
 
   // Create start state at top left bin
-  moveit::core::RobotStatePtr start(
-      new moveit::core::RobotState(*manipulation_->getCurrentState()));
+  moveit::core::RobotStatePtr start =
+      manipulation_->getStatePool()->acquire(*manipulation_->getCurrentState());
   BinObjectPtr bin = shelf_->getBin(0);  // first bin, bin_A
 
   if (!manipulation_->getGraspingSeedState(bin, start, arm_jmg))
@@ -2523,7 +2748,7 @@ bool APCManager::testPlanningSimple()
   Eigen::Affine3d dropoff_location = dropoff_locations_[next_dropoff_location_];
   dropoff_location = dropoff_location * grasp_datas_[arm_jmg]->grasp_pose_to_eef_pose_;
 
-  moveit::core::RobotStatePtr goal(new moveit::core::RobotState(*start));
+  moveit::core::RobotStatePtr goal = manipulation_->getStatePool()->acquire(*start);
   if (!manipulation_->getRobotStateFromPose(dropoff_location, goal, arm_jmg))
   {
     ROS_ERROR_STREAM_NAMED("apc_manager", "Unable to get goal bin state");
@@ -2554,7 +2779,7 @@ bool APCManager::testPlanningSimple()
       ROS_ERROR_STREAM_NAMED("apc_manager", "Failed to plan from start to goal");
       return false;
     }
-    remote_control_->waitForNextStep("plan again");
+    remote_control_->waitForNextStep("plan again", __FILE__, __LINE__);
   }
   return true;
 }
@@ -2622,7 +2847,7 @@ bool APCManager::testGraspWidths()
 
       // Wait
       ros::Duration(2.0).sleep();
-      remote_control_->waitForNextStep("move fingers");
+      remote_control_->waitForNextStep("move fingers", __FILE__, __LINE__);
 
       // Increment the test
       joint_position += (max_finger_joint_limit - min_finger_joint_limit) / 10.0;  //
@@ -2649,7 +2874,7 @@ bool APCManager::testGraspWidths()
 
       // Wait
       ros::Duration(1.0).sleep();
-      remote_control_->waitForNextStep("move fingers");
+      remote_control_->waitForNextStep("move fingers", __FILE__, __LINE__);
 
       // Change fingers
       trajectory_msgs::JointTrajectory grasp_posture;
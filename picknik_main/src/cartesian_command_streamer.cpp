@@ -0,0 +1,165 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Send cartesian end effector targets to the robot at a fixed rate from one thread,
+           regardless of which thread or how irregularly they are produced
+*/
+
+// PickNik
+#include <picknik_main/cartesian_command_streamer.h>
+
+// C++
+#include <thread>
+
+namespace picknik_main
+{
+namespace
+{
+// Targets that can wait for the streaming thread, far more than can be produced in one period
+const std::size_t QUEUE_CAPACITY = 128;
+
+void updateMax(std::atomic<int64_t>& max, int64_t value)
+{
+  int64_t previous = max.load(std::memory_order_relaxed);
+  while (value > previous && !max.compare_exchange_weak(previous, value))
+  {
+  }
+}
+}  // end anonymous namespace
+
+CartesianCommandStreamer::CartesianCommandStreamer(const std::string& topic, double rate)
+  : period_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate)))
+  , targets_(QUEUE_CAPACITY)
+  , running_(true)
+  , ticks_(0)
+  , published_(0)
+  , coalesced_(0)
+  , dropped_(0)
+  , missed_deadlines_(0)
+  , jitter_sum_nsec_(0)
+  , jitter_max_nsec_(0)
+  , latency_sum_nsec_(0)
+  , latency_max_nsec_(0)
+{
+  cartesian_command_pub_ = nh_.advertise<cartesian_msgs::CartesianCommand>(topic, 1000);
+  stream_thread_ = boost::thread(boost::bind(&CartesianCommandStreamer::streamThread, this));
+
+  ROS_INFO_STREAM_NAMED("cartesian_command_streamer", "Streaming cartesian commands on "
+                                                          << topic << " at " << rate << " hz");
+}
+
+CartesianCommandStreamer::~CartesianCommandStreamer() { stop(); }
+
+bool CartesianCommandStreamer::push(const geometry_msgs::Pose& pose, double duration)
+{
+  Target target;
+  target.position_[0] = pose.position.x;
+  target.position_[1] = pose.position.y;
+  target.position_[2] = pose.position.z;
+  target.orientation_[0] = pose.orientation.x;
+  target.orientation_[1] = pose.orientation.y;
+  target.orientation_[2] = pose.orientation.z;
+  target.orientation_[3] = pose.orientation.w;
+  target.duration_ = duration;
+  target.enqueue_nsec_ = toNSec(Clock::now());
+
+  if (!targets_.bounded_push(target))
+  {
+    dropped_++;
+    ROS_WARN_STREAM_NAMED("cartesian_command_streamer", "Command queue full, dropping target");
+    return false;
+  }
+  return true;
+}
+
+void CartesianCommandStreamer::stop()
+{
+  if (!running_.exchange(false))
+    return;
+  stream_thread_.join();
+  printStats();
+}
+
+void CartesianCommandStreamer::printStats() const
+{
+  const std::size_t ticks = std::max<std::size_t>(1, ticks_);
+  const std::size_t published = std::max<std::size_t>(1, published_);
+  ROS_INFO_STREAM_NAMED("cartesian_command_streamer",
+                        "Published " << published_ << " commands over " << ticks_ << " ticks, "
+                                     << coalesced_ << " stale targets coalesced, " << dropped_
+                                     << " dropped, " << missed_deadlines_ << " missed deadlines");
+  ROS_INFO_STREAM_NAMED("cartesian_command_streamer",
+                        "Wake up jitter mean " << jitter_sum_nsec_ / ticks / 1000 << " us, max "
+                                               << jitter_max_nsec_ / 1000
+                                               << " us. Target latency mean "
+                                               << latency_sum_nsec_ / published / 1000
+                                               << " us, max " << latency_max_nsec_ / 1000 << " us");
+}
+
+void CartesianCommandStreamer::streamThread()
+{
+  Clock::time_point deadline = Clock::now();
+
+  while (running_)
+  {
+    // Sleep until this tick is due
+    std::this_thread::sleep_until(deadline);
+    const Clock::time_point wake_time = Clock::now();
+    ticks_++;
+
+    const int64_t jitter = toNSec(wake_time) - toNSec(deadline);
+    jitter_sum_nsec_ += jitter;
+    updateMax(jitter_max_nsec_, jitter);
+
+    // Only the newest target matters, anything older has already been superseded
+    Target target;
+    std::size_t count = 0;
+    while (targets_.pop(target))
+      count++;
+
+    if (count)
+    {
+      coalesced_ += count - 1;
+
+      geometry_msgs::Pose& pose = cartesian_command_msg_.desired_pose.pose;
+      pose.position.x = target.position_[0];
+      pose.position.y = target.position_[1];
+      pose.position.z = target.position_[2];
+      pose.orientation.x = target.orientation_[0];
+      pose.orientation.y = target.orientation_[1];
+      pose.orientation.z = target.orientation_[2];
+      pose.orientation.w = target.orientation_[3];
+      cartesian_command_msg_.duration = target.duration_;
+      cartesian_command_pub_.publish(cartesian_command_msg_);
+      published_++;
+
+      const int64_t latency = toNSec(Clock::now()) - target.enqueue_nsec_;
+      latency_sum_nsec_ += latency;
+      updateMax(latency_max_nsec_, latency);
+    }
+
+    // Schedule next tick, skipping any we are already too late for
+    deadline += period_;
+    const Clock::time_point now = Clock::now();
+    if (now > deadline)
+    {
+      missed_deadlines_++;
+      deadline = now;
+    }
+  }
+}
+
+int64_t CartesianCommandStreamer::toNSec(Clock::time_point time)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+}  // end namespace
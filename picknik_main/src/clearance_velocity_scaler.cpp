@@ -0,0 +1,222 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Slow a trajectory down only where it passes close to the shelf or products, or while
+           carrying a product, instead of running the whole motion at the slowest safe speed
+*/
+
+// PickNik
+#include <picknik_main/clearance_velocity_scaler.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace picknik_main
+{
+namespace
+{
+// Largest change in stretch from one segment to the next, so moving between clearance bands
+// ramps the speed instead of stepping it
+const double MAX_STRETCH_RATIO = 1.25;
+
+// Passes of slowing down around waypoints that exceed an acceleration limit after retiming
+const std::size_t MAX_ACCELERATION_PASSES = 10;
+}  // end anonymous namespace
+
+ClearanceVelocityScaler::ClearanceVelocityScaler(double near_distance, double far_distance,
+                                                 double free_space_scaling,
+                                                 double payload_scaling, std::size_t stride)
+  : near_distance_(near_distance)
+  , far_distance_(std::max(far_distance, near_distance))
+  , free_space_scaling_(free_space_scaling)
+  , payload_scaling_(payload_scaling)
+  , stride_(std::max<std::size_t>(1, stride))
+{
+}
+
+double ClearanceVelocityScaler::getPlanningScaling(double base_scaling) const
+{
+  return std::max(base_scaling, free_space_scaling_);
+}
+
+bool ClearanceVelocityScaler::retime(robot_trajectory::RobotTrajectory& trajectory,
+                                     const planning_scene::PlanningScene& scene,
+                                     double planned_scaling, double base_scaling,
+                                     Breakdown& breakdown) const
+{
+  const std::size_t count = trajectory.getWayPointCount();
+  breakdown.original_duration_ = count ? trajectory.getWaypointDurationFromStart(count - 1) : 0.0;
+  breakdown.near_duration_ = 0;
+  breakdown.between_duration_ = 0;
+  breakdown.free_duration_ = 0;
+  if (count < 2 || !trajectory.getGroup())
+    return false;
+
+  std::vector<const moveit::core::AttachedBody*> attached_bodies;
+  scene.getCurrentState().getAttachedBodies(attached_bodies);
+  breakdown.payload_ = !attached_bodies.empty();
+
+  // Measure clearance on every stride'th waypoint and the last
+  std::vector<double> clearance(count);
+  for (std::size_t i = 0; i < count; i += stride_)
+    clearance[i] = scene.distanceToCollision(*trajectory.getWayPointPtr(i));
+  if ((count - 1) % stride_)
+    clearance[count - 1] = scene.distanceToCollision(*trajectory.getWayPointPtr(count - 1));
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    if (i % stride_ == 0 || i == count - 1)
+      continue;
+    const std::size_t before = i - i % stride_;
+    const std::size_t after = std::min(before + stride_, count - 1);
+    clearance[i] = std::min(clearance[before], clearance[after]);
+  }
+
+  // Blend from the base to the free space scaling by clearance, never faster than planned
+  const double free_space_scaling =
+      std::max(base_scaling, free_space_scaling_ * (breakdown.payload_ ? payload_scaling_ : 1.0));
+  std::vector<double> fraction(count);
+  std::vector<double> scaling(count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    fraction[i] = far_distance_ > near_distance_ ?
+                      (clearance[i] - near_distance_) / (far_distance_ - near_distance_) :
+                      (clearance[i] >= far_distance_ ? 1.0 : 0.0);
+    fraction[i] = std::min(std::max(fraction[i], 0.0), 1.0);
+    scaling[i] = std::min(planned_scaling,
+                          base_scaling + fraction[i] * (free_space_scaling - base_scaling));
+  }
+
+  // Stretch each segment by its slower end
+  std::vector<double> stretch(count, 1.0);
+  for (std::size_t i = 1; i < count; ++i)
+    stretch[i] = planned_scaling / std::min(scaling[i - 1], scaling[i]);
+
+  // Slow down ahead of and after slow segments so neighbouring speeds stay close
+  for (std::size_t i = 2; i < count; ++i)
+    stretch[i] = std::max(stretch[i], stretch[i - 1] / MAX_STRETCH_RATIO);
+  for (std::size_t i = count - 1; i > 1; --i)
+    stretch[i - 1] = std::max(stretch[i - 1], stretch[i] / MAX_STRETCH_RATIO);
+
+  std::vector<double> durations(count, 0.0);
+  for (std::size_t i = 1; i < count; ++i)
+    durations[i] = trajectory.getWayPointDurationFromPrevious(i) * stretch[i];
+
+  // Velocities and accelerations no longer match the new durations, so recompute them and slow
+  // down further wherever that breaks an acceleration limit
+  std::vector<double> acceleration_ratio(count);
+  for (std::size_t pass = 0;; ++pass)
+  {
+    const double worst_ratio = applyDurations(trajectory, durations, acceleration_ratio);
+    if (worst_ratio <= 1.0)
+      break;
+    if (pass == MAX_ACCELERATION_PASSES)
+    {
+      ROS_WARN_STREAM_NAMED("clearance_velocity_scaler", "Retimed trajectory still exceeds an "
+                                                         "acceleration limit by "
+                                                             << worst_ratio << "x");
+      break;
+    }
+
+    // Acceleration falls with the square of the time scale
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (acceleration_ratio[i] <= 1.0)
+        continue;
+      const double factor = sqrt(acceleration_ratio[i]);
+      if (i > 0)
+        durations[i] *= factor;
+      if (i + 1 < count)
+        durations[i + 1] *= factor;
+    }
+  }
+
+  // The robot must start and stop at rest
+  const std::vector<int>& indices = trajectory.getGroup()->getVariableIndexList();
+  const moveit::core::RobotState& first = *trajectory.getWayPointPtr(0);
+  const moveit::core::RobotState& last = *trajectory.getWayPointPtr(count - 1);
+  for (std::size_t j = 0; j < indices.size(); ++j)
+  {
+    if (first.getVariableVelocity(indices[j]) != 0.0 ||
+        last.getVariableVelocity(indices[j]) != 0.0)
+    {
+      ROS_ERROR_STREAM_NAMED("clearance_velocity_scaler", "Retimed trajectory does not start and "
+                                                          "end at rest");
+      return false;
+    }
+  }
+
+  // Time spent in each band
+  for (std::size_t i = 1; i < count; ++i)
+  {
+    const double segment_fraction = std::min(fraction[i - 1], fraction[i]);
+    if (segment_fraction <= 0.0)
+      breakdown.near_duration_ += durations[i];
+    else if (segment_fraction >= 1.0)
+      breakdown.free_duration_ += durations[i];
+    else
+      breakdown.between_duration_ += durations[i];
+  }
+
+  return true;
+}
+
+double ClearanceVelocityScaler::applyDurations(robot_trajectory::RobotTrajectory& trajectory,
+                                               const std::vector<double>& durations,
+                                               std::vector<double>& acceleration_ratio) const
+{
+  const moveit::core::JointModelGroup* group = trajectory.getGroup();
+  const moveit::core::RobotModel& robot_model = *trajectory.getRobotModel();
+  const std::vector<std::string>& names = group->getVariableNames();
+  const std::vector<int>& indices = group->getVariableIndexList();
+  const std::size_t count = trajectory.getWayPointCount();
+
+  for (std::size_t i = 1; i < count; ++i)
+    trajectory.setWayPointDurationFromPrevious(i, durations[i]);
+
+  // Finite differences over the neighbouring waypoints, as the time parameterization does. The
+  // ends are commanded at rest, their acceleration is still what reaching the neighbour from rest
+  // takes, for the limit check
+  double worst_ratio = 0;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const bool at_rest = i == 0 || i + 1 == count;
+    const moveit::core::RobotState& previous = *trajectory.getWayPointPtr(i > 0 ? i - 1 : i);
+    const moveit::core::RobotStatePtr& state = trajectory.getWayPointPtr(i);
+    const moveit::core::RobotState& next = *trajectory.getWayPointPtr(i + 1 < count ? i + 1 : i);
+    const double dt1 = i > 0 ? durations[i] : durations[i + 1];
+    const double dt2 = i + 1 < count ? durations[i + 1] : durations[i];
+
+    acceleration_ratio[i] = 0;
+    for (std::size_t j = 0; j < indices.size(); ++j)
+    {
+      const double position = state->getVariablePosition(indices[j]);
+      const double v1 = dt1 > 0 ? (position - previous.getVariablePosition(indices[j])) / dt1 : 0;
+      const double v2 = dt2 > 0 ? (next.getVariablePosition(indices[j]) - position) / dt2 : 0;
+      const double acceleration = dt1 + dt2 > 0 ? 2 * (v2 - v1) / (dt1 + dt2) : 0;
+      state->setVariableVelocity(indices[j], at_rest ? 0.0 : (v1 + v2) / 2);
+      state->setVariableAcceleration(indices[j], at_rest ? 0.0 : acceleration);
+
+      const moveit::core::VariableBounds& bounds = robot_model.getVariableBounds(names[j]);
+      if (bounds.acceleration_bounded_)
+      {
+        const double limit =
+            acceleration > 0 ? bounds.max_acceleration_ : -bounds.min_acceleration_;
+        if (limit > 0)
+          acceleration_ratio[i] = std::max(acceleration_ratio[i], fabs(acceleration) / limit);
+      }
+    }
+    worst_ratio = std::max(worst_ratio, acceleration_ratio[i]);
+  }
+  return worst_ratio;
+}
+
+}  // end namespace
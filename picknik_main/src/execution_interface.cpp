@@ -48,8 +48,14 @@
 // Parameter loading
 //#include <rviz_visual_tools/ros_param_utilities.h>
 
+// C++
+#include <set>
+
 namespace picknik_main
 {
+// Drop trajectories from the log rather than buffering more than this
+static const std::size_t TRAJECTORY_LOG_MAX_BYTES = 16 * 1024 * 1024;
+
 ExecutionInterface::ExecutionInterface(
     bool verbose, RemoteControlPtr remote_control, VisualsPtr visuals,
     moveit_grasps::GraspDatas grasp_datas,
@@ -62,7 +68,12 @@ ExecutionInterface::ExecutionInterface(
   , planning_scene_monitor_(planning_scene_monitor)
   , config_(config)
   , current_state_(current_state)
+  , scene_changed_(true)
   , nh_("~")
+  , latency_stats_(new LatencyStats())
+  , execution_pending_(false)
+  , execution_start_time_(0)
+  , execution_duration_(0)
   , unit_testing_enabled_(false)
   , fake_execution_(fake_execution)
 {
@@ -72,8 +83,52 @@ ExecutionInterface::ExecutionInterface(
   kinova_list_controllers_client_ = nh_.serviceClient<controller_manager_msgs::ListControllers>(
       "/jacob/kinova/controller_manager/list_controllers");
 
-  cartesian_command_pub_ =
-      nh_.advertise<cartesian_msgs::CartesianCommand>("/r3/cartesian_command", 1000);
+  // Send end effector poses at a steady rate from a dedicated thread
+  cartesian_command_streamer_.reset(
+      new CartesianCommandStreamer("/r3/cartesian_command", config_->cartesian_command_rate_));
+
+  // Publish joint states into a snapshot so that getCurrentState() does not need the scene lock
+  if (planning_scene_monitor_->getStateMonitor())
+  {
+    const double* positions = current_state_->getVariablePositions();
+    state_snapshot_.reset(new StateSnapshot(
+        current_state_->getVariableNames(),
+        std::vector<double>(positions, positions + current_state_->getVariableCount())));
+    planning_scene_monitor_->getStateMonitor()->addUpdateCallback(
+        boost::bind(&StateSnapshot::update, state_snapshot_, _1));
+
+    settle_detector_.reset(new SettleDetector(current_state_->getVariableNames(),
+                                              config_->settle_position_threshold_,
+                                              config_->settle_velocity_threshold_,
+                                              config_->settle_window_));
+    planning_scene_monitor_->getStateMonitor()->addUpdateCallback(
+        boost::bind(&SettleDetector::update, settle_detector_, _1));
+
+    std::vector<std::string> ee_variable_names;
+    for (moveit_grasps::GraspDatas::const_iterator it = grasp_datas_.begin();
+         it != grasp_datas_.end(); ++it)
+    {
+      const std::vector<std::string>& names = it->second->ee_jmg_->getVariableNames();
+      ee_variable_names.insert(ee_variable_names.end(), names.begin(), names.end());
+    }
+    grasp_settle_detector_.reset(new GraspSettleDetector(
+        ee_variable_names, config_->grasp_settle_position_threshold_,
+        config_->grasp_settle_effort_threshold_, config_->grasp_settle_window_));
+    planning_scene_monitor_->getStateMonitor()->addUpdateCallback(
+        boost::bind(&GraspSettleDetector::update, grasp_settle_detector_, _1));
+    planning_scene_monitor_->addUpdateCallback(
+        boost::bind(&ExecutionInterface::sceneUpdateCallback, this, _1));
+  }
+  else
+    ROS_WARN_STREAM_NAMED("execution_interface", "State monitor not started, getCurrentState() "
+                                                 "will lock the planning scene");
+
+  // Save every executed trajectory in the background, see trajectory_log_to_csv for analysis
+  std::string log_file_path;
+  getFilePath(log_file_path, "trajectory_log_" +
+                                 boost::lexical_cast<std::string>(ros::WallTime::now().sec) +
+                                 ".bin");
+  trajectory_logger_.reset(new TrajectoryLogger(log_file_path, TRAJECTORY_LOG_MAX_BYTES));
 
   ROS_INFO_STREAM_NAMED("execution_interface", "ExecutionInterface Ready.");
 }
@@ -85,11 +140,9 @@ bool ExecutionInterface::executePose(const Eigen::Affine3d &pose, JointModelGrou
   // manually calibrated
   Eigen::Affine3d converted_pose = pose * grasp_datas_[arm_jmg]->grasp_pose_to_eef_pose_;
 
-  visuals_->visual_tools_->convertPoseSafe(converted_pose,
-                                           cartesian_command_msg_.desired_pose.pose);
-  cartesian_command_msg_.duration = duration;
-  cartesian_command_pub_.publish(cartesian_command_msg_);
-  return true;
+  geometry_msgs::Pose pose_msg;
+  visuals_->visual_tools_->convertPoseSafe(converted_pose, pose_msg);
+  return cartesian_command_streamer_->push(pose_msg, duration);
 }
 
 bool ExecutionInterface::executeTrajectory(moveit_msgs::RobotTrajectory &trajectory_msg,
@@ -123,10 +176,9 @@ bool ExecutionInterface::executeTrajectory(moveit_msgs::RobotTrajectory &traject
     if (trajectory.joint_names.size() > 3)
     {
       static std::size_t trajectory_count = 0;
-      saveTrajectory(trajectory_msg, jmg->getName() + "_trajectory_" +
-                                         boost::lexical_cast<std::string>(trajectory_count++) +
-                                         ".csv");
-      // saveTrajectory(trajectory_msg, "trajectory.csv");
+      trajectory_logger_->log(
+          jmg->getName() + "_trajectory_" + boost::lexical_cast<std::string>(trajectory_count++),
+          trajectory_msg);
     }
   }
 
@@ -199,11 +251,10 @@ bool ExecutionInterface::executeTrajectory(moveit_msgs::RobotTrajectory &traject
   // Check if in unit testing mode
   if (unit_testing_enabled_)
   {
-    robot_trajectory::RobotTrajectoryPtr robot_trajectory(
-        new robot_trajectory::RobotTrajectory(planning_scene_monitor_->getRobotModel(), jmg));
-
-    robot_trajectory->setRobotTrajectoryMsg(*current_state_, trajectory_msg);
-    *current_state_ = robot_trajectory->getLastWayPoint();
+    // Jump straight to the last waypoint, without allocating a RobotState for every waypoint
+    if (!trajectory.points.empty())
+      current_state_->setVariablePositions(trajectory.joint_names,
+                                           trajectory.points.back().positions);
     return true;
   }
 
@@ -212,11 +263,12 @@ bool ExecutionInterface::executeTrajectory(moveit_msgs::RobotTrajectory &traject
       // Only wait for non-finger trajectories
       trajectory.joint_names.size() > 3)
   {
-    remote_control_->waitForNextFullStep("execute trajectory");
+    remote_control_->waitForNextFullStep("execute trajectory", __FILE__, __LINE__);
     ROS_INFO_STREAM_NAMED("execution_interface", "Executing trajectory....");
   }
 
   // Reset trajectory manager
+  const double push_start_time = LatencyStats::now();
   trajectory_execution_manager_->clear();
 
   // Send new trajectory
@@ -224,6 +276,14 @@ bool ExecutionInterface::executeTrajectory(moveit_msgs::RobotTrajectory &traject
   {
     trajectory_execution_manager_->execute();
 
+    // Motion and controller latency are measured once done
+    execution_start_time_ = LatencyStats::now();
+    latency_stats_->record(LatencyStats::PUSH, execution_start_time_ - push_start_time);
+    execution_duration_ =
+        trajectory.points.empty() ? 0.0 : trajectory.points.back().time_from_start.toSec();
+    execution_motion_type_ = latency_stats_->getMotionType();
+    execution_pending_ = true;
+
     // Optionally wait for completion
     if (wait_for_execution)
     {
@@ -254,8 +314,17 @@ bool ExecutionInterface::waitForExecution()
   // wait for the trajectory to complete
   moveit_controller_manager::ExecutionStatus execution_status =
       trajectory_execution_manager_->waitForExecution();
+  const bool execution_pending = execution_pending_;
+  execution_pending_ = false;
   if (execution_status == moveit_controller_manager::ExecutionStatus::SUCCEEDED)
   {
+    if (execution_pending)
+    {
+      const double execution_time = LatencyStats::now() - execution_start_time_;
+      latency_stats_->record(execution_motion_type_, LatencyStats::MOTION, execution_duration_);
+      latency_stats_->record(execution_motion_type_, LatencyStats::CONTROLLER_LATENCY,
+                             execution_time - execution_duration_);
+    }
     ROS_DEBUG_STREAM_NAMED("execution_interface", "Trajectory execution succeeded");
     return true;
   }
@@ -341,6 +410,42 @@ bool ExecutionInterface::checkExecutionManager()
   return true;
 }
 
+bool ExecutionInterface::checkControllersActive()
+{
+  if (!trajectory_execution_manager_)
+    return false;
+
+  // Only the joints of the group in use need an active controller, others may be loaded but
+  // stopped, such as the unused one of a position and velocity controller pair
+  JointModelGroup *arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
+  const std::vector<std::string> &group_joints = arm_jmg->getActiveJointModelNames();
+  std::set<std::string> uncontrolled_joints(group_joints.begin(), group_joints.end());
+
+  const moveit_controller_manager::MoveItControllerManagerPtr &controller_manager =
+      trajectory_execution_manager_->getControllerManager();
+  std::vector<std::string> controller_list;
+  controller_manager->getControllersList(controller_list);
+  std::vector<std::string> controller_joints;
+  for (std::size_t i = 0; i < controller_list.size() && !uncontrolled_joints.empty(); ++i)
+  {
+    if (!controller_manager->getControllerState(controller_list[i]).active_)
+      continue;
+    controller_manager->getControllerJoints(controller_list[i], controller_joints);
+    for (std::size_t j = 0; j < controller_joints.size(); ++j)
+      uncontrolled_joints.erase(controller_joints[j]);
+  }
+
+  if (!uncontrolled_joints.empty())
+  {
+    ROS_WARN_STREAM_THROTTLE_NAMED(2, "execution_interface",
+                                   "Joint " << *uncontrolled_joints.begin() << " of group "
+                                            << arm_jmg->getName()
+                                            << " has no active controller");
+    return false;
+  }
+  return true;
+}
+
 bool ExecutionInterface::checkTrajectoryController(ros::ServiceClient &service_client,
                                                    const std::string &hardware_name, bool has_ee)
 {
@@ -407,66 +512,6 @@ bool ExecutionInterface::checkTrajectoryController(ros::ServiceClient &service_c
   return true;
 }
 
-bool ExecutionInterface::saveTrajectory(const moveit_msgs::RobotTrajectory &trajectory_msg,
-                                        const std::string &file_name)
-{
-  const trajectory_msgs::JointTrajectory &joint_trajectory = trajectory_msg.joint_trajectory;
-
-  // Error check
-  if (!joint_trajectory.points.size() || !joint_trajectory.points[0].positions.size())
-  {
-    ROS_ERROR_STREAM_NAMED("execution_interface", "No trajectory points available to save");
-    return false;
-  }
-  bool has_accelerations = true;
-  if (joint_trajectory.points[0].accelerations.size() == 0)
-  {
-    has_accelerations = false;
-  }
-
-  std::string file_path;
-  getFilePath(file_path, file_name);
-  std::ofstream output_file;
-  output_file.open(file_path.c_str());
-
-  // Output header -------------------------------------------------------
-  output_file << "time_from_start,";
-  for (std::size_t j = 0; j < joint_trajectory.joint_names.size(); ++j)
-  {
-    output_file << joint_trajectory.joint_names[j] << "_pos," << joint_trajectory.joint_names[j]
-                << "_vel,";
-    if (has_accelerations)
-      output_file << joint_trajectory.joint_names[j] << "_acc,";
-  }
-  output_file << std::endl;
-
-  // Output data ------------------------------------------------------
-
-  // Subtract starting time
-
-  for (std::size_t i = 0; i < joint_trajectory.points.size(); ++i)
-  {
-    // Timestamp
-    output_file.precision(20);
-    output_file << joint_trajectory.points[i].time_from_start.toSec() << ",";
-    output_file.precision(5);
-    // Output entire trajectory to single line
-    for (std::size_t j = 0; j < joint_trajectory.points[i].positions.size(); ++j)
-    {
-      // Output State
-      output_file << joint_trajectory.points[i].positions[j] << ","
-                  << joint_trajectory.points[i].velocities[j] << ",";
-      if (has_accelerations)
-        output_file << joint_trajectory.points[i].accelerations[j] << ",";
-    }
-
-    output_file << std::endl;
-  }
-  output_file.close();
-  ROS_DEBUG_STREAM_NAMED("execution_interface", "Saved trajectory to file " << file_name);
-  return true;
-}
-
 bool ExecutionInterface::getFilePath(std::string &file_path, const std::string &file_name) const
 {
   namespace fs = boost::filesystem;
@@ -503,6 +548,18 @@ moveit::core::RobotStatePtr ExecutionInterface::getCurrentState()
     return current_state_;
   }
 
+  // Get the latest joint values without locking the scene, unless something other than joint
+  // values (e.g. attached objects) changed since the last full copy
+  if (state_snapshot_ && !scene_changed_.exchange(false))
+  {
+    ros::Time stamp;
+    if (state_snapshot_->read(snapshot_positions_, stamp))
+    {
+      current_state_->setVariablePositions(snapshot_positions_);
+      return current_state_;
+    }
+  }
+
   // Get the real current state
   planning_scene_monitor::LockedPlanningSceneRO scene(
       planning_scene_monitor_);  // Lock planning scene
@@ -510,6 +567,13 @@ moveit::core::RobotStatePtr ExecutionInterface::getCurrentState()
   return current_state_;
 }
 
+void ExecutionInterface::sceneUpdateCallback(
+    planning_scene_monitor::PlanningSceneMonitor::SceneUpdateType type)
+{
+  if (type & planning_scene_monitor::PlanningSceneMonitor::UPDATE_GEOMETRY)
+    scene_changed_ = true;
+}
+
 bool ExecutionInterface::enableUnitTesting(bool enable)
 {
   unit_testing_enabled_ = enable;
@@ -0,0 +1,261 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Remember which grasps worked for each type of product, across orders and runs, so that
+           they can be tried before any others
+*/
+
+// PickNik
+#include <picknik_main/grasp_memory.h>
+
+// C++
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace picknik_main
+{
+GraspMemory::GraspMemory(double position_tolerance, double angle_tolerance)
+  : position_tolerance_(position_tolerance)
+  , angle_tolerance_(angle_tolerance)
+  , hit_time_(0)
+  , hits_(0)
+  , miss_time_(0)
+  , misses_(0)
+{
+}
+
+bool GraspMemory::load(const std::string& file_path)
+{
+  boost::mutex::scoped_lock lock(memory_mutex_);
+  grasps_.clear();
+
+  std::ifstream input(file_path.c_str());
+  if (!input.is_open())
+  {
+    ROS_WARN_STREAM_NAMED("grasp_memory", "No grasp memory at " << file_path << ", starting empty");
+    return false;
+  }
+
+  // Columns: product,successes,failures,x,y,z,qx,qy,qz,qw, with a header row
+  std::size_t count = 0;
+  std::string line;
+  std::getline(input, line);
+  while (std::getline(input, line))
+  {
+    std::istringstream line_stream(line);
+    std::string product;
+    std::string fields[9];
+    if (!std::getline(line_stream, product, ','))
+      continue;
+    bool complete = true;
+    for (std::size_t i = 0; i < 9 && complete; ++i)
+      complete = static_cast<bool>(std::getline(line_stream, fields[i], ','));
+    if (!complete)
+      continue;
+
+    RememberedGrasp grasp;
+    grasp.successes_ = strtoul(fields[0].c_str(), NULL, 10);
+    grasp.failures_ = strtoul(fields[1].c_str(), NULL, 10);
+    const Eigen::Quaterniond rotation(atof(fields[8].c_str()), atof(fields[5].c_str()),
+                                      atof(fields[6].c_str()), atof(fields[7].c_str()));
+    grasp.product_to_grasp_ = Eigen::Translation3d(atof(fields[2].c_str()),
+                                                   atof(fields[3].c_str()),
+                                                   atof(fields[4].c_str())) *
+                              rotation.normalized();
+    grasps_[product].push_back(grasp);
+    count++;
+  }
+
+  for (std::map<std::string, Grasps>::iterator it = grasps_.begin(); it != grasps_.end(); ++it)
+    std::stable_sort(it->second.begin(), it->second.end(), &GraspMemory::compareGrasps);
+
+  ROS_INFO_STREAM_NAMED("grasp_memory", "Loaded " << count << " remembered grasps of "
+                                                  << grasps_.size() << " products");
+  return true;
+}
+
+bool GraspMemory::save(const std::string& file_path) const
+{
+  std::ofstream output(file_path.c_str());
+  if (!output.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_memory", "Unable to write grasp memory " << file_path);
+    return false;
+  }
+
+  boost::mutex::scoped_lock lock(memory_mutex_);
+  output << "product,successes,failures,x,y,z,qx,qy,qz,qw" << std::endl;
+  for (std::map<std::string, Grasps>::const_iterator it = grasps_.begin(); it != grasps_.end();
+       ++it)
+  {
+    for (std::size_t i = 0; i < it->second.size(); ++i)
+    {
+      const RememberedGrasp& grasp = it->second[i];
+      const Eigen::Vector3d& position = grasp.product_to_grasp_.translation();
+      const Eigen::Quaterniond rotation(grasp.product_to_grasp_.rotation());
+      output << it->first << "," << grasp.successes_ << "," << grasp.failures_ << ","
+             << position.x() << "," << position.y() << "," << position.z() << "," << rotation.x()
+             << "," << rotation.y() << "," << rotation.z() << "," << rotation.w() << std::endl;
+    }
+  }
+  return true;
+}
+
+bool GraspMemory::findProvenGrasp(const std::string& product,
+                                  const Eigen::Affine3d& product_to_grasp, std::size_t& rank) const
+{
+  boost::mutex::scoped_lock lock(memory_mutex_);
+  std::map<std::string, Grasps>::const_iterator it = grasps_.find(product);
+  if (it == grasps_.end())
+    return false;
+
+  const std::size_t index = findMatch(it->second, product_to_grasp);
+  if (index == it->second.size())
+    return false;
+
+  // (s + 1) / (n + 2) > 0.5 once successes outnumber failures
+  const RememberedGrasp& grasp = it->second[index];
+  if (grasp.successes_ <= grasp.failures_)
+    return false;
+
+  rank = index;
+  return true;
+}
+
+std::size_t GraspMemory::orderGrasps(const std::string& product,
+                                     const EigenSTL::vector_Affine3d& product_to_grasps,
+                                     std::vector<std::size_t>& order) const
+{
+  // Rank of each candidate, unproven ones after every proven one
+  std::vector<std::pair<std::size_t, std::size_t> > ranked;
+  ranked.reserve(product_to_grasps.size());
+  std::size_t proven = 0;
+  for (std::size_t i = 0; i < product_to_grasps.size(); ++i)
+  {
+    std::size_t rank;
+    if (findProvenGrasp(product, product_to_grasps[i], rank))
+      proven++;
+    else
+      rank = std::numeric_limits<std::size_t>::max();
+    ranked.push_back(std::make_pair(rank, i));
+  }
+
+  // Candidate index breaks ties, which keeps the generated order
+  std::sort(ranked.begin(), ranked.end());
+  order.resize(ranked.size());
+  for (std::size_t i = 0; i < ranked.size(); ++i)
+    order[i] = ranked[i].second;
+
+  return proven;
+}
+
+void GraspMemory::recordResult(const std::string& product, const Eigen::Affine3d& product_to_grasp,
+                               bool success)
+{
+  boost::mutex::scoped_lock lock(memory_mutex_);
+  Grasps& grasps = grasps_[product];
+  const std::size_t index = findMatch(grasps, product_to_grasp);
+  if (index == grasps.size())
+  {
+    // Only grasps that have worked are worth trying first
+    if (!success)
+      return;
+
+    RememberedGrasp grasp;
+    grasp.product_to_grasp_ = product_to_grasp;
+    grasp.successes_ = 0;
+    grasp.failures_ = 0;
+    grasps.push_back(grasp);
+  }
+
+  if (success)
+    grasps[index].successes_++;
+  else
+    grasps[index].failures_++;
+  std::stable_sort(grasps.begin(), grasps.end(), &GraspMemory::compareGrasps);
+
+  ROS_INFO_STREAM_NAMED("grasp_memory", "Remembering grasp of " << product << " as a "
+                                                                << (success ? "success" : "failure")
+                                                                << ", " << grasps.size()
+                                                                << " grasps known for it");
+}
+
+void GraspMemory::recordTimeToChooseGrasp(double seconds, bool proven)
+{
+  boost::mutex::scoped_lock lock(memory_mutex_);
+  if (proven)
+  {
+    hit_time_ += seconds;
+    hits_++;
+  }
+  else
+  {
+    miss_time_ += seconds;
+    misses_++;
+  }
+}
+
+void GraspMemory::printStats() const
+{
+  boost::mutex::scoped_lock lock(memory_mutex_);
+  std::cout << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+  std::cout << "Grasp memory" << std::endl;
+  for (std::map<std::string, Grasps>::const_iterator it = grasps_.begin(); it != grasps_.end();
+       ++it)
+  {
+    if (it->second.empty())
+      continue;
+    const RememberedGrasp& best = it->second.front();
+    std::cout << "  " << it->first << ": " << it->second.size() << " grasps, best "
+              << best.successes_ << " of " << best.successes_ + best.failures_ << std::endl;
+  }
+  std::cout << "Time to choose a grasp: " << hits_ << " proven, mean "
+            << (hits_ ? hit_time_ / hits_ : 0.0) << " s, " << misses_ << " unproven, mean "
+            << (misses_ ? miss_time_ / misses_ : 0.0) << " s" << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+}
+
+bool GraspMemory::compareGrasps(const RememberedGrasp& a, const RememberedGrasp& b)
+{
+  // Compare (s_a + 1) / (n_a + 2) > (s_b + 1) / (n_b + 2) without dividing
+  const double a_rate = (a.successes_ + 1.0) * (b.successes_ + b.failures_ + 2.0);
+  const double b_rate = (b.successes_ + 1.0) * (a.successes_ + a.failures_ + 2.0);
+  if (a_rate != b_rate)
+    return a_rate > b_rate;
+  return a.successes_ > b.successes_;
+}
+
+bool GraspMemory::isSameGrasp(const Eigen::Affine3d& a_product_to_grasp,
+                              const Eigen::Affine3d& b_product_to_grasp) const
+{
+  if ((a_product_to_grasp.translation() - b_product_to_grasp.translation()).norm() >
+      position_tolerance_)
+    return false;
+  return Eigen::Quaterniond(a_product_to_grasp.rotation())
+             .angularDistance(Eigen::Quaterniond(b_product_to_grasp.rotation())) <=
+         angle_tolerance_;
+}
+
+std::size_t GraspMemory::findMatch(const Grasps& grasps,
+                                   const Eigen::Affine3d& product_to_grasp) const
+{
+  for (std::size_t i = 0; i < grasps.size(); ++i)
+    if (isSameGrasp(grasps[i].product_to_grasp_, product_to_grasp))
+      return i;
+  return grasps.size();
+}
+
+}  // end namespace
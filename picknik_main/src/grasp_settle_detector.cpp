@@ -0,0 +1,122 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Decide from end effector joint states, and optionally the tactile sensor, when a grip
+           has stopped changing, so that a pick only waits as long as the product needs
+*/
+
+// PickNik
+#include <picknik_main/grasp_settle_detector.h>
+
+// Boost
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace picknik_main
+{
+GraspSettleDetector::GraspSettleDetector(const std::vector<std::string>& variable_names,
+                                         double position_threshold, double effort_threshold,
+                                         double window)
+  : position_threshold_(position_threshold)
+  , effort_threshold_(effort_threshold)
+  , window_(window)
+  , positions_(variable_names.size(), 0.0)
+  , efforts_(variable_names.size(), 0.0)
+  , window_start_positions_(variable_names.size(), 0.0)
+  , window_start_efforts_(variable_names.size(), 0.0)
+{
+  for (std::size_t i = 0; i < variable_names.size(); ++i)
+    variable_indices_[variable_names[i]] = i;
+}
+
+void GraspSettleDetector::update(const sensor_msgs::JointStateConstPtr& joint_state)
+{
+  const ros::Time stamp =
+      joint_state->header.stamp.isZero() ? ros::Time::now() : joint_state->header.stamp;
+  const bool has_efforts = joint_state->effort.size() == joint_state->name.size();
+
+  // Copy in new values
+  bool changed = false;
+  bool found = false;
+  const std::size_t count = std::min(joint_state->name.size(), joint_state->position.size());
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::map<std::string, std::size_t>::const_iterator it =
+        variable_indices_.find(joint_state->name[i]);
+    if (it == variable_indices_.end())
+      continue;
+    found = true;
+    positions_[it->second] = joint_state->position[i];
+    if (has_efforts)
+      efforts_[it->second] = joint_state->effort[i];
+  }
+
+  // Messages from other controllers say nothing about the fingers
+  if (!found)
+    return;
+
+  // Check drift since start of window
+  for (std::size_t i = 0; i < positions_.size() && !changed; ++i)
+    if (fabs(positions_[i] - window_start_positions_[i]) > position_threshold_ ||
+        (has_efforts && fabs(efforts_[i] - window_start_efforts_[i]) > effort_threshold_))
+      changed = true;
+
+  {
+    boost::mutex::scoped_lock lock(stamp_mutex_);
+
+    // Restart the window from here
+    if (changed || window_start_stamp_.isZero())
+    {
+      window_start_positions_ = positions_;  // same size, no allocation
+      window_start_efforts_ = efforts_;
+      window_start_stamp_ = stamp;
+    }
+    latest_stamp_ = stamp;
+  }
+  update_condition_.notify_all();
+}
+
+bool GraspSettleDetector::waitForGrasp(double max_wait, const SettleCheck& check,
+                                       double& time_to_settle)
+{
+  const ros::Time call_stamp = ros::Time::now();
+  const boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+  const boost::posix_time::ptime end_time =
+      start_time + boost::posix_time::microseconds(static_cast<int64_t>(max_wait * 1e6));
+
+  boost::mutex::scoped_lock lock(stamp_mutex_);
+  while (true)
+  {
+    // Stillness from before the command was sent does not count
+    const ros::Time window_start = std::max(window_start_stamp_, call_stamp);
+    if (!latest_stamp_.isZero() && latest_stamp_ - window_start >= window_)
+    {
+      lock.unlock();
+      const bool settled = check.empty() || check(call_stamp);
+      lock.lock();
+
+      if (settled)
+        break;
+    }
+
+    if (!update_condition_.timed_wait(lock, end_time))
+    {
+      time_to_settle = max_wait;
+      return false;
+    }
+  }
+
+  time_to_settle =
+      (boost::posix_time::microsec_clock::universal_time() - start_time).total_microseconds() /
+      1e6;
+  return true;
+}
+
+}  // end namespace
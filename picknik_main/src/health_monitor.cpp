@@ -0,0 +1,149 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Keep track of whether the controllers, perception and joint states are alive from a
+           background thread, so that asking if the system is ready costs nothing
+*/
+
+// PickNik
+#include <picknik_main/health_monitor.h>
+
+namespace picknik_main
+{
+namespace
+{
+const std::string JOINT_STATES_CHECK = "joint_states";
+}  // end anonymous namespace
+
+HealthMonitor::HealthMonitor(double rate)
+  : period_(1.0 / rate)
+  , joint_state_timeout_(0)
+  , last_update_count_(0)
+  , healthy_(false)
+  , running_(false)
+  , started_(false)
+{
+}
+
+HealthMonitor::~HealthMonitor()
+{
+  running_ = false;
+  if (monitor_thread_.joinable())
+    monitor_thread_.join();
+}
+
+void HealthMonitor::addCheck(const std::string& name, const CheckFunction& check)
+{
+  Check new_check;
+  new_check.name_ = name;
+  new_check.check_ = check;
+  new_check.healthy_ = true;
+  new_check.failures_ = 0;
+  new_check.last_change_ = ros::WallTime::now();
+  checks_.push_back(new_check);
+}
+
+void HealthMonitor::watchJointStates(StateSnapshotPtr state_snapshot, double timeout)
+{
+  state_snapshot_ = state_snapshot;
+  joint_state_timeout_ = timeout;
+  last_update_count_ = state_snapshot_->getUpdateCount();
+  last_update_time_ = ros::WallTime::now();
+
+  addCheck(JOINT_STATES_CHECK, boost::bind(&HealthMonitor::checkJointStates, this));
+}
+
+bool HealthMonitor::start()
+{
+  if (started_)
+    return isHealthy();
+
+  const bool healthy = checkAll();
+
+  started_ = true;
+  running_ = true;
+  monitor_thread_ = boost::thread(boost::bind(&HealthMonitor::monitorThread, this));
+
+  return healthy;
+}
+
+void HealthMonitor::printStatus() const
+{
+  boost::unique_lock<boost::mutex> lock(checks_mutex_);
+  const ros::WallTime now = ros::WallTime::now();
+  for (std::size_t i = 0; i < checks_.size(); ++i)
+  {
+    const Check& check = checks_[i];
+    ROS_INFO_STREAM_NAMED("health_monitor", check.name_ << ": "
+                                                        << (check.healthy_ ? "ok" : "FAILED")
+                                                        << " for "
+                                                        << (now - check.last_change_).toSec()
+                                                        << " s, " << check.failures_
+                                                        << " failed checks in total");
+  }
+}
+
+void HealthMonitor::monitorThread()
+{
+  ros::WallTime next_check = ros::WallTime::now() + period_;
+  while (running_ && ros::ok())
+  {
+    ros::WallDuration sleep_time = next_check - ros::WallTime::now();
+    if (sleep_time > ros::WallDuration(0))
+      sleep_time.sleep();
+    next_check += period_;
+
+    checkAll();
+  }
+}
+
+bool HealthMonitor::checkAll()
+{
+  bool healthy = true;
+  for (std::size_t i = 0; i < checks_.size(); ++i)
+  {
+    // Run without the lock so printStatus() never waits on a service call
+    const bool check_healthy = checks_[i].check_();
+    healthy = healthy && check_healthy;
+
+    boost::unique_lock<boost::mutex> lock(checks_mutex_);
+    Check& check = checks_[i];
+    if (!check_healthy)
+      check.failures_++;
+    if (check_healthy == check.healthy_)
+      continue;
+
+    check.healthy_ = check_healthy;
+    check.last_change_ = ros::WallTime::now();
+    if (check_healthy)
+      ROS_INFO_STREAM_NAMED("health_monitor", check.name_ << " recovered");
+    else
+      ROS_ERROR_STREAM_NAMED("health_monitor", check.name_ << " failed");
+  }
+
+  healthy_.store(healthy, std::memory_order_release);
+  return healthy;
+}
+
+bool HealthMonitor::checkJointStates()
+{
+  const ros::WallTime now = ros::WallTime::now();
+  const std::size_t update_count = state_snapshot_->getUpdateCount();
+  if (update_count != last_update_count_)
+  {
+    last_update_count_ = update_count;
+    last_update_time_ = now;
+    return true;
+  }
+  return update_count > 0 && (now - last_update_time_).toSec() < joint_state_timeout_;
+}
+
+}  // end namespace
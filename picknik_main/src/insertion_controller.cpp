@@ -0,0 +1,437 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Run the insertion control loop on its own thread, optionally with real-time priority,
+           reading tactile data and writing poses without locks or I/O
+*/
+
+// PickNik
+#include <picknik_main/insertion_controller.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// Linux
+#include <pthread.h>
+#include <sched.h>
+
+namespace picknik_main
+{
+namespace
+{
+// Histogram resolution, jitter is much smaller than the period
+const double PERIOD_BIN_WIDTH = 0.0005;  // sec
+const double JITTER_BIN_WIDTH = 0.00005;  // sec
+
+// Largest factor an adaptive step can grow by from one tick to the next
+const double STEP_GROWTH = 1.25;
+}  // end anonymous namespace
+
+const std::size_t InsertionController::Histogram::NUM_BINS;
+
+InsertionGoal::InsertionGoal()
+  : world_to_tool_(Eigen::Affine3d::Identity())
+  , base_to_world_(Eigen::Affine3d::Identity())
+  , tool_to_command_(Eigen::Affine3d::Identity())
+  , distance_(0)
+  , direction_in_(true)
+  , num_steps_(0)
+  , step_duration_(0.1)
+  , command_duration_(0.1)
+  , use_tactile_(false)
+  , torque_min_(0)
+  , torque_max_(0)
+  , torque_scale_(0)
+  , correction_pause_(0)
+  , adaptive_step_(false)
+  , min_step_(0)
+  , max_step_(0)
+  , contact_force_(1)
+  , contact_torque_(1)
+  , max_sample_age_(0.05)
+{
+}
+
+InsertionStepper::InsertionStepper()
+  : adaptive_step_(false)
+  , rotated_direction_(Eigen::Vector3d::UnitZ())
+  , fixed_step_(0)
+  , step_distance_(0)
+  , pause_ticks_(0)
+  , hold_ticks_(0)
+  , world_to_tool_(Eigen::Affine3d::Identity())
+  , steps_(0)
+  , corrections_(0)
+  , stale_samples_(0)
+  , held_ticks_(0)
+  , travelled_(0)
+  , net_rotation_(0)
+  , max_rotation_(0)
+{
+}
+
+void InsertionStepper::reset(const InsertionGoal& goal)
+{
+  goal_ = goal;
+  adaptive_step_ =
+      goal_.adaptive_step_ && goal_.min_step_ > 0 && goal_.max_step_ >= goal_.min_step_;
+
+  Eigen::Vector3d approach_direction;
+  approach_direction << 0, 0, (goal_.direction_in_ ? 1 : -1);
+  rotated_direction_ = goal_.world_to_tool_.rotation() * approach_direction;
+  fixed_step_ = goal_.num_steps_ ? goal_.distance_ / double(goal_.num_steps_) : 0;
+  step_distance_ = adaptive_step_ ? goal_.min_step_ : fixed_step_;
+  pause_ticks_ =
+      goal_.step_duration_ > 0 ? ceil(goal_.correction_pause_ / goal_.step_duration_) : 0;
+  hold_ticks_ = 0;
+
+  world_to_tool_ = goal_.world_to_tool_;
+  steps_ = 0;
+  corrections_ = 0;
+  stale_samples_ = 0;
+  held_ticks_ = 0;
+  travelled_ = 0;
+  net_rotation_ = 0;
+  max_rotation_ = 0;
+}
+
+bool InsertionStepper::isDone() const
+{
+  return !goal_.num_steps_ || travelled_ >= goal_.distance_ - fixed_step_ * 1e-6;
+}
+
+bool InsertionStepper::needsTactile() const { return goal_.use_tactile_ || adaptive_step_; }
+
+bool InsertionStepper::step(const TactileSample* sample, const ros::Time& now)
+{
+  // Hold position for a while after a correction so it can take effect
+  if (hold_ticks_)
+  {
+    hold_ticks_--;
+    held_ticks_++;
+    return false;
+  }
+  steps_++;
+
+  // A stalled sensor must not keep the last reading, which may have been free space
+  if (sample && (now - sample->stamp_).toSec() > goal_.max_sample_age_)
+  {
+    stale_samples_++;
+    sample = NULL;
+  }
+
+  // Large steps in free space, small ones in contact
+  if (adaptive_step_)
+    step_distance_ = getAdaptiveStep(sample, step_distance_);
+  step_distance_ = std::min(step_distance_, goal_.distance_ - travelled_);
+
+  // Move target pose inward
+  world_to_tool_.translation() += rotated_direction_ * step_distance_;
+  travelled_ += step_distance_;
+
+  // Adjust pose based on tactile feedback
+  double rotation;
+  if (goal_.use_tactile_ && sample &&
+      TactileFeedback::computeInsertionRotation(sample->data_[SHEER_TORQUE], goal_.torque_min_,
+                                                goal_.torque_max_, goal_.torque_scale_, rotation))
+  {
+    world_to_tool_ = world_to_tool_ * Eigen::AngleAxisd(rotation, Eigen::Vector3d::UnitY());
+    corrections_++;
+    net_rotation_ += rotation;
+    max_rotation_ = std::max(max_rotation_, fabs(rotation));
+    hold_ticks_ = pause_ticks_;
+  }
+  return true;
+}
+
+double InsertionStepper::getAdaptiveStep(const TactileSample* sample, double previous_step) const
+{
+  // Without data assume contact
+  double contact = 1.0;
+  if (sample)
+    contact = std::max(fabs(sample->data_[SHEER_FORCE]) / goal_.contact_force_,
+                       fabs(sample->data_[SHEER_TORQUE]) / goal_.contact_torque_);
+  contact = std::min(1.0, contact);
+
+  // Shrink immediately, grow gradually
+  const double step = goal_.max_step_ - (goal_.max_step_ - goal_.min_step_) * contact;
+  return std::max(goal_.min_step_, std::min(step, previous_step * STEP_GROWTH));
+}
+
+void InsertionController::Histogram::reset(double bin_width)
+{
+  bin_width_ = bin_width;
+  std::fill(bins_, bins_ + NUM_BINS + 1, 0);
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+}
+
+void InsertionController::Histogram::add(double value)
+{
+  const std::size_t bin =
+      value <= 0 ? 0 : std::min(static_cast<std::size_t>(value / bin_width_), NUM_BINS);
+  bins_[bin]++;
+  count_++;
+  sum_ += value;
+  max_ = std::max(max_, value);
+}
+
+double InsertionController::Histogram::getPercentile(double fraction) const
+{
+  const std::size_t rank = std::max<std::size_t>(1, ceil(fraction * count_));
+  std::size_t cumulative = 0;
+  for (std::size_t bin = 0; bin < NUM_BINS; ++bin)
+  {
+    cumulative += bins_[bin];
+    if (cumulative >= rank)
+      return std::min((bin + 1) * bin_width_, max_);  // upper edge of the bin
+  }
+  return max_;
+}
+
+InsertionController::InsertionController(TactileFeedbackPtr tactile_feedback,
+                                         CartesianCommandStreamerPtr cartesian_command_streamer,
+                                         int priority, int cpu)
+  : tactile_feedback_(tactile_feedback)
+  , cartesian_command_streamer_(cartesian_command_streamer)
+  , priority_(priority)
+  , cpu_(cpu)
+  , goal_pending_(false)
+  , goal_done_(true)
+  , shutdown_(false)
+  , cancel_(false)
+  , hold_(false)
+  , missed_deadlines_(0)
+  , duration_(0)
+  , baseline_duration_(0)
+  , pause_duration_(0)
+{
+  period_histogram_.reset(PERIOD_BIN_WIDTH);
+  jitter_histogram_.reset(JITTER_BIN_WIDTH);
+  control_thread_ = boost::thread(boost::bind(&InsertionController::controlThread, this));
+}
+
+InsertionController::~InsertionController()
+{
+  cancel_ = true;
+  {
+    boost::mutex::scoped_lock lock(goal_mutex_);
+    shutdown_ = true;
+  }
+  goal_condition_.notify_all();
+  control_thread_.join();
+}
+
+bool InsertionController::start(const InsertionGoal& goal)
+{
+  {
+    boost::mutex::scoped_lock lock(goal_mutex_);
+    if (!goal_done_)
+    {
+      ROS_ERROR_STREAM_NAMED("insertion_controller", "Insertion already running");
+      return false;
+    }
+    goal_ = goal;
+    goal_pending_ = true;
+    goal_done_ = false;
+    cancel_ = false;
+    hold_ = false;
+  }
+  goal_condition_.notify_all();
+  return true;
+}
+
+bool InsertionController::waitForCompletion(double timeout)
+{
+  const boost::system_time end_time =
+      boost::get_system_time() + boost::posix_time::microseconds(static_cast<int64_t>(timeout * 1e6));
+
+  boost::mutex::scoped_lock lock(goal_mutex_);
+  while (!goal_done_)
+    if (!goal_condition_.timed_wait(lock, end_time))
+      return goal_done_;
+  return true;
+}
+
+void InsertionController::cancel() { cancel_ = true; }
+
+void InsertionController::setHold(bool hold) { hold_ = hold; }
+
+std::size_t InsertionController::getResult(Eigen::Affine3d& world_to_tool) const
+{
+  world_to_tool = stepper_.getPose();
+  return stepper_.getCorrections();
+}
+
+void InsertionController::printStats() const
+{
+  ROS_INFO_STREAM_NAMED("insertion_controller",
+                        "Insertion ran " << stepper_.getSteps() << " steps, "
+                                         << stepper_.getCorrections()
+                                         << " tactile corrections, " << stepper_.getStaleSamples()
+                                         << " stale samples, " << missed_deadlines_
+                                         << " missed deadlines");
+  ROS_INFO_STREAM_NAMED("insertion_controller",
+                        "Moved " << stepper_.getTravelled() << " m in " << duration_
+                                 << " s, fixed step baseline "
+                                 << baseline_duration_ << " s ("
+                                 << (duration_ > 0 ? baseline_duration_ / duration_ : 0)
+                                 << "x), both including " << pause_duration_
+                                 << " s of correction pauses");
+  if (!period_histogram_.count_)
+    return;
+  ROS_INFO_STREAM_NAMED("insertion_controller",
+                        "Period mean " << period_histogram_.sum_ / period_histogram_.count_ * 1000
+                                       << " ms, p50 "
+                                       << period_histogram_.getPercentile(0.5) * 1000 << " ms, p99 "
+                                       << period_histogram_.getPercentile(0.99) * 1000
+                                       << " ms, max " << period_histogram_.max_ * 1000 << " ms");
+  ROS_INFO_STREAM_NAMED("insertion_controller",
+                        "Wake up jitter mean "
+                            << jitter_histogram_.sum_ / jitter_histogram_.count_ * 1e6
+                            << " us, p50 " << jitter_histogram_.getPercentile(0.5) * 1e6
+                            << " us, p99 " << jitter_histogram_.getPercentile(0.99) * 1e6
+                            << " us, max " << jitter_histogram_.max_ * 1e6 << " us");
+}
+
+void InsertionController::controlThread()
+{
+  configureThread();
+
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock lock(goal_mutex_);
+      while (!goal_pending_ && !shutdown_)
+        goal_condition_.wait(lock);
+      if (shutdown_)
+        return;
+      goal_pending_ = false;
+    }
+
+    runGoal();
+
+    {
+      boost::mutex::scoped_lock lock(goal_mutex_);
+      goal_done_ = true;
+    }
+    goal_condition_.notify_all();
+  }
+}
+
+void InsertionController::configureThread()
+{
+  if (cpu_ >= 0)
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu_, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+      ROS_WARN_STREAM_NAMED("insertion_controller", "Unable to pin control thread to cpu " << cpu_);
+  }
+
+  if (priority_ > 0)
+  {
+    sched_param param;
+    param.sched_priority = priority_;
+    // Usually requires rtprio in /etc/security/limits.conf
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+      ROS_WARN_STREAM_NAMED("insertion_controller", "Unable to set SCHED_FIFO priority "
+                                                        << priority_
+                                                        << ", using normal scheduling");
+  }
+}
+
+void InsertionController::runGoal()
+{
+  // Setup, before the first deadline
+  stepper_.reset(goal_);
+  missed_deadlines_ = 0;
+  duration_ = 0;
+  baseline_duration_ = goal_.num_steps_ * goal_.step_duration_;
+  pause_duration_ = 0;
+  period_histogram_.reset(PERIOD_BIN_WIDTH);
+  jitter_histogram_.reset(JITTER_BIN_WIDTH);
+
+  if (stepper_.isDone())
+    return;
+  const bool needs_tactile = stepper_.needsTactile();
+
+  const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(goal_.step_duration_));
+
+  TactileSample sample;
+  const Clock::time_point start_time = Clock::now();
+  Clock::time_point deadline = start_time;
+  Clock::time_point last_wake = deadline;
+  Clock::duration held_time = Clock::duration::zero();
+
+  // Begin real time loop
+  while (!stepper_.isDone() && !cancel_)
+  {
+    // Hold position while held from outside
+    const bool held = hold_;
+    if (!held)
+    {
+      const bool has_sample = needs_tactile && tactile_feedback_->getLatestSample(sample);
+      if (stepper_.step(has_sample ? &sample : NULL, ros::Time::now()))
+        command(stepper_.getPose());
+    }
+
+    // Wait for next tick
+    deadline += period;
+    std::this_thread::sleep_until(deadline);
+    const Clock::time_point wake = Clock::now();
+    jitter_histogram_.add(std::chrono::duration<double>(wake - deadline).count());
+    period_histogram_.add(std::chrono::duration<double>(wake - last_wake).count());
+    if (held)
+      held_time += wake - last_wake;
+    last_wake = wake;
+
+    // Skip ticks we are already too late for rather than bursting to catch up
+    if (wake > deadline + period)
+    {
+      missed_deadlines_++;
+      deadline = wake;
+    }
+  }
+
+  duration_ = std::chrono::duration<double>(Clock::now() - start_time - held_time).count();
+
+  // Fixed steps would have paused after the same corrections
+  pause_duration_ = stepper_.getHoldTicks() * goal_.step_duration_;
+  baseline_duration_ += pause_duration_;
+}
+
+void InsertionController::command(const Eigen::Affine3d& world_to_tool)
+{
+  const Eigen::Affine3d base_to_command =
+      goal_.base_to_world_ * world_to_tool * goal_.tool_to_command_;
+  const Eigen::Quaterniond rotation(base_to_command.rotation());
+
+  geometry_msgs::Pose pose;
+  pose.position.x = base_to_command.translation().x();
+  pose.position.y = base_to_command.translation().y();
+  pose.position.z = base_to_command.translation().z();
+  pose.orientation.x = rotation.x();
+  pose.orientation.y = rotation.y();
+  pose.orientation.z = rotation.z();
+  pose.orientation.w = rotation.w();
+  cartesian_command_streamer_->push(pose, goal_.command_duration_);
+
+  // Lock-free, and a no-op unless recording
+  tactile_feedback_->recordCommand(base_to_command, goal_.command_duration_);
+}
+
+}  // end namespace
@@ -0,0 +1,180 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Record every joint state message to file, without polling the robot state
+*/
+
+// PickNik
+#include <picknik_main/joint_state_recorder.h>
+
+namespace picknik_main
+{
+JointStateRecorder::JointStateRecorder(const std::string& topic,
+                                       const moveit::core::RobotState& initial_state,
+                                       double position_threshold, double max_interval,
+                                       std::size_t buffer_size)
+  : nh_("~")
+  , topic_(topic)
+  , position_threshold_(position_threshold)
+  , max_interval_(max_interval)
+  , head_(0)
+  , count_(0)
+  , running_(false)
+  , received_(0)
+  , recorded_(0)
+  , dropped_(0)
+{
+  const std::vector<std::string>& variable_names = initial_state.getVariableNames();
+  for (std::size_t i = 0; i < variable_names.size(); ++i)
+    variable_indices_[variable_names[i]] = i;
+
+  const double* positions = initial_state.getVariablePositions();
+  latest_positions_.assign(positions, positions + variable_names.size());
+
+  // Allocate all memory up front
+  ring_.resize(buffer_size);
+  for (std::size_t i = 0; i < ring_.size(); ++i)
+    ring_[i].positions_.resize(variable_names.size());
+
+  nh_.setCallbackQueue(&callback_queue_);
+}
+
+JointStateRecorder::~JointStateRecorder() { stop(); }
+
+bool JointStateRecorder::start(const std::string& file_path)
+{
+  if (running_)
+  {
+    ROS_WARN_STREAM_NAMED("joint_state_recorder", "Already recording");
+    return false;
+  }
+
+  output_file_.open(file_path.c_str());
+  if (!output_file_.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("joint_state_recorder", "Unable to open " << file_path);
+    return false;
+  }
+  ROS_DEBUG_STREAM_NAMED("joint_state_recorder", "Recording joint states to file " << file_path);
+
+  last_recorded_stamp_ = ros::Time();
+  head_ = 0;
+  count_ = 0;
+  running_ = true;
+  writer_thread_ = boost::thread(boost::bind(&JointStateRecorder::writerThread, this));
+
+  joint_state_sub_ = nh_.subscribe(topic_, 1000, &JointStateRecorder::jointStateCallback, this,
+                                   ros::TransportHints().tcpNoDelay());
+  spinner_.reset(new ros::AsyncSpinner(1, &callback_queue_));
+  spinner_->start();
+
+  return true;
+}
+
+void JointStateRecorder::stop()
+{
+  if (!running_)
+    return;
+
+  // No more callbacks after this
+  spinner_->stop();
+  joint_state_sub_.shutdown();
+
+  {
+    boost::mutex::scoped_lock lock(ring_mutex_);
+    running_ = false;
+  }
+  ring_condition_.notify_one();
+  writer_thread_.join();
+  output_file_.close();
+
+  ROS_INFO_STREAM_NAMED("joint_state_recorder", "Recorded " << recorded_ << " of " << received_
+                                                            << " joint states, " << dropped_
+                                                            << " dropped");
+}
+
+void JointStateRecorder::jointStateCallback(const sensor_msgs::JointStateConstPtr& msg)
+{
+  received_++;
+
+  // Update our copy of every variable
+  const std::size_t count = std::min(msg->name.size(), msg->position.size());
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::map<std::string, std::size_t>::const_iterator it = variable_indices_.find(msg->name[i]);
+    if (it != variable_indices_.end())
+      latest_positions_[it->second] = msg->position[i];
+  }
+  const ros::Time stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
+
+  // Decide if this sample is worth keeping
+  bool record = last_recorded_stamp_.isZero() || stamp - last_recorded_stamp_ >= max_interval_;
+  for (std::size_t i = 0; i < latest_positions_.size() && !record; ++i)
+    if (fabs(latest_positions_[i] - last_recorded_positions_[i]) > position_threshold_)
+      record = true;
+  if (!record)
+    return;
+  last_recorded_positions_ = latest_positions_;
+  last_recorded_stamp_ = stamp;
+
+  // Queue for writer
+  {
+    boost::mutex::scoped_lock lock(ring_mutex_);
+    if (count_ == ring_.size())
+    {
+      dropped_++;
+      return;
+    }
+    Sample& sample = ring_[(head_ + count_) % ring_.size()];
+    sample.stamp_ = stamp;
+    sample.positions_ = latest_positions_;  // same size, no allocation
+    count_++;
+  }
+  ring_condition_.notify_one();
+}
+
+void JointStateRecorder::writerThread()
+{
+  while (true)
+  {
+    std::size_t count;
+    {
+      boost::mutex::scoped_lock lock(ring_mutex_);
+      while (count_ == 0 && running_)
+        ring_condition_.wait(lock);
+
+      if (count_ == 0)  // only possible when stopped
+        return;
+      count = count_;
+    }
+
+    // These samples are not touched by the callback until released below
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const Sample& sample = ring_[(head_ + i) % ring_.size()];
+      for (std::size_t j = 0; j < sample.positions_.size(); ++j)
+        output_file_ << sample.positions_[j] << ",";
+      output_file_.precision(20);
+      output_file_ << sample.stamp_.toSec() << '\n';
+      output_file_.precision(6);
+    }
+    output_file_.flush();
+    recorded_ += count;
+
+    {
+      boost::mutex::scoped_lock lock(ring_mutex_);
+      head_ = (head_ + count) % ring_.size();
+      count_ -= count;
+    }
+  }
+}
+
+}  // end namespace
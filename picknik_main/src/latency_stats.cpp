@@ -0,0 +1,156 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Histograms of how long each phase of a motion takes, from planning to the controller
+           reporting done
+*/
+
+// PickNik
+#include <picknik_main/latency_stats.h>
+
+// C++
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <algorithm>
+
+namespace picknik_main
+{
+const double LatencyStats::MIN_SECONDS = 0.0001;
+
+LatencyStats::Histogram::Histogram()
+  : bins_(BINS_PER_DECADE * NUM_DECADES + 2, 0), count_(0), sum_(0), max_(0)
+{
+}
+
+void LatencyStats::Histogram::add(double seconds)
+{
+  std::size_t bin = 0;  // underflow
+  if (seconds >= MIN_SECONDS)
+    bin = std::min(static_cast<std::size_t>(log10(seconds / MIN_SECONDS) * BINS_PER_DECADE) + 1,
+                   bins_.size() - 1);
+  bins_[bin]++;
+  count_++;
+  sum_ += seconds;
+  max_ = std::max(max_, seconds);
+}
+
+double LatencyStats::Histogram::getPercentile(double fraction) const
+{
+  const std::size_t rank = std::max<std::size_t>(1, ceil(fraction * count_));
+  std::size_t cumulative = 0;
+  for (std::size_t bin = 0; bin < bins_.size(); ++bin)
+  {
+    cumulative += bins_[bin];
+    if (cumulative >= rank)
+    {
+      // Upper edge of the bin, never more than what was actually seen
+      const double upper = MIN_SECONDS * pow(10.0, static_cast<double>(bin) / BINS_PER_DECADE);
+      return bin == bins_.size() - 1 ? max_ : std::min(upper, max_);
+    }
+  }
+  return max_;
+}
+
+LatencyStats::LatencyStats() : motion_type_("unlabeled") {}
+
+void LatencyStats::setMotionType(const std::string& motion_type)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  motion_type_ = motion_type;
+}
+
+std::string LatencyStats::getMotionType() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return motion_type_;
+}
+
+void LatencyStats::record(Phase phase, double seconds) { record(getMotionType(), phase, seconds); }
+
+void LatencyStats::record(const std::string& motion_type, Phase phase, double seconds)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  PhaseHistograms& phases = histograms_[motion_type];
+  if (phases.empty())
+    phases.resize(NUM_PHASES);
+  phases[phase].add(std::max(0.0, seconds));
+}
+
+double LatencyStats::now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void LatencyStats::printSummary(std::ostream& out) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  out << std::endl;
+  out << "-------------------------------------------------------" << std::endl;
+  out << "Motion latency summary (milliseconds)" << std::endl;
+  out << std::left << std::setw(20) << "phase" << std::right << std::setw(7) << "count"
+      << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+      << std::setw(10) << "p99" << std::setw(10) << "max" << std::setw(10) << "total" << std::endl;
+  out << std::fixed << std::setprecision(1);
+
+  for (std::map<std::string, PhaseHistograms>::const_iterator it = histograms_.begin();
+       it != histograms_.end(); ++it)
+  {
+    out << it->first << ":" << std::endl;
+    for (std::size_t phase = 0; phase < NUM_PHASES; ++phase)
+    {
+      const Histogram& histogram = it->second[phase];
+      if (!histogram.count_)
+        continue;
+      out << "  " << std::left << std::setw(18) << getPhaseName(static_cast<Phase>(phase))
+          << std::right << std::setw(7) << histogram.count_ << std::setw(10)
+          << 1000 * histogram.sum_ / histogram.count_ << std::setw(10)
+          << 1000 * histogram.getPercentile(0.5) << std::setw(10)
+          << 1000 * histogram.getPercentile(0.9) << std::setw(10)
+          << 1000 * histogram.getPercentile(0.99) << std::setw(10) << 1000 * histogram.max_
+          << std::setw(10) << 1000 * histogram.sum_ << std::endl;
+    }
+  }
+  out << "-------------------------------------------------------" << std::endl;
+  out.unsetf(std::ios::floatfield);
+  out << std::setprecision(6);
+}
+
+void LatencyStats::reset()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  histograms_.clear();
+}
+
+const char* LatencyStats::getPhaseName(Phase phase)
+{
+  switch (phase)
+  {
+    case PLAN:
+      return "plan";
+    case PARAMETERIZE:
+      return "parameterize";
+    case PUSH:
+      return "push";
+    case CONTROLLER_LATENCY:
+      return "controller_latency";
+    case MOTION:
+      return "motion";
+    case SETTLE:
+      return "settle";
+    default:
+      return "unknown";
+  }
+}
+
+}  // end namespace
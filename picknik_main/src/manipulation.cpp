@@ -33,6 +33,23 @@
 
 namespace picknik_main
 {
+// Fraction of the finger joints' velocity limits used for end effector motions
+static const double EE_VELOCITY_SCALING_FACTOR = 0.1;
+
+namespace
+{
+/** \brief Drops a request queued for the next arm motion when that motion returns early */
+class QueuedRequestGuard
+{
+public:
+  QueuedRequestGuard(bool& queued) : queued_(queued) {}
+  ~QueuedRequestGuard() { queued_ = false; }
+
+private:
+  bool& queued_;
+};
+}  // end anonymous namespace
+
 Manipulation::Manipulation(bool verbose, VisualsPtr visuals,
                            planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
                            ManipulationDataPtr config, moveit_grasps::GraspDatas grasp_datas,
@@ -46,6 +63,17 @@ Manipulation::Manipulation(bool verbose, VisualsPtr visuals,
   , grasp_datas_(grasp_datas)
   , remote_control_(remote_control)
   , tactile_feedback_(tactile_feedback)
+  , state_pool_(new RobotStatePool())
+  , ee_posture_queued_(false)
+  , queued_ee_arm_jmg_(NULL)
+  , queued_ee_window_(0)
+  , ee_overlap_saved_(0)
+  , plan_lookahead_queued_(false)
+  , queued_lookahead_arm_jmg_(NULL)
+  , plan_lookahead_arm_jmg_(NULL)
+  , plan_lookahead_success_(false)
+  , grasp_wait_saved_(0)
+  , grasp_waits_(0)
 {
   // Create initial robot state
   {
@@ -64,6 +92,18 @@ Manipulation::Manipulation(bool verbose, VisualsPtr visuals,
   execution_interface_.reset(new ExecutionInterface(verbose_, remote_control_, visuals_,
                                                     grasp_datas_, planning_scene_monitor_, config_,
                                                     current_state_, fake_execution));
+  latency_stats_ = execution_interface_->getLatencyStats();
+
+  // Load insertion control thread
+  insertion_controller_.reset(new InsertionController(
+      tactile_feedback_, execution_interface_->getCartesianCommandStreamer(),
+      config_->insertion_thread_priority_, config_->insertion_thread_cpu_));
+
+  // Load clearance based velocity scaling
+  clearance_velocity_scaler_.reset(new ClearanceVelocityScaler(
+      config_->clearance_near_distance_, config_->clearance_far_distance_,
+      config_->free_space_velocity_scaling_factor_, config_->payload_velocity_scaling_factor_,
+      config_->clearance_check_stride_));
 
   // Load logging capability
   if (config_->use_experience_setup_)
@@ -85,12 +125,15 @@ Manipulation::Manipulation(bool verbose, VisualsPtr visuals,
   grasp_filter_.reset(new moveit_grasps::GraspFilter(current_state_, visuals_->grasp_markers_));
   grasp_planner_.reset(new moveit_grasps::GraspPlanner(visuals_->trajectory_lines_));
   grasp_planner_->setWaitForNextStepCallback(
-      boost::bind(&picknik_main::RemoteControl::waitForNextStep, remote_control_, _1));
+      boost::bind(&picknik_main::RemoteControl::waitForNextStep, remote_control_, _1, __FILE__,
+                  __LINE__));
 
   // Done
   ROS_INFO_STREAM_NAMED("manipulation", "Manipulation Ready.");
 }
 
+Manipulation::~Manipulation() { discardPlanLookahead(); }
+
 bool Manipulation::computeCartesianWaypointPath(
     JointModelGroup* arm_jmg, const moveit::core::RobotStatePtr start_state,
     const EigenSTL::vector_Affine3d& waypoints,
@@ -196,6 +239,14 @@ bool Manipulation::computeCartesianWaypointPath(
 
 bool Manipulation::moveCartesianWaypointPath(JointModelGroup* arm_jmg,
                                              EigenSTL::vector_Affine3d waypoints)
+{
+  std::vector<moveit::core::RobotStatePtr> solved_path;
+  return moveCartesianWaypointPath(arm_jmg, waypoints, solved_path);
+}
+
+bool Manipulation::moveCartesianWaypointPath(JointModelGroup* arm_jmg,
+                                             EigenSTL::vector_Affine3d waypoints,
+                                             std::vector<moveit::core::RobotStatePtr>& solved_path)
 {
   // Debug
   visuals_->visual_tools_->publishAxisLabeled(waypoints.front(), "start");
@@ -226,6 +277,71 @@ bool Manipulation::moveCartesianWaypointPath(JointModelGroup* arm_jmg,
                                     segmented_cartesian_traj[i].end());
   }
 
+  // Remember solution, starting from where the first waypoint was reached
+  solved_path.clear();
+  solved_path.push_back(state_pool_->acquire(*getCurrentState()));
+  solved_path.insert(solved_path.end(), single_cartesian_traj[0].begin(),
+                     single_cartesian_traj[0].end());
+
+  visuals_->visual_tools_->publishTrajectoryPoints(single_cartesian_traj[0],
+                                                   grasp_datas_[arm_jmg]->parent_link_, rvt::RAND);
+
+  if (!executeSavedCartesianPath(single_cartesian_traj, arm_jmg, 0))
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Error executing trajectory segment " << 0);
+    return false;
+  }
+
+  return true;
+}
+
+bool Manipulation::checkSolvedWaypointPath(
+    JointModelGroup* arm_jmg, const std::vector<moveit::core::RobotStatePtr>& solved_path)
+{
+  if (solved_path.empty())
+    return false;
+
+  planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor_);
+  for (std::size_t i = 0; i < solved_path.size(); ++i)
+  {
+    if (!solved_path[i]->satisfiesBounds(arm_jmg, fix_state_bounds_.getMaxBoundsError()))
+    {
+      ROS_WARN_STREAM_NAMED("manipulation.waypoints", "Solved waypoint " << i
+                                                                         << " is out of bounds");
+      return false;
+    }
+
+    solved_path[i]->update();
+    if (scene->isStateColliding(*solved_path[i], arm_jmg->getName()))
+    {
+      ROS_WARN_STREAM_NAMED("manipulation.waypoints", "Solved waypoint " << i
+                                                                         << " is now colliding");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Manipulation::moveSolvedWaypointPath(
+    JointModelGroup* arm_jmg, const std::vector<moveit::core::RobotStatePtr>& solved_path)
+{
+  // Move to first position
+  bool verbose = false;
+  bool execute_trajectory = true;
+  if (!move(getCurrentState(), solved_path.front(), arm_jmg, config_->main_velocity_scaling_factor_,
+            verbose, execute_trajectory))
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation", "Unable to move to starting state");
+    return false;
+  }
+
+  // Remaining path
+  moveit_grasps::GraspTrajectories single_cartesian_traj;
+  single_cartesian_traj.resize(1);
+  single_cartesian_traj[0].assign(solved_path.begin() + 1, solved_path.end());
+  if (single_cartesian_traj[0].empty())
+    return true;
+
   visuals_->visual_tools_->publishTrajectoryPoints(single_cartesian_traj[0],
                                                    grasp_datas_[arm_jmg]->parent_link_, rvt::RAND);
 
@@ -247,8 +363,7 @@ bool Manipulation::moveToSRDFPose(JointModelGroup* arm_jmg, const std::string& p
   getCurrentState();
 
   // Set goal state to initial pose
-  moveit::core::RobotStatePtr goal_state(
-      new moveit::core::RobotState(*current_state_));  // Allocate robot states
+  moveit::core::RobotStatePtr goal_state = state_pool_->acquire(*current_state_);
   if (!goal_state->setToDefaultValues(arm_jmg, pose_name))
   {
     ROS_ERROR_STREAM_NAMED("manipulation", "Failed to set pose '" << pose_name
@@ -278,8 +393,7 @@ bool Manipulation::moveToSRDFPoseNoPlan(JointModelGroup* arm_jmg, const std::str
   getCurrentState();
 
   // Set goal state to initial pose
-  moveit::core::RobotStatePtr goal_state(
-      new moveit::core::RobotState(*current_state_));  // Allocate robot states
+  moveit::core::RobotStatePtr goal_state = state_pool_->acquire(*current_state_);
   if (!goal_state->setToDefaultValues(arm_jmg, pose_name))
   {
     ROS_ERROR_STREAM_NAMED("manipulation", "Failed to set pose '" << pose_name
@@ -306,7 +420,7 @@ bool Manipulation::moveToEEPose(const Eigen::Affine3d& ee_pose, double velocity_
 {
   // Create start and goal
   getCurrentState();
-  moveit::core::RobotStatePtr goal_state(new moveit::core::RobotState(*current_state_));
+  moveit::core::RobotStatePtr goal_state = state_pool_->acquire(*current_state_);
 
   if (!getRobotStateFromPose(ee_pose, goal_state, arm_jmg))
   {
@@ -335,6 +449,12 @@ bool Manipulation::move(const moveit::core::RobotStatePtr& start,
                         double velocity_scaling_factor, bool verbose, bool execute_trajectory,
                         bool check_validity)
 {
+  latency_stats_->setMotionType("planned");
+
+  // A queued finger motion or lookahead is only for this arm motion, even if it ends up not moving
+  QueuedRequestGuard queued_ee_posture_guard(ee_posture_queued_);
+  QueuedRequestGuard queued_plan_lookahead_guard(plan_lookahead_queued_);
+
   ROS_INFO_STREAM_NAMED("manipulation.move", "Planning to new pose with velocity scale "
                                                  << velocity_scaling_factor);
 
@@ -365,10 +485,11 @@ bool Manipulation::move(const moveit::core::RobotStatePtr& start,
     return true;
   }
 
-  // Do motion plan
+  // Do motion plan, unless it was already planned while the previous motion executed
   moveit_msgs::RobotTrajectory trajectory_msg;
+  const bool planned_ahead = takePlanLookahead(start, goal, arm_jmg, trajectory_msg);
   std::size_t plan_attempts = 0;
-  while (ros::ok())
+  while (!planned_ahead && ros::ok())
   {
     if (plan_attempts > 0)
       ROS_WARN_STREAM_NAMED("manipulation", "Previous plan attempt failed, trying again on attempt "
@@ -418,7 +539,10 @@ bool Manipulation::move(const moveit::core::RobotStatePtr& start,
       std::cout << "BEFORE PARAM: \n" << trajectory_msg << std::endl;
 
       // Perform iterative parabolic smoothing
+      const double parameterize_start_time = LatencyStats::now();
       iterative_smoother_.computeTimeStamps(*robot_traj, config_->main_velocity_scaling_factor_);
+      latency_stats_->record(LatencyStats::PARAMETERIZE,
+                             LatencyStats::now() - parameterize_start_time);
 
       // Convert trajectory back to a message
       robot_traj->getRobotTrajectoryMsg(trajectory_msg);
@@ -429,11 +553,15 @@ bool Manipulation::move(const moveit::core::RobotStatePtr& start,
   bool wait_for_execution = false;
   if (execute_trajectory)  // TODO remove this feature and replace with the unit testing ability?
   {
+    mergeQueuedEEPosture(trajectory_msg);
     if (!execution_interface_->executeTrajectory(trajectory_msg, arm_jmg, wait_for_execution))
     {
       ROS_ERROR_STREAM_NAMED("manipulation", "Failed to execute trajectory");
       return false;
     }
+
+    // Plan the next motion while this one runs
+    startPlanLookahead();
   }
   else
   {
@@ -513,12 +641,14 @@ bool Manipulation::plan(const moveit::core::RobotStatePtr& start,
   planning_interface::MotionPlanRequest request;
   planning_interface::MotionPlanResponse result;
 
-  createPlanningRequest(request, start, goal, arm_jmg, config_->main_velocity_scaling_factor_);
+  const double planned_scaling = getPlanningScaling(config_->main_velocity_scaling_factor_);
+  createPlanningRequest(request, start, goal, arm_jmg, planned_scaling);
 
   // Call pipeline
   std::vector<std::size_t> dummy;
 
   // SOLVE
+  boost::unique_lock<boost::mutex> planning_lock(planning_mutex_);
   loadPlanningPipeline();  // always call before using planning_pipeline_
   planning_scene::PlanningScenePtr cloned_scene;
   {
@@ -527,8 +657,23 @@ bool Manipulation::plan(const moveit::core::RobotStatePtr& start,
     cloned_scene = planning_scene::PlanningScene::clone(scene);
   }  // end scoped pointer of locked planning scene
 
+  const double plan_start_time = LatencyStats::now();
   planning_pipeline_->generatePlan(cloned_scene, request, result, dummy, planning_context_handle_);
 
+  // The planner reports its own solve time, the rest is adapters such as time parameterization
+  const double pipeline_time = LatencyStats::now() - plan_start_time;
+  latency_stats_->record(LatencyStats::PLAN, result.planning_time_);
+  latency_stats_->record(LatencyStats::PARAMETERIZE, pipeline_time - result.planning_time_);
+
+  // Slow down near the shelf and products
+  if (result.error_code_.val == result.error_code_.SUCCESS && result.trajectory_)
+  {
+    const double retime_start_time = LatencyStats::now();
+    retimeByClearance(*result.trajectory_, *cloned_scene, planned_scaling,
+                      config_->main_velocity_scaling_factor_);
+    latency_stats_->record(LatencyStats::PARAMETERIZE, LatencyStats::now() - retime_start_time);
+  }
+
   // Get the trajectory
   moveit_msgs::MotionPlanResponse response;
   response.trajectory = moveit_msgs::RobotTrajectory();
@@ -554,6 +699,7 @@ bool Manipulation::planPostProcessing()
   if (config_->use_experience_setup_)
   {
     ROS_INFO_STREAM_NAMED("manipulation", "Performing planner post-processing");
+    boost::unique_lock<boost::mutex> planning_lock(planning_mutex_);
 
     moveit_ompl::ModelBasedPlanningContextPtr mbpc =
         boost::dynamic_pointer_cast<moveit_ompl::ModelBasedPlanningContext>(
@@ -583,6 +729,87 @@ bool Manipulation::planPostProcessing()
   return true;
 }
 
+void Manipulation::queuePlanLookahead(const moveit::core::RobotStatePtr& start,
+                                      const moveit::core::RobotStatePtr& goal,
+                                      JointModelGroup* arm_jmg)
+{
+  plan_lookahead_queued_ = true;
+  queued_lookahead_start_ = state_pool_->acquire(*start);
+  queued_lookahead_goal_ = state_pool_->acquire(*goal);
+  queued_lookahead_arm_jmg_ = arm_jmg;
+}
+
+void Manipulation::discardPlanLookahead()
+{
+  if (plan_lookahead_thread_.joinable())
+    plan_lookahead_thread_.join();
+  plan_lookahead_success_ = false;
+}
+
+void Manipulation::startPlanLookahead()
+{
+  if (!plan_lookahead_queued_)
+    return;
+  plan_lookahead_queued_ = false;
+
+  discardPlanLookahead();
+  plan_lookahead_start_ = queued_lookahead_start_;
+  plan_lookahead_goal_ = queued_lookahead_goal_;
+  plan_lookahead_arm_jmg_ = queued_lookahead_arm_jmg_;
+  plan_lookahead_thread_ = boost::thread(boost::bind(&Manipulation::computePlanLookahead, this));
+}
+
+void Manipulation::computePlanLookahead()
+{
+  const double start_time = LatencyStats::now();
+  const bool verbose = false;
+  plan_lookahead_success_ =
+      plan(plan_lookahead_start_, plan_lookahead_goal_, plan_lookahead_arm_jmg_,
+           config_->main_velocity_scaling_factor_, verbose, plan_lookahead_trajectory_);
+
+  ROS_INFO_STREAM_NAMED("manipulation.lookahead", "Lookahead planning took "
+                                                      << LatencyStats::now() - start_time
+                                                      << " seconds");
+}
+
+bool Manipulation::takePlanLookahead(const moveit::core::RobotStatePtr& start,
+                                     const moveit::core::RobotStatePtr& goal,
+                                     JointModelGroup* arm_jmg,
+                                     moveit_msgs::RobotTrajectory& trajectory_msg)
+{
+  if (!plan_lookahead_thread_.joinable())
+    return false;
+  plan_lookahead_thread_.join();
+
+  if (!plan_lookahead_success_)
+    return false;
+  plan_lookahead_success_ = false;  // used at most once
+
+  // The previous motion may not have ended where it was expected to
+  if (plan_lookahead_arm_jmg_ != arm_jmg || !statesEqual(*start, *plan_lookahead_start_, arm_jmg) ||
+      !statesEqual(*goal, *plan_lookahead_goal_, arm_jmg))
+  {
+    ROS_INFO_STREAM_NAMED("manipulation.lookahead", "Lookahead plan is for another motion");
+    return false;
+  }
+
+  // Something may have moved into the way while the previous motion executed
+  moveit_msgs::RobotState start_state_msg;
+  moveit::core::robotStateToRobotStateMsg(*start, start_state_msg);
+  {
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor_);
+    if (!scene->isPathValid(start_state_msg, plan_lookahead_trajectory_, arm_jmg->getName()))
+    {
+      ROS_INFO_STREAM_NAMED("manipulation.lookahead", "Lookahead plan is no longer valid");
+      return false;
+    }
+  }
+
+  ROS_INFO_STREAM_NAMED("manipulation.lookahead", "Using plan from lookahead");
+  trajectory_msg = plan_lookahead_trajectory_;
+  return true;
+}
+
 bool Manipulation::printExperienceLogs()
 {
   if (!config_->use_experience_setup_)
@@ -635,8 +862,8 @@ bool Manipulation::interpolate(robot_trajectory::RobotTrajectoryPtr robot_traj,
     for (double t = discretization; t < 1; t += discretization)
     {
       // Create new state
-      moveit::core::RobotStatePtr interpolated_state(
-          new moveit::core::RobotState(robot_traj->getFirstWayPoint()));
+      moveit::core::RobotStatePtr interpolated_state =
+          state_pool_->acquire(robot_traj->getFirstWayPoint());
       // Fill in new values
       robot_traj->getWayPoint(i)
           .interpolate(robot_traj->getWayPoint(i + 1), t, *interpolated_state);
@@ -713,6 +940,8 @@ std::string Manipulation::getActionResultString(const moveit_msgs::MoveItErrorCo
 bool Manipulation::executeState(const moveit::core::RobotStatePtr goal_state, JointModelGroup* jmg,
                                 double velocity_scaling_factor)
 {
+  latency_stats_->setMotionType("direct");
+
   // Get the start state
   getCurrentState();
 
@@ -763,6 +992,8 @@ bool Manipulation::executeState(const moveit::core::RobotStatePtr goal_state, Jo
 bool Manipulation::moveDirectToState(const moveit::core::RobotStatePtr goal_state,
                                      JointModelGroup* jmg, double velocity_scaling_factor)
 {
+  latency_stats_->setMotionType("direct");
+
   // Visualize goal
   visuals_->goal_state_->publishRobotState(goal_state, rvt::ORANGE);
 
@@ -803,6 +1034,8 @@ bool Manipulation::moveDirectToState(const moveit::core::RobotStatePtr goal_stat
 
 bool Manipulation::executeApproachPath(moveit_grasps::GraspCandidatePtr chosen_grasp)
 {
+  latency_stats_->setMotionType("cartesian");
+
   ROS_WARN_STREAM_NAMED("temp", "deprecated");
 
   // Get start pose
@@ -883,6 +1116,9 @@ bool Manipulation::executeSavedCartesianPath(
     const moveit_grasps::GraspTrajectories& segmented_cartesian_traj, JointModelGroup* arm_jmg,
     std::size_t segment_id)
 {
+  latency_stats_->setMotionType("cartesian");
+  QueuedRequestGuard queued_ee_posture_guard(ee_posture_queued_);
+
   // Error check
   if (segment_id >= segmented_cartesian_traj.size())
   {
@@ -909,6 +1145,7 @@ bool Manipulation::executeSavedCartesianPath(
   }
 
   // Execute
+  mergeQueuedEEPosture(trajectory_msg);
   if (!execution_interface_->executeTrajectory(trajectory_msg, arm_jmg))
   {
     ROS_ERROR_STREAM_NAMED("manipulation", "Failed to execute trajectory");
@@ -1009,6 +1246,8 @@ bool Manipulation::executeVerticlePathGantryOnly(JointModelGroup* arm_jmg,
                                                  const double& velocity_scaling_factor, bool up,
                                                  bool ignore_collision, bool best_attempt)
 {
+  latency_stats_->setMotionType("cartesian");
+
   if (!config_->has_gantry_)
   {
     ROS_ERROR_STREAM_NAMED("manipulation", "Attempt to use gantry on robot that does not have one");
@@ -1046,7 +1285,7 @@ bool Manipulation::executeVerticlePathGantryOnly(JointModelGroup* arm_jmg,
   }
 
   // Create new movemenet state
-  moveit::core::RobotStatePtr new_state(new moveit::core::RobotState(*current_state_));
+  moveit::core::RobotStatePtr new_state = state_pool_->acquire(*current_state_);
   new_state->setJointPositions(gantry_joint, new_gantry_positions);
   robot_state_trajectory.push_back(new_state);
 
@@ -1126,103 +1365,23 @@ bool Manipulation::executeInsertionClosedLoop(JointModelGroup* arm_jmg, double d
                                               Eigen::Affine3d& desired_world_to_tool,
                                               bool direction_in, bool& achieved_depth)
 {
-  // Copy pose
-  teleop_world_to_tool_ = desired_world_to_tool;
-
-  // Move in and out
-  Eigen::Vector3d approach_direction;
-  approach_direction << 0, 0, (direction_in ? 1 : -1);
-
-  // the direction can be in the local reference frame (in which case we rotate it)
-  const Eigen::Vector3d rotated_direction = teleop_world_to_tool_.rotation() * approach_direction;
-
-  // The target pose is built by applying a translation to the start pose for the desired direction
-  // and distance
-  // Eigen::Affine3d teleop_world_to_tool__base_frame;
-  std::size_t num_steps = desired_distance * config_->insertion_steps_per_meter_;
-  // don't allow waypoints to be reached before next goal sent
-  static const double SMOOTH_FACTOR = 1.1;
+  InsertionGoal goal;
+  goal.distance_ = desired_distance;
+  goal.direction_in_ = direction_in;
+  goal.num_steps_ = desired_distance * config_->insertion_steps_per_meter_;
+  goal.step_duration_ = config_->insertion_duration_ / double(goal.num_steps_);
 
-  // Pre-calculate values
-  double step_distance = desired_distance / double(num_steps);
-  double step_duration = config_->insertion_duration_ / double(num_steps);
-
-  std::cout << "step_distance: " << step_distance << std::endl;
-  std::cout << "step_duration: " << step_duration << std::endl;
-
-  achieved_depth = true;  // assume it works
-
-  ros::Rate rate_limiter(1 / step_duration);  // specify the hz
-  // Begin soft-real time loop
-  for (std::size_t i = 0; i < num_steps; ++i)
-  {
-    // Check if program needs to end
-    if (!ros::ok())
-      break;
-
-    if (remote_control_->getStop())
-      remote_control_->waitForNextStep("clear stop");
-
-    if (direction_in)
-      std::cout << "insertion,  step " << i << std::endl;
-    else
-      std::cout << "retracting, step " << i << std::endl;
-
-    // Move target pose inward
-    teleop_world_to_tool_.translation() += rotated_direction * step_distance;
-
-    // Track if tactile sensor was used
-    bool corrected = false;
-
-    // Adjust pose based on tactile feedback
-    corrected = adjustPoseFromTactile();
-
-    // Decide when to stop inserting based on negative z-axis sheer force
-    // if (direction_in && adjustPoseAndReject())
-    // {
-    //   std::cout << "Breaking insertion loop because sheer force too high" << std::endl;
-    //   achieved_depth = false;
-    //   remote_control_->waitForNextStep("reverse direction");
-    //   break;
-    // }
-
-    // Visualize the pivot point for pose rotations
-    visuals_->visual_tools_->publishSphere(
-        visuals_->visual_tools_->convertPose(teleop_world_to_tool_), rvt::PURPLE,
-        visuals_->visual_tools_->getScale(rvt::LARGE, false, 0.1), "Sphere", 1);
-
-    // Move pose from tips of finger (tool) back to base of EE
-    teleop_world_to_ee_ = teleop_world_to_tool_ * config_->teleoperation_offset_;
-
-    // Show pose-rotation pose
-    visuals_->trajectory_lines_->publishZArrow(teleop_world_to_ee_, rvt::BLACK, rvt::REGULAR);
-
-    // Convert desired pose from 'world' frame to 'robot base' frame
-    transformWorldToBase(teleop_world_to_ee_, teleop_base_to_ee_);
-
-    if (corrected)
-      remote_control_->waitForNextStep("move");
-
-    // Move robot
-    execution_interface_->executePose(teleop_base_to_ee_, arm_jmg, step_duration * SMOOTH_FACTOR);
-
-    if (corrected)
-    {
-      std::cout << "CORRECTED" << std::endl;
-      ros::Duration(config_->insertion_alter_pause_).sleep();
-      // tactile_feedback_->recalibrateTactileSensor();
-    }
-    else
-    {
-      // Wait for next loop
-      rate_limiter.sleep();
-    }
-  }
-
-  // Copy pose back
-  desired_world_to_tool = teleop_world_to_tool_;
-
-  return true;
+  // Adjust pose based on tactile feedback
+  goal.use_tactile_ = true;
+  goal.torque_min_ = config_->insertion_torque_min_;
+  goal.torque_max_ = config_->insertion_torque_max_;
+  goal.torque_scale_ = config_->insertion_torque_scale_;
+  goal.correction_pause_ = config_->insertion_alter_pause_;
+  setupInsertionGoal(arm_jmg, desired_world_to_tool, goal);
+
+  // Only a cancelled insertion falls short
+  achieved_depth = runInsertion(goal, desired_world_to_tool);
+  return achieved_depth;
 }
 
 bool Manipulation::executeInsertionOpenLoopNew(JointModelGroup* arm_jmg, double desired_distance,
@@ -1230,61 +1389,88 @@ bool Manipulation::executeInsertionOpenLoopNew(JointModelGroup* arm_jmg, double
                                                Eigen::Affine3d& desired_world_to_tool,
                                                bool direction_in, bool& achieved_depth)
 {
-  // Copy pose
-  teleop_world_to_tool_ = desired_world_to_tool;
-
-  // Move in and out
-  Eigen::Vector3d approach_direction;
-  approach_direction << 0, 0, (direction_in ? 1 : -1);
-
-  // the direction can be in the local reference frame (in which case we rotate it)
-  const Eigen::Vector3d rotated_direction = teleop_world_to_tool_.rotation() * approach_direction;
+  InsertionGoal goal;
+  goal.distance_ = desired_distance;
+  goal.direction_in_ = direction_in;
+  goal.num_steps_ = desired_distance * config_->insertion_steps_per_meter_;
+  goal.step_duration_ = duration / double(goal.num_steps_);
+  goal.use_tactile_ = false;
+  setupInsertionGoal(arm_jmg, desired_world_to_tool, goal);
+
+  // Only a cancelled insertion falls short
+  achieved_depth = runInsertion(goal, desired_world_to_tool);
+  return achieved_depth;
+}
 
-  // The target pose is built by applying a translation to the start pose for the desired direction
-  // and distance
-  std::size_t num_steps = desired_distance * config_->insertion_steps_per_meter_;
+void Manipulation::setupInsertionGoal(JointModelGroup* arm_jmg,
+                                      const Eigen::Affine3d& world_to_tool, InsertionGoal& goal)
+{
   // don't allow waypoints to be reached before next goal sent
   static const double SMOOTH_FACTOR = 1.1;
+  goal.command_duration_ = goal.step_duration_ * SMOOTH_FACTOR;
+
+  goal.world_to_tool_ = world_to_tool;
+
+  // Move quickly until the sensor reports contact
+  goal.adaptive_step_ = config_->insertion_adaptive_step_;
+  goal.min_step_ = config_->insertion_step_min_;
+  goal.max_step_ = config_->insertion_step_max_;
+  goal.contact_force_ = config_->insertion_contact_force_;
+  goal.contact_torque_ = config_->insertion_contact_torque_;
+  goal.max_sample_age_ = config_->insertion_max_sample_age_;
+
+  // The robot base does not move during an insertion, so the frame conversions done by
+  // transformWorldToBase() and executePose() can be computed once up front
+  goal.base_to_world_ = getCurrentState()->getGlobalLinkTransform("base_link").inverse();
+  goal.tool_to_command_ =
+      config_->teleoperation_offset_ * grasp_datas_[arm_jmg]->grasp_pose_to_eef_pose_;
+
+  ROS_INFO_STREAM_NAMED("manipulation", "Insertion of " << goal.num_steps_ << " steps, "
+                                                        << goal.distance_ / goal.num_steps_
+                                                        << " m every " << goal.step_duration_
+                                                        << " s");
+}
 
-  // Pre-calculate values
-  double step_distance = desired_distance / double(num_steps);
-  double step_duration = duration / double(num_steps);
-
-  std::cout << "step_distance: " << step_distance << std::endl;
-  std::cout << "step_duration: " << step_duration << std::endl;
+bool Manipulation::runInsertion(const InsertionGoal& goal, Eigen::Affine3d& world_to_tool)
+{
+  latency_stats_->setMotionType("cartesian");
+  const double start_time = LatencyStats::now();
 
-  achieved_depth = true;  // assume it works
+  if (!insertion_controller_->start(goal))
+    return false;
 
-  ros::Rate rate_limiter(1 / step_duration);  // specify the hz
-  // Begin soft-real time loop
-  for (std::size_t i = 0; i < num_steps; ++i)
+  // Only poll the remote stop from here, the control loop itself never blocks
+  static const double STOP_CHECK_PERIOD = 0.05;
+  bool cancelled = false;
+  while (!insertion_controller_->waitForCompletion(STOP_CHECK_PERIOD))
   {
-    // Check if program needs to end
     if (!ros::ok())
-      break;
-
-    if (remote_control_->getStop())
-      remote_control_->waitForNextStep("clear stop");
-
-    if (direction_in)
-      std::cout << "insertion,  step " << i << std::endl;
-    else
-      std::cout << "retracting, step " << i << std::endl;
-
-    // Move target pose inward
-    teleop_world_to_tool_.translation() += rotated_direction * step_distance;
-
-    // Move Robot
-    executeToolPose(arm_jmg, teleop_world_to_tool_, step_duration * SMOOTH_FACTOR);
-
-    // Wait for next loop
-    rate_limiter.sleep();
+    {
+      if (!cancelled)
+        ROS_WARN_STREAM_NAMED("manipulation", "Stopping insertion");
+      insertion_controller_->cancel();
+      cancelled = true;
+    }
+    else if (remote_control_->getStop())
+    {
+      // Hold where the insertion is, then continue with the rest of it
+      ROS_WARN_STREAM_NAMED("manipulation", "Pausing insertion");
+      insertion_controller_->setHold(true);
+      remote_control_->waitForNextStep("clear stop", __FILE__, __LINE__);
+      insertion_controller_->setHold(false);
+    }
   }
+  latency_stats_->record(LatencyStats::MOTION, LatencyStats::now() - start_time);
 
   // Copy pose back
-  desired_world_to_tool = teleop_world_to_tool_;
+  insertion_controller_->getResult(world_to_tool);
+  insertion_controller_->printStats();
 
-  return true;
+  // Visualize where the insertion ended
+  visuals_->trajectory_lines_->publishZArrow(world_to_tool * config_->teleoperation_offset_,
+                                             rvt::BLACK, rvt::REGULAR);
+
+  return !cancelled;
 }
 
 bool Manipulation::executeToolPose(JointModelGroup* arm_jmg, Eigen::Affine3d& pose_world_to_tool,
@@ -1309,9 +1495,11 @@ bool Manipulation::executeToolPose(JointModelGroup* arm_jmg, Eigen::Affine3d& po
 bool Manipulation::executeInsertionOpenLoop(JointModelGroup* arm_jmg, double desired_distance,
                                             bool in, double velocity_scaling_factor)
 {
+  latency_stats_->setMotionType("cartesian");
+
   const moveit::core::LinkModel* ik_tip_link = grasp_datas_[arm_jmg]->parent_link_;
 
-  moveit::core::RobotStatePtr robot_state(new moveit::core::RobotState(*getCurrentState()));
+  moveit::core::RobotStatePtr robot_state = state_pool_->acquire(*getCurrentState());
 
   // Get current pose
   Eigen::Affine3d ee_start_pose =
@@ -1387,6 +1575,8 @@ bool Manipulation::executeCartesianPath(JointModelGroup* arm_jmg, const Eigen::V
                                         double desired_distance, double velocity_scaling_factor,
                                         bool reverse_path, bool ignore_collision)
 {
+  latency_stats_->setMotionType("cartesian");
+
   getCurrentState();
 
   // Debug
@@ -1745,8 +1935,16 @@ bool Manipulation::convertRobotStatesToTrajectory(
     }
   }
 
-  // Perform iterative parabolic smoothing
-  iterative_smoother_.computeTimeStamps(*robot_traj, velocity_scaling_factor);
+  // Perform iterative parabolic smoothing, then slow down near the shelf and products
+  const double parameterize_start_time = LatencyStats::now();
+  const double planned_scaling = getPlanningScaling(velocity_scaling_factor);
+  iterative_smoother_.computeTimeStamps(*robot_traj, planned_scaling);
+  if (config_->isEnabled("adaptive_velocity"))
+  {
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor_);
+    retimeByClearance(*robot_traj, *scene, planned_scaling, velocity_scaling_factor);
+  }
+  latency_stats_->record(LatencyStats::PARAMETERIZE, LatencyStats::now() - parameterize_start_time);
 
   // Convert trajectory to a message
   robot_traj->getRobotTrajectoryMsg(trajectory_msg);
@@ -1754,6 +1952,38 @@ bool Manipulation::convertRobotStatesToTrajectory(
   return true;
 }
 
+double Manipulation::getPlanningScaling(double base_scaling) const
+{
+  if (!config_->isEnabled("adaptive_velocity"))
+    return base_scaling;
+  return clearance_velocity_scaler_->getPlanningScaling(base_scaling);
+}
+
+void Manipulation::retimeByClearance(robot_trajectory::RobotTrajectory& trajectory,
+                                     const planning_scene::PlanningScene& scene,
+                                     double planned_scaling, double base_scaling)
+{
+  if (!config_->isEnabled("adaptive_velocity"))
+    return;
+
+  ClearanceVelocityScaler::Breakdown breakdown;
+  if (!clearance_velocity_scaler_->retime(trajectory, scene, planned_scaling, base_scaling,
+                                          breakdown))
+    return;
+
+  // What the whole motion would have taken at the base scaling
+  const double base_duration = breakdown.original_duration_ * planned_scaling / base_scaling;
+  const double duration =
+      breakdown.near_duration_ + breakdown.between_duration_ + breakdown.free_duration_;
+  ROS_INFO_STREAM_NAMED("manipulation.adaptive_velocity",
+                        "Motion takes " << duration << " s instead of " << base_duration
+                                        << " s: " << breakdown.near_duration_
+                                        << " s near obstacles, " << breakdown.between_duration_
+                                        << " s in between, " << breakdown.free_duration_
+                                        << " s in free space"
+                                        << (breakdown.payload_ ? ", carrying a product" : ""));
+}
+
 bool Manipulation::openEEs(bool open)
 {
   ROS_DEBUG_STREAM_NAMED("manipulation.superdebug", "openEEs()");
@@ -1802,6 +2032,7 @@ bool Manipulation::setEEGraspPosture(trajectory_msgs::JointTrajectory grasp_post
 {
   ROS_DEBUG_STREAM_NAMED("manipulation.end_effector", "Moving to grasp posture:\n"
                                                           << grasp_posture);
+  latency_stats_->setMotionType("end_effector");
 
   // Check status
   if (!config_->isEnabled("end_effector_enabled"))
@@ -1841,8 +2072,9 @@ bool Manipulation::setEEGraspPosture(trajectory_msgs::JointTrajectory grasp_post
   interpolate(ee_trajectory, discretization);
 
   // Perform iterative parabolic smoothing
-  double ee_velocity_scaling_factor = 0.1;
-  iterative_smoother_.computeTimeStamps(*ee_trajectory, ee_velocity_scaling_factor);
+  const double parameterize_start_time = LatencyStats::now();
+  iterative_smoother_.computeTimeStamps(*ee_trajectory, EE_VELOCITY_SCALING_FACTOR);
+  latency_stats_->record(LatencyStats::PARAMETERIZE, LatencyStats::now() - parameterize_start_time);
 
   // Show the change in end effector
   if (verbose_)
@@ -1865,6 +2097,113 @@ bool Manipulation::setEEGraspPosture(trajectory_msgs::JointTrajectory grasp_post
   return true;
 }
 
+void Manipulation::queueEEGraspPosture(const trajectory_msgs::JointTrajectory& grasp_posture,
+                                       JointModelGroup* arm_jmg, double window)
+{
+  ee_posture_queued_ = window > 0 && !grasp_posture.points.empty();
+  queued_ee_posture_ = grasp_posture;
+  queued_ee_arm_jmg_ = arm_jmg;
+  queued_ee_window_ = window;
+}
+
+bool Manipulation::mergeQueuedEEPosture(moveit_msgs::RobotTrajectory& trajectory_msg)
+{
+  if (!ee_posture_queued_)
+    return false;
+  ee_posture_queued_ = false;
+
+  if (!config_->isEnabled("end_effector_enabled"))
+    return false;
+
+  const trajectory_msgs::JointTrajectory& trajectory = trajectory_msg.joint_trajectory;
+  if (trajectory.points.size() < 2)
+    return false;
+
+  // The fingers start from wherever they are now and take as long as a separate command would
+  const trajectory_msgs::JointTrajectoryPoint& goal = queued_ee_posture_.points.back();
+  const std::vector<std::string>& names = queued_ee_posture_.joint_names;
+  if (goal.positions.size() != names.size())
+    return false;
+  getCurrentState();
+  std::vector<double> start_positions(names.size());
+  double ee_duration = 0;
+  for (std::size_t i = 0; i < names.size(); ++i)
+  {
+    if (!robot_model_->hasJointModel(names[i]) ||
+        std::find(trajectory.joint_names.begin(), trajectory.joint_names.end(), names[i]) !=
+            trajectory.joint_names.end())
+      return false;
+
+    start_positions[i] = current_state_->getVariablePosition(names[i]);
+    const moveit::core::VariableBounds& bounds = robot_model_->getVariableBounds(names[i]);
+    if (bounds.velocity_bounded_ && bounds.max_velocity_ > 0)
+      ee_duration =
+          std::max(ee_duration, fabs(goal.positions[i] - start_positions[i]) /
+                                    (bounds.max_velocity_ * EE_VELOCITY_SCALING_FACTOR));
+  }
+
+  // Start as late as possible, but no earlier than the window allows
+  const double arm_duration = trajectory.points.back().time_from_start.toSec();
+  if (ee_duration > std::min(queued_ee_window_, arm_duration))
+  {
+    ROS_INFO_STREAM_NAMED("manipulation.end_effector",
+                          "End effector needs " << ee_duration << " seconds, too long to overlap "
+                                                << "the last " << queued_ee_window_ << " of "
+                                                << arm_duration << " seconds of arm motion");
+    return false;
+  }
+  const double ee_start = arm_duration - ee_duration;
+
+  // Smoothstep from start to goal so velocity is zero at both ends
+  moveit_msgs::RobotTrajectory merged_msg = trajectory_msg;
+  trajectory_msgs::JointTrajectory& merged = merged_msg.joint_trajectory;
+  merged.joint_names.insert(merged.joint_names.end(), names.begin(), names.end());
+  for (std::size_t p = 0; p < merged.points.size(); ++p)
+  {
+    trajectory_msgs::JointTrajectoryPoint& point = merged.points[p];
+    const double t = point.time_from_start.toSec() - ee_start;
+    const bool moving = ee_duration > 0 && t > 0 && t < ee_duration;
+    const double u = ee_duration > 0 ? std::min(std::max(t / ee_duration, 0.0), 1.0) : 1.0;
+    const double s = u * u * (3.0 - 2.0 * u);
+    const double ds = moving ? 6.0 * u * (1.0 - u) / ee_duration : 0.0;
+    const double dds = moving ? (6.0 - 12.0 * u) / (ee_duration * ee_duration) : 0.0;
+
+    for (std::size_t i = 0; i < names.size(); ++i)
+    {
+      const double delta = goal.positions[i] - start_positions[i];
+      point.positions.push_back(start_positions[i] + s * delta);
+      if (!point.velocities.empty())
+        point.velocities.push_back(ds * delta);
+      if (!point.accelerations.empty())
+        point.accelerations.push_back(dds * delta);
+    }
+  }
+
+  // The arm was planned and checked with the fingers where they are now, so check the combined
+  // motion too. If it collides the fingers are moved separately once the arm arrives
+  moveit_msgs::RobotState start_state_msg;
+  moveit::core::robotStateToRobotStateMsg(*current_state_, start_state_msg);
+  bool valid;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor_);
+    valid = scene->isPathValid(start_state_msg, merged_msg);
+  }
+  if (!valid)
+  {
+    ROS_WARN_STREAM_NAMED("manipulation.end_effector", "Moving the end effector during the arm "
+                                                       "motion would collide, moving it after");
+    return false;
+  }
+  trajectory_msg = merged_msg;
+
+  ee_overlap_saved_ += ee_duration;
+  ROS_INFO_STREAM_NAMED("manipulation.end_effector", "Moving end effector "
+                                                        << queued_ee_arm_jmg_->getName()
+                                                        << " during the last " << ee_duration
+                                                        << " seconds of arm motion");
+  return true;
+}
+
 // bool Manipulation::setStateWithOpenEE(bool open, moveit::core::RobotStatePtr robot_state)
 // {
 //   ROS_DEBUG_STREAM_NAMED("manipulation.superdebug","setStateWithOpenEE()");
@@ -2300,6 +2639,23 @@ moveit::core::RobotStatePtr Manipulation::getCurrentState()
 bool Manipulation::waitForRobotToStop(const double& timeout)
 {
   ROS_INFO_STREAM_NAMED("manipulation", "Waiting for robot to stop moving");
+
+  // Woken by the joint state callback as soon as the robot is at rest
+  SettleDetectorPtr settle_detector = execution_interface_->getSettleDetector();
+  if (settle_detector)
+  {
+    double time_to_settle;
+    if (!settle_detector->waitForSettle(timeout, time_to_settle))
+    {
+      ROS_WARN_STREAM_NAMED("manipulation", "Timed out while waiting for robot to stop");
+      return false;
+    }
+    ROS_DEBUG_STREAM_NAMED("manipulation", "Robot settled after " << time_to_settle << " seconds");
+    latency_stats_->record(LatencyStats::SETTLE, time_to_settle);
+    return true;
+  }
+
+  // Without a state monitor, poll
   ros::Time when_to_stop = ros::Time::now() + ros::Duration(timeout);
 
   static const double UPDATE_RATE = 0.1;  // how often to check if robot is stopped
@@ -2309,22 +2665,22 @@ bool Manipulation::waitForRobotToStop(const double& timeout)
   std::size_t stability_passes = 0;
   double error;
   // Get the current position
-  moveit::core::RobotState previous_position = *getCurrentState();  // copy the memory
-  moveit::core::RobotState current_position = previous_position;    // copy the memory
+  moveit::core::RobotStatePtr previous_position = state_pool_->acquire(*getCurrentState());
+  moveit::core::RobotStatePtr current_position = state_pool_->acquire(*previous_position);
 
   while (ros::ok())
   {
     ros::Duration(UPDATE_RATE).sleep();
     ros::spinOnce();
 
-    current_position = *getCurrentState();  // copy the memory
+    *current_position = *getCurrentState();  // copy the memory
 
     // Check if all positions are near zero
     bool stopped = true;
-    for (std::size_t i = 0; i < current_position.getVariableCount(); ++i)
+    for (std::size_t i = 0; i < current_position->getVariableCount(); ++i)
     {
-      error = fabs(previous_position.getVariablePositions()[i] -
-                   current_position.getVariablePositions()[i]);
+      error = fabs(previous_position->getVariablePositions()[i] -
+                   current_position->getVariablePositions()[i]);
 
       if (error > POSITION_ERROR_THRESHOLD)
       {
@@ -2354,13 +2710,46 @@ bool Manipulation::waitForRobotToStop(const double& timeout)
       return false;
     }
 
-    // Copy newest positions
-    previous_position = current_position;  // copy the memory
+    // Newest positions become previous, no copy needed
+    previous_position.swap(current_position);
   }
 
   return false;
 }
 
+bool Manipulation::waitForGrasp(double max_wait)
+{
+  GraspSettleDetectorPtr grasp_settle_detector = execution_interface_->getGraspSettleDetector();
+  if (!grasp_settle_detector)
+  {
+    ros::Duration(max_wait).sleep();
+    return false;
+  }
+
+  GraspSettleDetector::SettleCheck tactile_check;
+  if (tactile_feedback_)
+    tactile_check = boost::bind(&TactileFeedback::isSheerForceSteady, tactile_feedback_, _1,
+                                grasp_settle_detector->getWindow(),
+                                config_->grasp_settle_tactile_threshold_);
+
+  double time_to_settle;
+  const bool settled = grasp_settle_detector->waitForGrasp(max_wait, tactile_check, time_to_settle);
+  latency_stats_->record("grasp", LatencyStats::SETTLE, time_to_settle);
+
+  grasp_wait_saved_ += max_wait - time_to_settle;
+  grasp_waits_++;
+  if (settled)
+    ROS_INFO_STREAM_NAMED("manipulation", "Grip settled after "
+                                              << time_to_settle << " of " << max_wait
+                                              << " seconds, " << grasp_wait_saved_
+                                              << " seconds saved over " << grasp_waits_
+                                              << " waits");
+  else
+    ROS_WARN_STREAM_NAMED("manipulation", "Grip did not settle within " << max_wait << " seconds");
+
+  return settled;
+}
+
 bool Manipulation::fixCurrentCollisionAndBounds(JointModelGroup* arm_jmg)
 {
   // ROS_INFO_STREAM_NAMED("manipulation","Checking current collision and bounds");
@@ -2408,7 +2797,7 @@ bool Manipulation::fixCurrentCollisionAndBounds(JointModelGroup* arm_jmg)
     ROS_WARN_STREAM_NAMED("manipulation", "State does not satisfy bounds, attempting to fix...");
     std::cout << "-------------------------------------------------------" << std::endl;
 
-    moveit::core::RobotStatePtr new_state(new moveit::core::RobotState(*current_state_));
+    moveit::core::RobotStatePtr new_state = state_pool_->acquire(*current_state_);
 
     if (!fix_state_bounds_.fixBounds(*new_state, arm_jmg))
     {
@@ -2674,43 +3063,26 @@ bool Manipulation::adjustPoseFromTactile()
     // rotate based on torque
     bool verbose_torque = true;
 
-    // Max threhold, absolute
     // Notes: getSheerTorque() will generally return values between -360 -> 0 -> 360 but can exceed
     // those values also. 0 is the calibrated position, i.e. no toruqe
-    double torque = std::min(tactile_feedback_->getSheerTorque(), config_->insertion_torque_max_);
-    torque = std::max(tactile_feedback_->getSheerTorque(), -config_->insertion_torque_max_);
-
-    // Debug
-    if (verbose_torque && false)
-    {
-      std::cout << "raw torque: " << tactile_feedback_->getSheerTorque() << std::endl;
-      std::cout << "capped torque: " << torque << std::endl;
-    }
-
-    // Min threshold, absolute
-    if (fabs(torque) < config_->insertion_torque_min_)
+    // Shared with tactile_replay_node so gains can be tuned offline
+    const double raw_torque = tactile_feedback_->getSheerTorque();
+    double torque;
+    if (!TactileFeedback::computeInsertionRotation(raw_torque, config_->insertion_torque_min_,
+                                                   config_->insertion_torque_max_,
+                                                   config_->insertion_torque_scale_, torque))
     {
       const bool show = false;
-      showDirectionArrow(torque, show);
+      showDirectionArrow(raw_torque, show);
 
       if (verbose_torque && false)
-        std::cout << "Ignoring torque because below threshold: " << torque << std::endl;
+        std::cout << "Ignoring torque because below threshold: " << raw_torque << std::endl;
       return false;
     }
 
-    // Remove bottom of torque so that there are no jumps after the min
-    if (torque > 0)
-      torque -= config_->insertion_torque_min_;
-    else
-      torque += config_->insertion_torque_min_;
-
-    if (verbose_torque)
-      std::cout << "  Pre-scaled torque: " << torque << std::endl;
-
-    // Scale torque rotation to output rotation
-    torque *= config_->insertion_torque_scale_;
     if (verbose_torque)
-      std::cout << "  Scaled (reduced) torque: " << torque << std::endl;
+      std::cout << "  Raw torque: " << raw_torque << " scaled (reduced) torque: " << torque
+                << std::endl;
 
     // Show pre-rotation pose
     // visuals_->trajectory_lines_->publishZArrow(
@@ -2800,7 +3172,7 @@ void Manipulation::updateTouchControl(JointModelGroup* arm_jmg)
   Eigen::Affine3d base_to_world = getCurrentState()->getGlobalLinkTransform("base_link").inverse();
   teleop_base_to_ee_ = base_to_world * teleop_world_to_ee_;
 
-  remote_control_->waitForNextStep("move");
+  remote_control_->waitForNextStep("move", __FILE__, __LINE__);
 
   // Move robot
   execution_interface_->executePose(teleop_base_to_ee_, arm_jmg);
@@ -2815,10 +3187,13 @@ bool Manipulation::teleoperation(const Eigen::Affine3d& ee_pose, bool move,
   // NOTE this is in a separate thread, so we should only use visuals_->trajectory_lines_ for
   // debugging!
 
-  // Solve IK
+  // Solve IK seeded with the previous solution, which is close by while the marker is dragged. A
+  // failed solve can leave its state at a random seed, so the result is only kept on success
+  *teleop_ik_state_ = *teleop_state_;
   bool use_consistency_limits = true;
-  if (!getRobotStateFromPose(ee_pose, teleop_state_, arm_jmg, use_consistency_limits))
+  if (!getRobotStateFromPose(ee_pose, teleop_ik_state_, arm_jmg, use_consistency_limits))
     return false;
+  teleop_state_.swap(teleop_ik_state_);
 
   // Execute robot pose
   if (move)
@@ -2842,6 +3217,7 @@ bool Manipulation::teleoperation(const Eigen::Affine3d& ee_pose, bool move,
 bool Manipulation::enableTeleoperation()
 {
   teleop_state_.reset(new moveit::core::RobotState(*getCurrentState()));
+  teleop_ik_state_.reset(new moveit::core::RobotState(*teleop_state_));
   return true;
 }
 
@@ -68,6 +68,16 @@ bool ManipulationData::load(robot_model::RobotModelPtr robot_model, bool fake_ex
                                           retreat_velocity_scaling_factor_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "calibration_velocity_scaling_factor",
                                           calibration_velocity_scaling_factor_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "free_space_velocity_scaling_factor",
+                                          free_space_velocity_scaling_factor_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "payload_velocity_scaling_factor",
+                                          payload_velocity_scaling_factor_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "clearance_near_distance",
+                                          clearance_near_distance_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "clearance_far_distance",
+                                          clearance_far_distance_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "clearance_check_stride",
+                                       clearance_check_stride_);
 
   if (fake_execution_)
   {
@@ -77,6 +87,7 @@ bool ManipulationData::load(robot_model::RobotModelPtr robot_model, bool fake_ex
     lift_velocity_scaling_factor_ = 1.0;
     retreat_velocity_scaling_factor_ = 1.0;
     calibration_velocity_scaling_factor_ = 1.0;
+    free_space_velocity_scaling_factor_ = 1.0;
   }
 
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "wait_before_grasp",
@@ -173,6 +184,22 @@ bool ManipulationData::load(robot_model::RobotModelPtr robot_model, bool fake_ex
                                           insertion_attempt_distance_scale_);
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_spiral_distance",
                                           insertion_spiral_distance_);
+  ros_param_utilities::getBoolParameter(parent_name, nh_, "insertion_adaptive_step",
+                                        insertion_adaptive_step_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_step_min",
+                                          insertion_step_min_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_step_max",
+                                          insertion_step_max_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_contact_force",
+                                          insertion_contact_force_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_contact_torque",
+                                          insertion_contact_torque_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "insertion_max_sample_age",
+                                          insertion_max_sample_age_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "insertion_thread_priority",
+                                       insertion_thread_priority_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "insertion_thread_cpu",
+                                       insertion_thread_cpu_);
 
   // Automated insertion test
   ros_param_utilities::getDoubleParameter(parent_name, nh_, "automated_insertion_distance",
@@ -186,6 +213,87 @@ bool ManipulationData::load(robot_model::RobotModelPtr robot_model, bool fake_ex
   ros_param_utilities::getStringParameter(parent_name, nh_, "joint_state_topic",
                                           joint_state_topic_);
 
+  // Trajectory recording
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "joint_state_record_threshold",
+                                          joint_state_record_threshold_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "joint_state_record_max_interval",
+                                          joint_state_record_max_interval_);
+
+  // Settle detection
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "settle_position_threshold",
+                                          settle_position_threshold_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "settle_velocity_threshold",
+                                          settle_velocity_threshold_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "settle_window", settle_window_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "grasp_settle_position_threshold",
+                                          grasp_settle_position_threshold_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "grasp_settle_effort_threshold",
+                                          grasp_settle_effort_threshold_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "grasp_settle_tactile_threshold",
+                                          grasp_settle_tactile_threshold_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "grasp_settle_window",
+                                          grasp_settle_window_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "ee_open_overlap", ee_open_overlap_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "ee_close_overlap", ee_close_overlap_);
+
+  // Cartesian command streaming
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "cartesian_command_rate",
+                                          cartesian_command_rate_);
+
+  // Health monitoring
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "health_check_rate",
+                                          health_check_rate_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "joint_state_timeout",
+                                          joint_state_timeout_);
+
+  // Grasp memory
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "grasp_memory_position_tolerance",
+                                          grasp_memory_position_tolerance_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "grasp_memory_angle_tolerance",
+                                          grasp_memory_angle_tolerance_);
+
+  // Order scheduling
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "order_time_limit", order_time_limit_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "order_default_duration",
+                                          order_default_duration_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "order_mistake_probability",
+                                          order_mistake_probability_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "order_max_attempts",
+                                       order_max_attempts_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "order_time_budget", order_time_budget_);
+
+  // Interactive marker teleoperation
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "teleop_rate", teleop_rate_);
+  if (teleop_rate_ <= 0)
+  {
+    ROS_ERROR_STREAM_NAMED("manipulation_data", "teleop_rate must be positive, got "
+                                                    << teleop_rate_);
+    return false;
+  }
+  ros_param_utilities::getBoolParameter(parent_name, nh_, "teleop_use_ik", teleop_use_ik_);
+
+  // Tactile feedback
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_visualization_rate",
+                                          tactile_visualization_rate_);
+  ros_param_utilities::getBoolParameter(parent_name, nh_, "tactile_record", tactile_record_);
+  ros_param_utilities::getStringParameter(parent_name, nh_, "tactile_filter/type",
+                                          tactile_filter_type_);
+  ros_param_utilities::getIntParameter(parent_name, nh_, "tactile_filter/median_window",
+                                       tactile_filter_median_window_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_filter/ema_alpha",
+                                          tactile_filter_ema_alpha_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_filter/one_euro_min_cutoff",
+                                          tactile_filter_one_euro_min_cutoff_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_filter/one_euro_beta",
+                                          tactile_filter_one_euro_beta_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_filter/one_euro_d_cutoff",
+                                          tactile_filter_one_euro_d_cutoff_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_, "tactile_filter/kalman_process_noise",
+                                          tactile_filter_kalman_process_noise_);
+  ros_param_utilities::getDoubleParameter(parent_name, nh_,
+                                          "tactile_filter/kalman_measurement_noise",
+                                          tactile_filter_kalman_measurement_noise_);
+
   // Load proper groups
   // TODO - check if joint model group exists
   if (dual_arm_)
@@ -0,0 +1,249 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Run a work order file through the order scheduler without a robot, to check the
+           schedule, the retry settings and grasp memory. Each try takes a random duration around
+           order_default_duration, on a simulated clock so a whole run finishes at once. With
+           ~runs above 1 the same orders are run again, keeping what grasp memory learned.
+           Scheduler and grasp memory settings must be loaded from the picknik config, there are
+           no defaults
+*/
+
+// PickNik
+#include <picknik_main/order_runner.h>
+#include <picknik_main/grasp_memory.h>
+#include <picknik_main/json/json.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+// Boost
+#include <boost/bind.hpp>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+
+namespace picknik_main
+{
+/**
+ * \brief Stands in for the pick pipeline. Every product has the same number of candidate grasps,
+ *        rotations about the product's z axis in the order generated, each with its own success
+ *        probability drawn around the product's grasp probability. Candidates are ordered by grasp
+ *        memory, and an other grasp retry skips the ones that failed on earlier tries of the
+ *        order, as graspObjectPipeline does
+ */
+class SimulatedPicker
+{
+public:
+  SimulatedPicker(GraspMemoryPtr grasp_memory, bool use_grasp_memory, std::size_t num_grasps,
+                  double min_duration, double max_duration, int seed)
+    : grasp_memory_(grasp_memory)
+    , use_grasp_memory_(use_grasp_memory)
+    , generator_(seed)
+    , chance_(0.0, 1.0)
+    , duration_(min_duration, max_duration)
+    , sim_time_(0)
+  {
+    for (std::size_t i = 0; i < num_grasps; ++i)
+      product_to_grasps_.push_back(Eigen::Affine3d(
+          Eigen::AngleAxisd(2.0 * M_PI * i / num_grasps, Eigen::Vector3d::UnitZ())));
+  }
+
+  /** \brief Start a run of the orders in scheduler, which is given the simulated clock */
+  void reset(OrderSchedulerPtr scheduler)
+  {
+    scheduler_ = scheduler;
+    scheduler_->setClock(boost::bind(&SimulatedPicker::now, this));
+    failed_grasps_.clear();
+    sim_time_ = 0;
+  }
+
+  double now() const { return sim_time_; }
+
+  bool attempt(std::size_t order_id, OrderStrategy strategy)
+  {
+    const std::string& product = scheduler_->getProduct(order_id);
+    const std::vector<double>& grasp_probabilities = getGraspProbabilities(order_id);
+
+    std::vector<std::size_t> order;
+    std::size_t proven = 0;
+    if (use_grasp_memory_)
+      proven = grasp_memory_->orderGrasps(product, product_to_grasps_, order);
+    else
+      for (std::size_t i = 0; i < product_to_grasps_.size(); ++i)
+        order.push_back(i);
+
+    // First candidate that has not failed on this order, unless they all have
+    std::vector<std::size_t>& failed = failed_grasps_[order_id];
+    std::size_t grasp = order.front();
+    if (strategy == ORDER_STRATEGY_OTHER_GRASP)
+      for (std::size_t i = 0; i < order.size(); ++i)
+        if (std::find(failed.begin(), failed.end(), order[i]) == failed.end())
+        {
+          grasp = order[i];
+          break;
+        }
+
+    const bool success = chance_(generator_) < grasp_probabilities[grasp];
+    const double seconds = duration_(generator_);
+    sim_time_ += seconds;
+    if (!success)
+      failed.push_back(grasp);
+    grasp_memory_->recordResult(product, product_to_grasps_[grasp], success);
+
+    ROS_INFO_STREAM_NAMED("order_dry_run", "Order " << order_id << " with strategy "
+                                                    << OrderScheduler::getStrategyName(strategy)
+                                                    << " tried grasp " << grasp << " of " << product
+                                                    << " (" << proven << " proven) and "
+                                                    << (success ? "succeeded" : "failed")
+                                                    << " after " << seconds << " s");
+    return success;
+  }
+
+private:
+  /** \brief Success probability of each candidate grasp, the same for every run */
+  const std::vector<double>& getGraspProbabilities(std::size_t order_id)
+  {
+    std::vector<double>& grasp_probabilities =
+        grasp_probabilities_[scheduler_->getProduct(order_id)];
+    if (grasp_probabilities.empty())
+    {
+      // Spread evenly up to twice the product's probability
+      const double p_grasping_correctly = scheduler_->getGraspProbability(order_id);
+      for (std::size_t i = 0; i < product_to_grasps_.size(); ++i)
+        grasp_probabilities.push_back(
+            std::min(1.0, 2.0 * p_grasping_correctly * chance_(generator_)));
+    }
+    return grasp_probabilities;
+  }
+
+  OrderSchedulerPtr scheduler_;
+  GraspMemoryPtr grasp_memory_;
+  bool use_grasp_memory_;
+
+  EigenSTL::vector_Affine3d product_to_grasps_;
+  std::map<std::string, std::vector<double> > grasp_probabilities_;
+  std::map<std::size_t, std::vector<std::size_t> > failed_grasps_;  // by order, this run
+
+  std::mt19937 generator_;
+  std::uniform_real_distribution<double> chance_;
+  std::uniform_real_distribution<double> duration_;
+  double sim_time_;
+};
+
+}  // end namespace
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "order_dry_run");
+  ros::NodeHandle nh("~");
+
+  using namespace picknik_main;
+
+  std::string file_path, item_data_path;
+  int seed, runs, num_grasps;
+  double duration_spread;
+  nh.param("file", file_path, std::string());
+  nh.param("item_data", item_data_path, std::string());
+  nh.param("seed", seed, 0);
+  // Tries take between 1 - spread and 1 + spread times order_default_duration
+  nh.param("duration_spread", duration_spread, 0.5);
+  nh.param("runs", runs, 1);
+  nh.param("grasps", num_grasps, 8);
+  if (runs < 1 || num_grasps < 1)
+  {
+    ROS_ERROR_STREAM_NAMED("order_dry_run", "~runs and ~grasps must be at least 1");
+    return 1;
+  }
+
+  // Same layout as read by AmazonJSONParser
+  std::ifstream input_stream(file_path.c_str());
+  Json::Value root;
+  Json::Reader reader;
+  if (!input_stream.good() || !reader.parse(input_stream, root))
+  {
+    ROS_ERROR_STREAM_NAMED("order_dry_run", "Set ~file to a work order json file, unable to "
+                                            "parse '" << file_path << "'");
+    return 1;
+  }
+  const Json::Value bin_contents = root["bin_contents"];
+  const Json::Value work_orders = root["work_order"];
+  if (!bin_contents.isObject() || !work_orders.isArray())
+  {
+    ROS_ERROR_STREAM_NAMED("order_dry_run", "Missing 'bin_contents' or 'work_order' in "
+                                                << file_path);
+    return 1;
+  }
+
+  // Load the same settings the robot uses, from the picknik config loaded into this namespace
+  const std::string parent_name = "order_dry_run";
+  double time_limit, default_duration, mistake_probability, time_budget;
+  double grasp_position_tolerance, grasp_angle_tolerance;
+  int max_attempts;
+  bool dual_arm, use_grasp_memory;
+  if (!ros_param_utilities::getDoubleParameter(parent_name, nh, "order_time_limit", time_limit) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "order_default_duration",
+                                               default_duration) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "order_mistake_probability",
+                                               mistake_probability) ||
+      !ros_param_utilities::getIntParameter(parent_name, nh, "order_max_attempts", max_attempts) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "order_time_budget",
+                                               time_budget) ||
+      !ros_param_utilities::getBoolParameter(parent_name, nh, "dual_arm", dual_arm) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "grasp_memory_position_tolerance",
+                                               grasp_position_tolerance) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "grasp_memory_angle_tolerance",
+                                               grasp_angle_tolerance) ||
+      !ros_param_utilities::getBoolParameter(parent_name, nh, "behavior/grasp_memory",
+                                             use_grasp_memory))
+  {
+    ROS_ERROR_STREAM_NAMED("order_dry_run", "Missing parameters, load the picknik config into "
+                                            "this node's namespace");
+    return 1;
+  }
+
+  // Kept over all runs, not saved
+  GraspMemoryPtr grasp_memory(new GraspMemory(grasp_position_tolerance, grasp_angle_tolerance));
+  SimulatedPicker picker(grasp_memory, use_grasp_memory, num_grasps,
+                         std::max(0.0, 1.0 - duration_spread) * default_duration,
+                         (1.0 + duration_spread) * default_duration, seed);
+
+  for (int run = 0; run < runs && ros::ok(); ++run)
+  {
+    ROS_INFO_STREAM_NAMED("order_dry_run", "Run " << run + 1 << " of " << runs);
+
+    OrderSchedulerPtr scheduler(new OrderScheduler(time_limit, default_duration,
+                                                   mistake_probability, max_attempts, time_budget));
+    scheduler->setDualArm(dual_arm);
+    scheduler->loadItemData(item_data_path);
+    for (std::size_t work_id = 0; work_id < work_orders.size(); ++work_id)
+    {
+      const Json::Value& work_order = work_orders[int(work_id)];
+      const std::string bin_name = work_order["bin"].asString();
+      scheduler->addOrder(work_order["item"].asString(), bin_name, bin_contents[bin_name].size());
+    }
+    picker.reset(scheduler);
+
+    OrderRunner runner(scheduler, boost::bind(&SimulatedPicker::attempt, &picker, _1, _2));
+    runner.run(false);
+
+    ROS_INFO_STREAM_NAMED("order_dry_run", "Ran " << work_orders.size() << " orders from "
+                                                  << file_path << " in " << picker.now()
+                                                  << " simulated s of " << time_limit);
+  }
+
+  grasp_memory->printStats();
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Run work orders in the order the OrderScheduler chooses, on the robot or in a dry run
+*/
+
+// PickNik
+#include <picknik_main/order_runner.h>
+
+// ROS
+#include <ros/ros.h>
+
+namespace picknik_main
+{
+OrderRunner::OrderRunner(OrderSchedulerPtr scheduler, const AttemptCallback& attempt_callback,
+                         const ReadyCallback& ready_callback,
+                         const ResultCallback& result_callback)
+  : scheduler_(scheduler)
+  , attempt_callback_(attempt_callback)
+  , ready_callback_(ready_callback)
+  , result_callback_(result_callback)
+  , attempts_(0)
+  , retries_(0)
+{
+}
+
+bool OrderRunner::run(bool stop_on_failure)
+{
+  attempts_ = 0;
+  retries_ = 0;
+  scheduler_->start();
+
+  std::size_t order_id;
+  while (scheduler_->getNextOrder(order_id))
+  {
+    if (!ros::ok())
+      return false;
+
+    const std::size_t order_attempts = scheduler_->getAttempts(order_id);
+    ROS_INFO_STREAM_NAMED("order_runner", "Starting order "
+                                              << order_id << " attempt " << order_attempts + 1
+                                              << " (expected "
+                                              << scheduler_->getExpectedPoints(order_id)
+                                              << " points, " << scheduler_->getRemainingTime()
+                                              << " s left)");
+
+    // Check every order if the system is still ready
+    if (ready_callback_ && !ready_callback_())
+    {
+      ROS_ERROR_STREAM_NAMED("order_runner", "System not ready, stopping");
+      scheduler_->printSummary();
+      return false;
+    }
+
+    attempts_++;
+    if (order_attempts)
+      retries_++;
+
+    // The scheduler's clock may be simulated, so time the try on it
+    const double remaining_time = scheduler_->getRemainingTime();
+    const bool success = attempt_callback_(order_id, scheduler_->getStrategy(order_id));
+    const bool requeued = scheduler_->reportResult(order_id, success,
+                                                   remaining_time - scheduler_->getRemainingTime());
+
+    if (result_callback_)
+      result_callback_(order_id, success, requeued);
+
+    if (!success && stop_on_failure)
+    {
+      ROS_ERROR_STREAM_NAMED("order_runner", "Order " << order_id << " failed, shutting down for "
+                                                      "debug purposes only (it could continue on)");
+      scheduler_->printSummary();
+      return false;
+    }
+  }
+
+  // Show what was run and what was skipped
+  scheduler_->printSummary();
+  ROS_INFO_STREAM_NAMED("order_runner", "Made " << attempts_ << " attempts, " << retries_
+                                                << " of them retries");
+  return true;
+}
+
+}  // end namespace
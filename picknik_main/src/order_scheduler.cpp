@@ -0,0 +1,384 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Choose which work order to run next so that the expected score within the time limit of
+           a run is as high as possible
+*/
+
+// PickNik
+#include <picknik_main/order_scheduler.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace picknik_main
+{
+namespace
+{
+// Used for products missing from the item data
+const double DEFAULT_P_GRASPING_CORRECTLY = 0.5;
+
+// Points lost for each product knocked out of a bin, from the competition rules
+const double MISTAKE_POINTS = 12.0;
+
+// Planning resolution in seconds
+const double PLAN_RESOLUTION = 1.0;
+
+double getWallTime() { return ros::WallTime::now().toSec(); }
+}  // end anonymous namespace
+
+OrderScheduler::OrderScheduler(double time_limit, double default_duration,
+                               double mistake_probability, std::size_t max_attempts,
+                               double order_time_budget)
+  : time_limit_(time_limit)
+  , default_duration_(default_duration)
+  , mistake_probability_(mistake_probability)
+  , max_attempts_(std::max<std::size_t>(1, max_attempts))
+  , order_time_budget_(order_time_budget)
+  , dual_arm_(true)
+  , clock_(&getWallTime)
+  , start_time_(clock_())
+  , total_duration_(0)
+  , finished_(0)
+{
+}
+
+bool OrderScheduler::loadItemData(const std::string& file_path)
+{
+  std::ifstream input(file_path.c_str());
+  if (!input.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("order_scheduler", "Unable to open item data " << file_path);
+    return false;
+  }
+
+  // Columns: name,p_grasping_correctly,extra_points, with a header row
+  std::string line;
+  std::getline(input, line);
+  while (std::getline(input, line))
+  {
+    std::istringstream line_stream(line);
+    std::string name, p_grasping, extra_points;
+    if (!std::getline(line_stream, name, ',') || !std::getline(line_stream, p_grasping, ',') ||
+        !std::getline(line_stream, extra_points, ','))
+      continue;
+
+    ItemData& data = item_data_[name];
+    data.p_grasping_correctly_ = atof(p_grasping.c_str());
+    data.extra_points_ = atof(extra_points.c_str());
+  }
+
+  ROS_INFO_STREAM_NAMED("order_scheduler", "Loaded item data for " << item_data_.size()
+                                                                   << " products");
+  return true;
+}
+
+std::size_t OrderScheduler::addOrder(const std::string& product, const std::string& bin,
+                                     std::size_t bin_count)
+{
+  double p_grasping_correctly = DEFAULT_P_GRASPING_CORRECTLY;
+  double extra_points = 0;
+  std::map<std::string, ItemData>::const_iterator item_it = item_data_.find(product);
+  if (item_it != item_data_.end())
+  {
+    p_grasping_correctly = item_it->second.p_grasping_correctly_;
+    extra_points = item_it->second.extra_points_;
+  }
+  else
+    ROS_WARN_STREAM_NAMED("order_scheduler", "No item data for " << product);
+
+  Order order;
+  order.product_ = product;
+  order.bin_ = bin;
+  order.bin_count_ = bin_count;
+  order.p_grasping_correctly_ = p_grasping_correctly;
+  order.extra_points_ = extra_points;
+  // Extra points are only awarded along with the grasp
+  order.expected_points_ = p_grasping_correctly * (getBinPoints(bin_count) + extra_points);
+  // Reaching into a shared bin risks disturbing the other products
+  if (bin_count > 1)
+    order.expected_points_ -= mistake_probability_ * MISTAKE_POINTS * (bin_count - 1);
+  order.status_ = PENDING;
+  order.duration_ = 0;
+  order.attempts_ = 0;
+  order.strategy_ = ORDER_STRATEGY_DEFAULT;
+
+  orders_.push_back(order);
+  return orders_.size() - 1;
+}
+
+void OrderScheduler::setDualArm(bool dual_arm) { dual_arm_ = dual_arm; }
+
+void OrderScheduler::setClock(const Clock& clock) { clock_ = clock; }
+
+void OrderScheduler::start() { start_time_ = clock_(); }
+
+bool OrderScheduler::getNextOrder(std::size_t& order_id)
+{
+  const double remaining_time = getRemainingTime();
+
+  std::vector<std::size_t> chosen;
+  plan(remaining_time, chosen);
+
+  std::size_t pending = 0;
+  for (std::size_t i = 0; i < orders_.size(); ++i)
+    if (orders_[i].status_ == PENDING)
+      pending++;
+
+  if (chosen.empty())
+  {
+    if (pending)
+      ROS_WARN_STREAM_NAMED("order_scheduler", "None of the " << pending << " remaining orders "
+                                                              << "are expected to finish in the "
+                                                              << remaining_time << " s left");
+    return false;
+  }
+
+  double planned_points = 0;
+  double planned_duration = 0;
+  for (std::size_t i = 0; i < chosen.size(); ++i)
+  {
+    planned_points += orders_[chosen[i]].expected_points_;
+    planned_duration += getExpectedDuration(chosen[i]);
+  }
+  ROS_INFO_STREAM_NAMED("order_scheduler", "Planned " << chosen.size() << " of " << pending
+                                                      << " pending orders, " << planned_points
+                                                      << " expected points in " << planned_duration
+                                                      << " of " << remaining_time << " s left");
+
+  order_id = chosen.front();
+  return true;
+}
+
+bool OrderScheduler::reportResult(std::size_t order_id, bool success, double duration)
+{
+  Order& order = orders_[order_id];
+  order.status_ = success ? SUCCEEDED : FAILED;
+  order.duration_ += duration;
+  order.attempts_++;
+
+  std::pair<double, std::size_t>& row = row_durations_[getBinRow(order.bin_)];
+  row.first += duration;
+  row.second++;
+  total_duration_ += duration;
+  finished_++;
+
+  if (success)
+    return false;
+
+  // Decide whether another try is worth it
+  const double expected_duration = getExpectedDuration(order_id);
+  if (order.attempts_ >= max_attempts_)
+  {
+    ROS_INFO_STREAM_NAMED("order_scheduler", "Order " << order_id << " failed " << order.attempts_
+                                                      << " times, giving up on it");
+    return false;
+  }
+  if (order.duration_ + expected_duration > order_time_budget_)
+  {
+    ROS_INFO_STREAM_NAMED("order_scheduler", "Order " << order_id << " has used " << order.duration_
+                                                      << " of its " << order_time_budget_
+                                                      << " s budget, giving up on it");
+    return false;
+  }
+  if (expected_duration > getRemainingTime())
+  {
+    ROS_INFO_STREAM_NAMED("order_scheduler", "Not enough time left to retry order " << order_id);
+    return false;
+  }
+
+  // Requeue with the next strategy, the planner puts it behind untried orders
+  order.status_ = PENDING;
+  const std::size_t num_retry_strategies =
+      dual_arm_ ? ORDER_NUM_STRATEGIES - 1 : ORDER_STRATEGY_OTHER_ARM - 1;
+  order.strategy_ =
+      static_cast<OrderStrategy>(1 + (order.attempts_ - 1) % num_retry_strategies);
+  ROS_INFO_STREAM_NAMED("order_scheduler", "Requeued order " << order_id << " for attempt "
+                                                             << order.attempts_ + 1 << " with "
+                                                             << getStrategyName(order.strategy_));
+  return true;
+}
+
+double OrderScheduler::getRemainingTime() const
+{
+  return time_limit_ - (clock_() - start_time_);
+}
+
+const std::string& OrderScheduler::getProduct(std::size_t order_id) const
+{
+  return orders_[order_id].product_;
+}
+
+double OrderScheduler::getExpectedPoints(std::size_t order_id) const
+{
+  return orders_[order_id].expected_points_;
+}
+
+double OrderScheduler::getGraspProbability(std::size_t order_id) const
+{
+  return orders_[order_id].p_grasping_correctly_;
+}
+
+double OrderScheduler::getExpectedDuration(std::size_t order_id) const
+{
+  std::map<std::size_t, std::pair<double, std::size_t> >::const_iterator row_it =
+      row_durations_.find(getBinRow(orders_[order_id].bin_));
+  if (row_it != row_durations_.end())
+    return row_it->second.first / row_it->second.second;
+  if (finished_)
+    return total_duration_ / finished_;
+  return default_duration_;
+}
+
+OrderStrategy OrderScheduler::getStrategy(std::size_t order_id) const
+{
+  return orders_[order_id].strategy_;
+}
+
+std::size_t OrderScheduler::getAttempts(std::size_t order_id) const
+{
+  return orders_[order_id].attempts_;
+}
+
+const char* OrderScheduler::getStrategyName(OrderStrategy strategy)
+{
+  switch (strategy)
+  {
+    case ORDER_STRATEGY_DEFAULT:
+      return "default";
+    case ORDER_STRATEGY_REPERCEIVE:
+      return "re-perceive";
+    case ORDER_STRATEGY_OTHER_GRASP:
+      return "other grasp";
+    case ORDER_STRATEGY_OTHER_ARM:
+      return "other arm";
+    default:
+      return "unknown";
+  }
+}
+
+void OrderScheduler::printSummary() const
+{
+  double points = 0;
+  std::size_t succeeded = 0;
+  std::cout << "-------------------------------------------------------" << std::endl;
+  std::cout << "Order schedule:" << std::endl;
+  for (std::size_t i = 0; i < orders_.size(); ++i)
+  {
+    const Order& order = orders_[i];
+    std::cout << "  " << i << " " << order.product_ << " in " << order.bin_ << " ("
+              << order.bin_count_ << " products): expected " << order.expected_points_
+              << " points in " << getExpectedDuration(i) << " s, ";
+    if (order.status_ == PENDING && !order.attempts_)
+      std::cout << "not run" << std::endl;
+    else if (order.status_ == PENDING)
+      std::cout << "not finished after " << order.attempts_ << " attempts" << std::endl;
+    else
+      std::cout << (order.status_ == SUCCEEDED ? "succeeded" : "failed") << " in "
+                << order.duration_ << " s over " << order.attempts_ << " attempts" << std::endl;
+
+    if (order.status_ == SUCCEEDED)
+    {
+      points += getBinPoints(order.bin_count_) + order.extra_points_;
+      succeeded++;
+    }
+  }
+  std::cout << "Succeeded " << succeeded << " of " << orders_.size() << " orders for about "
+            << points << " points, " << getRemainingTime() << " s left" << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+}
+
+std::size_t OrderScheduler::getBinRow(const std::string& bin)
+{
+  // Names are bin_A through bin_L, three to a row
+  if (bin.empty() || bin[bin.size() - 1] < 'A' || bin[bin.size() - 1] > 'L')
+    return 0;
+  return (bin[bin.size() - 1] - 'A') / 3;
+}
+
+double OrderScheduler::getBinPoints(std::size_t bin_count)
+{
+  if (bin_count <= 1)
+    return 10.0;
+  if (bin_count == 2)
+    return 15.0;
+  return 20.0;
+}
+
+void OrderScheduler::plan(double remaining_time, std::vector<std::size_t>& chosen) const
+{
+  chosen.clear();
+  if (remaining_time <= 0)
+    return;
+
+  // Only orders worth something are candidates
+  std::vector<std::size_t> candidates;
+  std::vector<std::size_t> costs;
+  for (std::size_t i = 0; i < orders_.size(); ++i)
+  {
+    if (orders_[i].status_ != PENDING || orders_[i].expected_points_ <= 0)
+      continue;
+    candidates.push_back(i);
+    costs.push_back(std::max(1.0, std::ceil(getExpectedDuration(i) / PLAN_RESOLUTION)));
+  }
+
+  // 0/1 knapsack over the remaining time: best[t] is the most points within t, take[c][t] whether
+  // candidate c is part of that
+  const std::size_t capacity = remaining_time / PLAN_RESOLUTION;
+  std::vector<double> best(capacity + 1, 0.0);
+  std::vector<std::vector<bool> > take(candidates.size(), std::vector<bool>(capacity + 1, false));
+  for (std::size_t c = 0; c < candidates.size(); ++c)
+  {
+    const double points = orders_[candidates[c]].expected_points_;
+    for (std::size_t t = capacity + 1; t-- > costs[c];)
+    {
+      if (best[t - costs[c]] + points > best[t])
+      {
+        best[t] = best[t - costs[c]] + points;
+        take[c][t] = true;
+      }
+    }
+  }
+
+  // Walk back to find the chosen set
+  std::size_t t = capacity;
+  for (std::size_t c = candidates.size(); c-- > 0;)
+  {
+    if (take[c][t])
+    {
+      chosen.push_back(candidates[c]);
+      t -= costs[c];
+    }
+  }
+
+  // Untried orders before retries, then most points per second first, so running out of time
+  // early costs the least
+  typedef std::pair<std::pair<std::size_t, double>, std::size_t> RankedOrder;
+  std::vector<RankedOrder> ranked;
+  for (std::size_t i = 0; i < chosen.size(); ++i)
+  {
+    const Order& order = orders_[chosen[i]];
+    const double points_per_second =
+        order.expected_points_ / std::max(getExpectedDuration(chosen[i]), 1e-3);
+    ranked.push_back(
+        RankedOrder(std::make_pair(order.attempts_, -points_per_second), chosen[i]));
+  }
+  std::sort(ranked.begin(), ranked.end());
+  for (std::size_t i = 0; i < ranked.size(); ++i)
+    chosen[i] = ranked[i].second;
+}
+
+}  // end namespace
@@ -100,6 +100,11 @@ bool PerceptionInterface::isPerceptionReady()
   return true;
 }
 
+bool PerceptionInterface::isPerceptionConnected()
+{
+  return find_objects_action_.isServerConnected();
+}
+
 bool PerceptionInterface::getTFTransform(Eigen::Affine3d& world_to_frame, ros::Time& time_stamp,
                                          const std::string& frame_id)
 {
@@ -61,7 +61,11 @@ PickManager::PickManager(bool verbose)
 
   // Load manipulation data for our robot
   config_.reset(new ManipulationData());
-  config_->load(robot_model_, FLAGS_fake_execution, package_path_);
+  if (!config_->load(robot_model_, FLAGS_fake_execution, package_path_))
+  {
+    ROS_FATAL_STREAM_NAMED("pick_manager", "Unable to load manipulation data, shutting down");
+    exit(-1);
+  }
 
   // Create tf transformer
   tf_.reset(new tf::TransformListener(nh_private_));
@@ -104,8 +108,12 @@ PickManager::PickManager(bool verbose)
                                        grasp_datas_, remote_control_, FLAGS_fake_execution,
                                        tactile_feedback_));
 
+  // Coalesce interactive marker feedback into rate limited commands
+  teleop_worker_.reset(new TeleopWorker(
+      boost::bind(&PickManager::executeTeleopPose, this, _1, _2), config_->teleop_rate_));
+
   // Load trajectory IO class
-  // trajectory_io_.reset(new TrajectoryIO(remote_control_, visuals_, config_, manipulation_));
+  trajectory_io_.reset(new TrajectoryIO(remote_control_, visuals_, config_, manipulation_));
 
   // Load perception layer
   perception_interface_.reset(
@@ -117,11 +125,33 @@ PickManager::PickManager(bool verbose)
   // Show interactive marker
   setupInteractiveMarker();
 
+  // Load health monitor, started by the first checkSystemReady()
+  health_monitor_.reset(new HealthMonitor(config_->health_check_rate_));
+  health_monitor_->addCheck("controllers",
+                            boost::bind(&ExecutionInterface::checkControllersActive,
+                                        manipulation_->getExecutionInterface()));
+  if (!fake_perception_)
+    health_monitor_->addCheck("perception", boost::bind(&PerceptionInterface::isPerceptionConnected,
+                                                        perception_interface_));
+  StateSnapshotPtr state_snapshot = manipulation_->getExecutionInterface()->getStateSnapshot();
+  if (state_snapshot)
+    health_monitor_->watchJointStates(state_snapshot, config_->joint_state_timeout_);
+
   ROS_INFO_STREAM_NAMED("pick_manager", "PickManager Ready.");
 }
 
 bool PickManager::checkSystemReady()
 {
+  // After the first full check, the monitor has already been keeping track in the background
+  if (health_monitor_->isStarted())
+  {
+    if (health_monitor_->isHealthy())
+      return true;
+    ROS_ERROR_STREAM_NAMED("pick_manager", "System is not healthy");
+    health_monitor_->printStatus();
+    return false;
+  }
+
   std::cout << std::endl;
   std::cout << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
@@ -170,11 +200,25 @@ bool PickManager::checkSystemReady()
   // Check end effectors calibrated
   // TODO
 
+  // Keep watching from now on
+  if (!health_monitor_->start())
+  {
+    ROS_FATAL_STREAM_NAMED("pick_manager", "Health monitor found a problem");
+    health_monitor_->printStatus();
+    return false;
+  }
+
   ROS_INFO_STREAM_NAMED("pick_manager", "System ready check COMPLETE");
   std::cout << "-------------------------------------------------------" << std::endl;
   return true;
 }
 
+void PickManager::printStats()
+{
+  manipulation_->getExecutionInterface()->getLatencyStats()->printSummary();
+  manipulation_->getStatePool()->printStats();
+}
+
 // Mode 8
 bool PickManager::testEndEffectors()
 {
@@ -196,7 +240,8 @@ bool PickManager::testEndEffectors()
       // Close all EEs
       manipulation_->openEEs(open);
 
-      ros::Duration(2.0).sleep();
+      // Until the fingers stop moving, at most the old fixed wait
+      manipulation_->waitForGrasp(2.0);
     }
     else
     {
@@ -209,7 +254,8 @@ bool PickManager::testEndEffectors()
       // Close all EEs
       manipulation_->openEEs(open);
 
-      ros::Duration(2.0).sleep();
+      // Until the fingers stop moving, at most the old fixed wait
+      manipulation_->waitForGrasp(2.0);
     }
     ++i;
   }
@@ -227,6 +273,10 @@ bool PickManager::testUpAndDown()
   std::size_t i = 0;
   while (ros::ok())
   {
+    // Check every motion if the system is still ready
+    if (!checkSystemReady())
+      return false;
+
     std::cout << std::endl << std::endl;
     if (i % 2 == 0)
     {
@@ -362,6 +412,10 @@ bool PickManager::testRandomValidMotions()
     scene->getAllowedCollisionMatrixNonConst().setEntry("base_39", "jaco2_link_1", true);
   }
 
+  // Goal chosen during the previous motion, already being planned to
+  moveit::core::RobotStatePtr next_goal_state;
+  JointModelGroup* next_arm_jmg = NULL;
+
   // Plan to random
   while (ros::ok())
   {
@@ -370,43 +424,51 @@ bool PickManager::testRandomValidMotions()
     {
       ROS_DEBUG_STREAM_NAMED("pick_manager", "Attempt " << i << " to plan to a random location");
 
+      // Check every motion if the system is still ready
+      if (!checkSystemReady())
+      {
+        manipulation_->discardPlanLookahead();
+        return false;
+      }
+
       // Create start
       moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
 
       // Create goal
-      moveit::core::RobotStatePtr goal_state(new moveit::core::RobotState(*current_state));
-
-      // Choose arm
-      JointModelGroup* arm_jmg = config_->right_arm_;
-      if (config_->dual_arm_)
-        if (visuals_->visual_tools_->iRand(0, 1) == 0)
-          arm_jmg = config_->left_arm_;
-
-      goal_state->setToRandomPositions(arm_jmg);
-
-      // Check if random goal state is valid
-      bool collision_verbose = false;
-      if (manipulation_->checkCollisionAndBounds(current_state, goal_state, collision_verbose))
+      moveit::core::RobotStatePtr goal_state = next_goal_state;
+      JointModelGroup* arm_jmg = next_arm_jmg;
+      next_goal_state.reset();
+      if (!goal_state && !chooseRandomValidGoal(current_state, arm_jmg, goal_state))
+        continue;
+
+      // Choose the motion after this one, so it is planned while this one executes
+      if (config_->isEnabled("plan_lookahead") &&
+          chooseRandomValidGoal(goal_state, next_arm_jmg, next_goal_state))
+        manipulation_->queuePlanLookahead(goal_state, next_goal_state, next_arm_jmg);
+      else
+        next_goal_state.reset();
+
+      // Plan to this position
+      bool verbose = true;
+      bool execute_trajectory = true;
+      if (manipulation_->move(current_state, goal_state, arm_jmg,
+                              config_->main_velocity_scaling_factor_, verbose, execute_trajectory))
       {
-        // Plan to this position
-        bool verbose = true;
-        bool execute_trajectory = true;
-        if (manipulation_->move(current_state, goal_state, arm_jmg,
-                                config_->main_velocity_scaling_factor_, verbose,
-                                execute_trajectory))
-        {
-          ROS_INFO_STREAM_NAMED("pick_manager", "Planned to random valid state successfullly");
-        }
-        else
-        {
-          ROS_ERROR_STREAM_NAMED("pick_manager", "Failed to plan to random valid state");
-          return false;
-        }
+        ROS_INFO_STREAM_NAMED("pick_manager", "Planned to random valid state successfullly");
+      }
+      else
+      {
+        ROS_ERROR_STREAM_NAMED("pick_manager", "Failed to plan to random valid state");
+        manipulation_->discardPlanLookahead();
+        return false;
       }
     }
     ROS_ERROR_STREAM_NAMED("pick_manager", "Unable to find random valid state after "
                                                << MAX_ATTEMPTS << " attempts");
 
+    // Steady state should show no new allocations between rounds
+    manipulation_->getStatePool()->printStats();
+
     ros::Duration(1).sleep();
   }  // while
 
@@ -414,6 +476,24 @@ bool PickManager::testRandomValidMotions()
   return true;
 }
 
+bool PickManager::chooseRandomValidGoal(const moveit::core::RobotStatePtr& start,
+                                        JointModelGroup*& arm_jmg,
+                                        moveit::core::RobotStatePtr& goal_state)
+{
+  // Choose arm
+  arm_jmg = config_->right_arm_;
+  if (config_->dual_arm_)
+    if (visuals_->visual_tools_->iRand(0, 1) == 0)
+      arm_jmg = config_->left_arm_;
+
+  goal_state = manipulation_->getStatePool()->acquire(*start);
+  goal_state->setToRandomPositions(arm_jmg);
+
+  // Check if random goal state is valid
+  bool collision_verbose = false;
+  return manipulation_->checkCollisionAndBounds(start, goal_state, collision_verbose);
+}
+
 // Mode 2
 bool PickManager::testGoHome()
 {
@@ -434,7 +514,7 @@ bool PickManager::testJointLimits()
   moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
 
   // Create goal
-  moveit::core::RobotStatePtr goal_state(new moveit::core::RobotState(*current_state));
+  moveit::core::RobotStatePtr goal_state = manipulation_->getStatePool()->acquire(*current_state);
 
   // Setup data
   std::vector<double> joint_position;
@@ -551,6 +631,21 @@ bool PickManager::playbackTrajectory()
   return true;
 }
 
+// Mode 12
+bool PickManager::convertTrajectories()
+{
+  // Choose which planning group to use
+  JointModelGroup* arm_jmg = config_->arm_only_;
+  if (!arm_jmg)
+  {
+    ROS_ERROR_STREAM_NAMED("pick_manager", "No joint model group for arm");
+    return false;
+  }
+
+  return trajectory_io_->convertAllCSVToBinary(arm_jmg,
+                                               config_->calibration_velocity_scaling_factor_);
+}
+
 bool PickManager::moveToStartPosition(JointModelGroup* arm_jmg, bool check_validity)
 {
   return manipulation_->moveToStartPosition(arm_jmg, check_validity);
@@ -677,8 +772,8 @@ bool PickManager::gotoPose(const std::string& pose_name)
 // Mode 25
 bool PickManager::testIKSolver()
 {
-  moveit::core::RobotStatePtr goal_state(
-      new moveit::core::RobotState(*manipulation_->getCurrentState()));
+  moveit::core::RobotStatePtr goal_state =
+      manipulation_->getStatePool()->acquire(*manipulation_->getCurrentState());
 
   JointModelGroup* arm_jmg = config_->right_arm_;
   Eigen::Affine3d ee_pose = Eigen::Affine3d::Identity();
@@ -817,7 +912,7 @@ bool PickManager::testGraspWidths()
 
       // Wait
       ros::Duration(2.0).sleep();
-      remote_control_->waitForNextStep("move fingers");
+      remote_control_->waitForNextStep("move fingers", __FILE__, __LINE__);
 
       // Increment the test
       joint_position += (max_finger_joint_limit - min_finger_joint_limit) / 10.0;  //
@@ -844,7 +939,7 @@ bool PickManager::testGraspWidths()
 
       // Wait
       ros::Duration(1.0).sleep();
-      remote_control_->waitForNextStep("move fingers");
+      remote_control_->waitForNextStep("move fingers", __FILE__, __LINE__);
 
       // Change fingers
       trajectory_msgs::JointTrajectory grasp_posture;
@@ -878,6 +973,7 @@ void PickManager::processMarkerPose(const geometry_msgs::Pose& pose, bool move)
 {
   // NOTE this is in a separate thread, so we should only use visuals_->trajectory_lines_ for
   // debugging!
+  boost::mutex::scoped_lock lock(interactive_marker_mutex_);
 
   // Get pose and visualize
   interactive_marker_pose_ = visuals_->trajectory_lines_->convertPose(pose);
@@ -891,25 +987,38 @@ void PickManager::processMarkerPose(const geometry_msgs::Pose& pose, bool move)
 
   move = true;
 
-  // Choose arm
-  JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
-
   // Offset ee pose forward, because we are treating interactive marker as a special thing in front
   // of hand
   Eigen::Affine3d ee_pose = interactive_marker_pose_ * config_->teleoperation_offset_;
 
+  // Solving and commanding happens on the worker, which skips targets that are already stale
+  teleop_worker_->push(ee_pose, move);
+}
+
+bool PickManager::executeTeleopPose(const Eigen::Affine3d& ee_pose, bool move)
+{
+  // Choose arm
+  JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
+
+  // Joint command from IK solved on this computer
+  if (config_->teleop_use_ik_)
+    return manipulation_->teleoperation(ee_pose, move, arm_jmg);
+
   // Convert pose to frame of robot base
   const Eigen::Affine3d& world_to_base =
       manipulation_->getCurrentState()->getGlobalLinkTransform("base_link");
   Eigen::Affine3d base_to_desired = world_to_base.inverse() * ee_pose;
 
   // New Method
-  manipulation_->getExecutionInterface()->executePose(base_to_desired, arm_jmg);
+  return manipulation_->getExecutionInterface()->executePose(base_to_desired, arm_jmg);
 }
 
 // Mode 3
 void PickManager::insertion()
 {
+  if (!checkSystemReady())
+    return;
+
   // Note: The pre-insertion pose is from interactive_marker_pose_
   JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
 
@@ -1074,13 +1183,17 @@ void PickManager::touchControl()
 void PickManager::setupInteractiveMarker()
 {
   JointModelGroup* arm_jmg = config_->dual_arm_ ? config_->both_arms_ : config_->right_arm_;
-  interactive_marker_pose_ =
-      manipulation_->getCurrentState()->getGlobalLinkTransform(grasp_datas_[arm_jmg]->parent_link_);
+  geometry_msgs::Pose pose_msg;
+  {
+    boost::mutex::scoped_lock lock(interactive_marker_mutex_);
+    interactive_marker_pose_ = manipulation_->getCurrentState()->getGlobalLinkTransform(
+        grasp_datas_[arm_jmg]->parent_link_);
 
-  // Move marker to tip of fingers
-  interactive_marker_pose_ = interactive_marker_pose_ * config_->teleoperation_offset_.inverse();
+    // Move marker to tip of fingers
+    interactive_marker_pose_ = interactive_marker_pose_ * config_->teleoperation_offset_.inverse();
 
-  geometry_msgs::Pose pose_msg = visuals_->visual_tools_->convertPose(interactive_marker_pose_);
+    pose_msg = visuals_->visual_tools_->convertPose(interactive_marker_pose_);
+  }
 
   // geometry_msgs::Pose pose =
   // visuals_->visual_tools_->convertPose(config_->grasp_location_transform_);
@@ -1225,6 +1338,9 @@ void PickManager::getSpiralPoses(std::vector<Eigen::Affine3d>& poses,
 
 void PickManager::automatedInsertionTest()
 {
+  if (!checkSystemReady())
+    return;
+
   JointModelGroup* arm_jmg = config_->right_arm_;
 
   // Go to pre-grap of knife pose
@@ -1264,9 +1380,10 @@ void PickManager::automatedInsertionTest()
   }
 
   // Close gripper
-  remote_control_->waitForNextFullStep("have user manually close gripper");
+  remote_control_->waitForNextFullStep("have user manually close gripper", __FILE__, __LINE__);
 
-  // Recalibrate tactile
+  // Recalibrate tactile once the grip is stable, so the zero is not taken mid squeeze
+  manipulation_->waitForGrasp(config_->wait_after_grasp_);
   tactile_feedback_->recalibrateTactileSensor();
 
   // Move knife out
@@ -1301,7 +1418,11 @@ void PickManager::automatedInsertionTest()
   visuals_->visual_tools_->publishZArrow(desired_world_to_tool, rvt::GREEN);
   */
 
-  remote_control_->waitForNextStep("insert");
+  remote_control_->waitForNextStep("insert", __FILE__, __LINE__);
+
+  // The user may have waited a while, check again before touching anything
+  if (!checkSystemReady())
+    return;
 
   // Move knife in
   direction_in = true;
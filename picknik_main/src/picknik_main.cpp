@@ -105,6 +105,10 @@ int main(int argc, char** argv)
       ROS_INFO_STREAM_NAMED("main", "Going in circle for calibration");
       manager.calibrateInCircle();
       break;
+    case 12:
+      ROS_INFO_STREAM_NAMED("main", "Convert CSV trajectories to binary");
+      manager.convertTrajectories();
+      break;
     case 17:
       ROS_INFO_STREAM_NAMED("main", "Test joint limits");
       manager.testJointLimits();
@@ -123,6 +127,9 @@ int main(int argc, char** argv)
       ROS_WARN_STREAM_NAMED("main", "Unkown mode: " << FLAGS_mode);
   }
 
+  // Show where the time went, whichever way the mode ended
+  manager.printStats();
+
   // Shutdown
   std::cout << std::endl << std::endl << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
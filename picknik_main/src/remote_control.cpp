@@ -47,6 +47,10 @@
 #include <tf/transform_broadcaster.h>
 #include <tf/tf.h>
 
+// C++
+#include <algorithm>
+#include <cstring>
+
 namespace picknik_main
 {
 DEFINE_bool(auto_step, false, "Automatically go through each step");
@@ -83,6 +87,8 @@ RemoteControl::RemoteControl(bool verbose, ros::NodeHandle nh, PickManager* pare
   ROS_INFO_STREAM_NAMED("remote_control", "RemoteControl Ready.");
 }
 
+RemoteControl::~RemoteControl() { printWaitStats(); }
+
 void RemoteControl::remoteCallback(const dashboard_msgs::DashboardControl::ConstPtr& msg)
 {
   if (msg->next_step)
@@ -132,92 +138,160 @@ void RemoteControl::joyCallback(const sensor_msgs::Joy::ConstPtr& msg)
 
 bool RemoteControl::setReadyForNextStep()
 {
-  stop_ = false;
-
-  if (is_waiting_)
   {
-    next_step_ready_ = true;
+    boost::mutex::scoped_lock lock(state_mutex_);
+    stop_ = false;
+
+    if (is_waiting_)
+    {
+      next_step_ready_ = true;
+    }
   }
+  state_condition_.notify_all();
   return true;
 }
 
 void RemoteControl::setAutonomous(bool autonomous)
 {
   // TODO: disable this feature for final competition
-  autonomous_ = autonomous;
-  stop_ = false;
+  {
+    boost::mutex::scoped_lock lock(state_mutex_);
+    autonomous_ = autonomous;
+    stop_ = false;
+  }
+  state_condition_.notify_all();
 }
 
 void RemoteControl::setFullAutonomous(bool autonomous)
 {
   // TODO: disable this feature for final competition
-  full_autonomous_ = autonomous;
-  autonomous_ = autonomous;
-  stop_ = false;
+  {
+    boost::mutex::scoped_lock lock(state_mutex_);
+    full_autonomous_ = autonomous;
+    autonomous_ = autonomous;
+    stop_ = false;
+  }
+  state_condition_.notify_all();
 }
 
 void RemoteControl::setStop(bool stop)
 {
-  stop_ = stop;
-  if (stop)
   {
-    autonomous_ = false;
-    full_autonomous_ = false;
+    boost::mutex::scoped_lock lock(state_mutex_);
+    stop_ = stop;
+    if (stop)
+    {
+      autonomous_ = false;
+      full_autonomous_ = false;
+    }
   }
+  state_condition_.notify_all();
 }
 
-bool RemoteControl::getStop() { return stop_; }
-bool RemoteControl::getAutonomous() { return autonomous_; }
-bool RemoteControl::getFullAutonomous() { return full_autonomous_; }
-bool RemoteControl::waitForNextStep(const std::string& caption)
+bool RemoteControl::getStop()
 {
-  // Check if we really need to wait
-  if (!(!next_step_ready_ && !autonomous_ && ros::ok()))
-    return true;
+  boost::mutex::scoped_lock lock(state_mutex_);
+  return stop_;
+}
 
-  // Show message
-  std::cout << std::endl << std::endl;
-  std::cout << MOVEIT_CONSOLE_COLOR_CYAN << "Waiting to " << caption << MOVEIT_CONSOLE_COLOR_RESET
-            << std::endl;
+bool RemoteControl::getAutonomous()
+{
+  boost::mutex::scoped_lock lock(state_mutex_);
+  return autonomous_;
+}
 
-  is_waiting_ = true;
-  // Wait until next step is ready
-  while (!next_step_ready_ && !autonomous_ && ros::ok())
-  {
-    ros::Duration(0.25).sleep();
-    ros::spinOnce();
-  }
-  if (!ros::ok())
-    return false;
-  next_step_ready_ = false;
-  is_waiting_ = false;
-  return true;
+bool RemoteControl::getFullAutonomous()
+{
+  boost::mutex::scoped_lock lock(state_mutex_);
+  return full_autonomous_;
 }
 
-bool RemoteControl::waitForNextFullStep(const std::string& caption)
+bool RemoteControl::isWaiting()
 {
+  boost::mutex::scoped_lock lock(state_mutex_);
+  return is_waiting_;
+}
+
+bool RemoteControl::waitForNextStep(const std::string& caption, const char* file, int line)
+{
+  return waitForStep(caption, file, line, false);
+}
+
+bool RemoteControl::waitForNextFullStep(const std::string& caption, const char* file, int line)
+{
+  return waitForStep(caption, file, line, true);
+}
+
+bool RemoteControl::waitForStep(const std::string& caption, const char* file, int line,
+                                bool full_step)
+{
+  // Sites are named by file name and line, without the directories
+  const char* file_name = strrchr(file, '/');
+  const std::string site =
+      std::string(file_name ? file_name + 1 : file) + ":" + std::to_string(line);
+
+  boost::mutex::scoped_lock lock(state_mutex_);
+  WaitStats& stats = wait_stats_[site];
+  stats.caption_ = caption;
+  const bool& skip = full_step ? full_autonomous_ : autonomous_;
+
   // Check if we really need to wait
-  if (!(!next_step_ready_ && !full_autonomous_ && ros::ok()))
+  if (next_step_ready_ || skip || !ros::ok())
+  {
+    stats.passed_++;
     return true;
+  }
 
   // Show message
+  if (!full_step)
+    std::cout << std::endl << std::endl;
   std::cout << MOVEIT_CONSOLE_COLOR_CYAN << "Waiting to " << caption << MOVEIT_CONSOLE_COLOR_RESET
             << std::endl;
 
+  const ros::WallTime start_time = ros::WallTime::now();
   is_waiting_ = true;
-  // Wait until next step is ready
-  while (!next_step_ready_ && !full_autonomous_ && ros::ok())
-  {
-    ros::Duration(0.25).sleep();
-    ros::spinOnce();
-  }
+  // Wait until next step is ready. Every change of mode notifies, the timeout only exists to
+  // notice ros shutting down
+  static const boost::posix_time::milliseconds SHUTDOWN_CHECK_PERIOD(500);
+  while (!next_step_ready_ && !skip && ros::ok())
+    state_condition_.timed_wait(lock, SHUTDOWN_CHECK_PERIOD);
+  is_waiting_ = false;
   if (!ros::ok())
     return false;
   next_step_ready_ = false;
-  is_waiting_ = false;
+
+  const double wait_time = (ros::WallTime::now() - start_time).toSec();
+  stats.waited_++;
+  stats.total_wait_ += wait_time;
+  stats.max_wait_ = std::max(stats.max_wait_, wait_time);
   return true;
 }
 
+void RemoteControl::printWaitStats()
+{
+  typedef std::pair<std::string, WaitStats> SiteStats;
+  std::vector<SiteStats> sorted;
+  {
+    boost::mutex::scoped_lock lock(state_mutex_);
+    sorted.assign(wait_stats_.begin(), wait_stats_.end());
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const SiteStats& a, const SiteStats& b)
+            {
+              return a.second.total_wait_ > b.second.total_wait_;
+            });
+
+  ROS_INFO_STREAM_NAMED("remote_control", "Remote control step waits (site caption: "
+                                           "waited/passed, total, max):");
+  for (std::size_t i = 0; i < sorted.size(); ++i)
+  {
+    const WaitStats& stats = sorted[i].second;
+    ROS_INFO_STREAM_NAMED("remote_control", "  " << sorted[i].first << " '" << stats.caption_
+                                                 << "': " << stats.waited_ << "/"
+                                                 << stats.passed_ << ", " << stats.total_wait_
+                                                 << " s, " << stats.max_wait_ << " s");
+  }
+}
+
 void RemoteControl::initializeInteractiveMarkers(const geometry_msgs::Pose& pose)
 {
   // Server
@@ -365,14 +439,8 @@ void RemoteControl::processFeedback(
   // }
   // throttle_time_ = ros::Time::now(); // remember last time we procesed feedback
 
-  {
-    boost::unique_lock<boost::mutex> scoped_lock(interactive_mutex_);
-    if (!teleoperation_ready_)
-    {
-      return;
-    }
-    teleoperation_ready_ = false;
-  }
+  // Feedback is not dropped here while a previous one is being handled, the teleop worker keeps
+  // only the newest pose so that the final mouse up is never lost
 
   // Check that this feedback isn't too old
   // if (feedback->header.stamp < ros::Time::now() - )  {
@@ -439,11 +507,6 @@ void RemoteControl::processFeedback(
   }
 
   imarker_server_->applyChanges();
-
-  {
-    boost::unique_lock<boost::mutex> scoped_lock(interactive_mutex_);
-    teleoperation_ready_ = true;
-  }
 }
 
 }  // end namespace
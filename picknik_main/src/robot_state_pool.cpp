@@ -0,0 +1,96 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Recycle RobotState memory in the hot paths instead of calling new every loop
+*/
+
+// PickNik
+#include <picknik_main/robot_state_pool.h>
+
+// Boost
+#include <boost/bind.hpp>
+
+namespace picknik_main
+{
+RobotStatePool::FreeList::~FreeList()
+{
+  for (std::size_t i = 0; i < states_.size(); ++i)
+    delete states_[i];
+}
+
+RobotStatePool::RobotStatePool(std::size_t max_free_per_thread)
+  : max_free_per_thread_(max_free_per_thread), allocations_(0), acquisitions_(0), releases_(0)
+{
+}
+
+moveit::core::RobotStatePtr RobotStatePool::acquire(const moveit::core::RobotState& copy_from)
+{
+  acquisitions_++;
+
+  FreeList* free_list = free_lists_.get();
+  moveit::core::RobotState* state = NULL;
+
+  // Only reuse memory that was sized for the same robot
+  if (free_list && !free_list->states_.empty() &&
+      free_list->states_.back()->getRobotModel() == copy_from.getRobotModel())
+  {
+    state = free_list->states_.back();
+    free_list->states_.pop_back();
+    *state = copy_from;  // copies into existing memory
+  }
+  else
+  {
+    allocations_++;
+    state = new moveit::core::RobotState(copy_from);
+  }
+
+  return moveit::core::RobotStatePtr(
+      state, boost::bind(&RobotStatePool::release,
+                         boost::weak_ptr<RobotStatePool>(shared_from_this()), _1));
+}
+
+void RobotStatePool::release(boost::weak_ptr<RobotStatePool> weak_pool,
+                             moveit::core::RobotState* state)
+{
+  RobotStatePoolPtr pool = weak_pool.lock();
+  if (!pool)
+  {
+    delete state;
+    return;
+  }
+  pool->releases_++;
+
+  FreeList* free_list = pool->free_lists_.get();
+  if (!free_list)
+  {
+    free_list = new FreeList();
+    free_list->states_.reserve(pool->max_free_per_thread_);
+    pool->free_lists_.reset(free_list);
+  }
+
+  if (free_list->states_.size() >= pool->max_free_per_thread_)
+  {
+    delete state;
+    return;
+  }
+  free_list->states_.push_back(state);
+}
+
+void RobotStatePool::printStats() const
+{
+  ROS_INFO_STREAM_NAMED("robot_state_pool", "RobotState pool: " << allocations_
+                                                                << " allocations for "
+                                                                << acquisitions_ << " acquires, "
+                                                                << getOutstandingCount()
+                                                                << " outstanding");
+}
+
+}  // end namespace
@@ -0,0 +1,109 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Decide from joint state messages when the robot has stopped moving, and wake waiting
+           threads the moment it does
+*/
+
+// PickNik
+#include <picknik_main/settle_detector.h>
+
+// Boost
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace picknik_main
+{
+SettleDetector::SettleDetector(const std::vector<std::string>& variable_names,
+                               double position_threshold, double velocity_threshold, double window)
+  : position_threshold_(position_threshold)
+  , velocity_threshold_(velocity_threshold)
+  , window_(window)
+  , positions_(variable_names.size(), 0.0)
+  , window_start_positions_(variable_names.size(), 0.0)
+  , settled_(false)
+{
+  for (std::size_t i = 0; i < variable_names.size(); ++i)
+    variable_indices_[variable_names[i]] = i;
+}
+
+void SettleDetector::update(const sensor_msgs::JointStateConstPtr& joint_state)
+{
+  const ros::Time stamp =
+      joint_state->header.stamp.isZero() ? ros::Time::now() : joint_state->header.stamp;
+  const bool has_velocities = joint_state->velocity.size() == joint_state->name.size();
+
+  // Copy in new values and check velocities
+  bool moving = window_start_stamp_.isZero();
+  const std::size_t count = std::min(joint_state->name.size(), joint_state->position.size());
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::map<std::string, std::size_t>::const_iterator it =
+        variable_indices_.find(joint_state->name[i]);
+    if (it == variable_indices_.end())
+      continue;
+    positions_[it->second] = joint_state->position[i];
+
+    if (has_velocities && fabs(joint_state->velocity[i]) > velocity_threshold_)
+      moving = true;
+  }
+
+  // Check drift since start of window
+  for (std::size_t i = 0; i < positions_.size() && !moving; ++i)
+    if (fabs(positions_[i] - window_start_positions_[i]) > position_threshold_)
+      moving = true;
+
+  // Restart the window from here
+  if (moving)
+  {
+    window_start_positions_ = positions_;  // same size, no allocation
+    window_start_stamp_ = stamp;
+  }
+
+  const bool settled = stamp - window_start_stamp_ >= window_;
+  {
+    boost::mutex::scoped_lock lock(settled_mutex_);
+    if (settled == settled_)
+      return;
+    settled_ = settled;
+  }
+  if (settled)
+    settled_condition_.notify_all();
+}
+
+bool SettleDetector::waitForSettle(double timeout, double& time_to_settle)
+{
+  const boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+  const boost::posix_time::ptime end_time =
+      start_time + boost::posix_time::microseconds(static_cast<int64_t>(timeout * 1e6));
+
+  boost::mutex::scoped_lock lock(settled_mutex_);
+  while (!settled_)
+  {
+    if (!settled_condition_.timed_wait(lock, end_time) && !settled_)
+    {
+      time_to_settle = timeout;
+      return false;
+    }
+  }
+
+  time_to_settle =
+      (boost::posix_time::microsec_clock::universal_time() - start_time).total_microseconds() /
+      1e6;
+  return true;
+}
+
+bool SettleDetector::isSettled() const
+{
+  boost::mutex::scoped_lock lock(settled_mutex_);
+  return settled_;
+}
+
+}  // end namespace
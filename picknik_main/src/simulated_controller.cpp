@@ -0,0 +1,342 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Follow joint trajectory controllers that play trajectories in simulated time, so that
+           offline runs take as long as they would on hardware (scaled by a real time factor)
+*/
+
+// PickNik
+#include <picknik_main/simulated_controller.h>
+
+// ROS
+#include <rosgraph_msgs/Clock.h>
+
+// C++
+#include <algorithm>
+
+namespace picknik_main
+{
+SimulatedController::SimulatedController(const moveit::core::RobotState& initial_state,
+                                         double real_time_factor, double update_rate,
+                                         bool publish_clock)
+  : real_time_factor_(real_time_factor)
+  , period_(1.0 / update_rate)
+  , publish_clock_(publish_clock)
+  , simulated_time_(ros::WallTime::now().toSec())
+  , execution_time_(0)
+  , running_(false)
+{
+  const std::vector<std::string>& variable_names = initial_state.getVariableNames();
+  for (std::size_t i = 0; i < variable_names.size(); ++i)
+    variable_indices_[variable_names[i]] = i;
+
+  const double* positions = initial_state.getVariablePositions();
+  joint_state_msg_.name = variable_names;
+  joint_state_msg_.position.assign(positions, positions + variable_names.size());
+
+  joint_state_pub_ = nh_.advertise<sensor_msgs::JointState>("joint_states", 10);
+  if (publish_clock_)
+    clock_pub_ = nh_.advertise<rosgraph_msgs::Clock>("/clock", 10);
+
+  ROS_INFO_STREAM_NAMED("simulated_controller", "Simulating at " << real_time_factor_
+                                                                 << "x real time");
+}
+
+SimulatedController::~SimulatedController() { stop(); }
+
+bool SimulatedController::addController(const std::string& name, const std::string& action_ns,
+                                        const std::vector<std::string>& joints)
+{
+  ControllerPtr controller(new Controller());
+  controller->name_ = name;
+  controller->active_ = false;
+  for (std::size_t i = 0; i < joints.size(); ++i)
+  {
+    std::map<std::string, std::size_t>::const_iterator it = variable_indices_.find(joints[i]);
+    if (it == variable_indices_.end())
+    {
+      ROS_ERROR_STREAM_NAMED("simulated_controller", "Controller " << name << " has unknown joint "
+                                                                   << joints[i]);
+      return false;
+    }
+    controller->variable_indices_.push_back(it->second);
+  }
+
+  controller->server_.reset(new FollowJointTrajectoryServer(
+      nh_, name + "/" + action_ns,
+      boost::bind(&SimulatedController::goalCallback, this, controller, _1),
+      boost::bind(&SimulatedController::cancelCallback, this, controller, _1), false));
+
+  boost::mutex::scoped_lock lock(mutex_);
+  controllers_.push_back(controller);
+
+  ROS_INFO_STREAM_NAMED("simulated_controller", "Added controller " << name << " with "
+                                                                    << joints.size() << " joints");
+  return true;
+}
+
+void SimulatedController::start()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (running_)
+      return;
+    running_ = true;
+  }
+  update_thread_ = boost::thread(boost::bind(&SimulatedController::updateThread, this));
+
+  for (std::size_t i = 0; i < controllers_.size(); ++i)
+    controllers_[i]->server_->start();
+}
+
+void SimulatedController::stop()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!running_)
+      return;
+    running_ = false;
+  }
+  update_thread_.join();
+
+  // Nothing will finish these now
+  std::vector<FollowJointTrajectoryServer::GoalHandle> aborted;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (std::size_t i = 0; i < controllers_.size(); ++i)
+    {
+      if (controllers_[i]->active_)
+        aborted.push_back(controllers_[i]->goal_handle_);
+      controllers_[i]->active_ = false;
+    }
+  }
+  for (std::size_t i = 0; i < aborted.size(); ++i)
+    aborted[i].setAborted();
+
+  ROS_INFO_STREAM_NAMED("simulated_controller", "Spent " << getExecutionTime()
+                                                         << " simulated seconds executing");
+}
+
+double SimulatedController::getExecutionTime() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return execution_time_.toSec();
+}
+
+ros::Time SimulatedController::getSimulatedTime() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return simulated_time_;
+}
+
+void SimulatedController::goalCallback(ControllerPtr controller,
+                                       FollowJointTrajectoryServer::GoalHandle goal_handle)
+{
+  const trajectory_msgs::JointTrajectory& trajectory = goal_handle.getGoal()->trajectory;
+  control_msgs::FollowJointTrajectoryResult result;
+
+  // Map goal joints to our variables
+  std::vector<std::size_t> goal_indices;
+  for (std::size_t i = 0; i < trajectory.joint_names.size(); ++i)
+  {
+    std::map<std::string, std::size_t>::const_iterator it =
+        variable_indices_.find(trajectory.joint_names[i]);
+    if (it == variable_indices_.end() ||
+        std::find(controller->variable_indices_.begin(), controller->variable_indices_.end(),
+                  it->second) == controller->variable_indices_.end())
+    {
+      ROS_ERROR_STREAM_NAMED("simulated_controller", "Controller " << controller->name_
+                                                                   << " does not have joint "
+                                                                   << trajectory.joint_names[i]);
+      result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_JOINTS;
+      goal_handle.setRejected(result);
+      return;
+    }
+    goal_indices.push_back(it->second);
+  }
+
+  // Error check
+  bool valid = !trajectory.points.empty();
+  for (std::size_t i = 0; i < trajectory.points.size() && valid; ++i)
+    valid = trajectory.points[i].positions.size() == goal_indices.size();
+  if (!valid)
+  {
+    ROS_ERROR_STREAM_NAMED("simulated_controller", "Controller " << controller->name_
+                                                                 << " received invalid trajectory");
+    result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_GOAL;
+    goal_handle.setRejected(result);
+    return;
+  }
+  goal_handle.setAccepted();
+
+  bool replaced = false;
+  FollowJointTrajectoryServer::GoalHandle replaced_goal_handle;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (controller->active_)
+    {
+      replaced = true;
+      replaced_goal_handle = controller->goal_handle_;
+    }
+
+    controller->trajectory_ = trajectory;
+    controller->goal_indices_ = goal_indices;
+    controller->goal_handle_ = goal_handle;
+    controller->active_ = true;
+
+    // Start from where we are if the trajectory does not
+    if (trajectory.points.front().time_from_start > ros::Duration(0))
+    {
+      trajectory_msgs::JointTrajectoryPoint start_point;
+      for (std::size_t i = 0; i < goal_indices.size(); ++i)
+        start_point.positions.push_back(joint_state_msg_.position[goal_indices[i]]);
+      start_point.velocities.resize(goal_indices.size(), 0.0);
+      controller->trajectory_.points.insert(controller->trajectory_.points.begin(), start_point);
+    }
+
+    // Zero stamp means now
+    controller->start_time_ = simulated_time_;
+    if (!trajectory.header.stamp.isZero() && trajectory.header.stamp > simulated_time_)
+      controller->start_time_ = trajectory.header.stamp;
+  }
+
+  if (replaced)
+    replaced_goal_handle.setCanceled();
+
+  ROS_DEBUG_STREAM_NAMED("simulated_controller",
+                         "Controller " << controller->name_ << " executing "
+                                       << trajectory.points.back().time_from_start.toSec()
+                                       << " second trajectory");
+}
+
+void SimulatedController::cancelCallback(ControllerPtr controller,
+                                         FollowJointTrajectoryServer::GoalHandle goal_handle)
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!controller->active_ || controller->goal_handle_ != goal_handle)
+      return;
+    controller->active_ = false;  // stop where we are
+  }
+  goal_handle.setCanceled();
+}
+
+void SimulatedController::updateThread()
+{
+  const ros::WallDuration wall_period(period_.toSec() / real_time_factor_);
+  ros::WallTime next_update = ros::WallTime::now();
+
+  while (true)
+  {
+    std::vector<FollowJointTrajectoryServer::GoalHandle> finished;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (!running_)
+        break;
+
+      simulated_time_ += period_;
+
+      bool executing = false;
+      for (std::size_t i = 0; i < controllers_.size(); ++i)
+      {
+        Controller& controller = *controllers_[i];
+        if (!controller.active_ || simulated_time_ < controller.start_time_)
+          continue;
+        executing = true;
+
+        if (sampleTrajectory(controller, (simulated_time_ - controller.start_time_).toSec()))
+        {
+          controller.active_ = false;
+          finished.push_back(controller.goal_handle_);
+        }
+      }
+      if (executing)
+        execution_time_ += period_;
+
+      publishState();
+    }
+
+    // Report outside of our lock, the server takes its own
+    control_msgs::FollowJointTrajectoryResult result;
+    result.error_code = control_msgs::FollowJointTrajectoryResult::SUCCESSFUL;
+    for (std::size_t i = 0; i < finished.size(); ++i)
+      finished[i].setSucceeded(result);
+
+    // Keep a steady rate, but do not try to catch up after falling behind
+    next_update += wall_period;
+    const ros::WallTime now = ros::WallTime::now();
+    if (next_update > now)
+      (next_update - now).sleep();
+    else
+      next_update = now;
+  }
+}
+
+bool SimulatedController::sampleTrajectory(const Controller& controller, double time_from_start)
+{
+  const std::vector<trajectory_msgs::JointTrajectoryPoint>& points = controller.trajectory_.points;
+  const std::vector<std::size_t>& indices = controller.goal_indices_;
+
+  // Past the end
+  if (time_from_start >= points.back().time_from_start.toSec())
+  {
+    for (std::size_t j = 0; j < indices.size(); ++j)
+      joint_state_msg_.position[indices[j]] = points.back().positions[j];
+    return true;
+  }
+
+  // Find segment
+  std::size_t i = 0;
+  while (points[i + 1].time_from_start.toSec() <= time_from_start)
+    ++i;
+  const trajectory_msgs::JointTrajectoryPoint& from = points[i];
+  const trajectory_msgs::JointTrajectoryPoint& to = points[i + 1];
+  const double duration = (to.time_from_start - from.time_from_start).toSec();
+  const double s = (time_from_start - from.time_from_start.toSec()) / duration;
+
+  const bool cubic =
+      from.velocities.size() == indices.size() && to.velocities.size() == indices.size();
+  for (std::size_t j = 0; j < indices.size(); ++j)
+  {
+    double position;
+    if (cubic)
+    {
+      // Hermite spline
+      const double s2 = s * s;
+      const double s3 = s2 * s;
+      position = (2 * s3 - 3 * s2 + 1) * from.positions[j] +
+                 (s3 - 2 * s2 + s) * duration * from.velocities[j] +
+                 (-2 * s3 + 3 * s2) * to.positions[j] + (s3 - s2) * duration * to.velocities[j];
+    }
+    else
+      position = from.positions[j] + s * (to.positions[j] - from.positions[j]);
+
+    joint_state_msg_.position[indices[j]] = position;
+  }
+  return false;
+}
+
+void SimulatedController::publishState()
+{
+  if (publish_clock_)
+  {
+    rosgraph_msgs::Clock clock_msg;
+    clock_msg.clock = simulated_time_;
+    clock_pub_.publish(clock_msg);
+    joint_state_msg_.header.stamp = simulated_time_;
+  }
+  else
+    joint_state_msg_.header.stamp = ros::Time::now();
+
+  joint_state_pub_.publish(joint_state_msg_);
+}
+
+}  // end namespace
@@ -0,0 +1,102 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Stand in for the robot's trajectory controllers so that full runs can be timed offline.
+           Reads the same controller_list as moveit_simple_controller_manager
+*/
+
+// PickNik
+#include <picknik_main/simulated_controller.h>
+
+// MoveIt
+#include <moveit/robot_model_loader/robot_model_loader.h>
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "simulated_controller");
+  ros::NodeHandle nh("~");
+
+  double real_time_factor;
+  double update_rate;
+  bool publish_clock;
+  std::string controller_list_param;
+  nh.param("real_time_factor", real_time_factor, 1.0);
+  nh.param("update_rate", update_rate, 100.0);
+  nh.param("publish_clock", publish_clock, false);
+  nh.param("controller_list_param", controller_list_param, std::string("controller_list"));
+
+  if (real_time_factor <= 0 || update_rate <= 0)
+  {
+    ROS_ERROR_STREAM_NAMED("simulated_controller", "real_time_factor and update_rate must be "
+                                                   "positive");
+    return 1;
+  }
+
+  // Faster or slower than real time only works if everyone follows the simulated clock, otherwise
+  // the execution timeouts of the trajectory execution manager drift against the trajectories
+  if (real_time_factor != 1.0)
+  {
+    bool use_sim_time = false;
+    ros::param::get("/use_sim_time", use_sim_time);
+    if (!publish_clock || !use_sim_time)
+    {
+      ROS_ERROR_STREAM_NAMED("simulated_controller", "real_time_factor "
+                                                         << real_time_factor
+                                                         << " requires publish_clock and "
+                                                            "/use_sim_time to be true");
+      return 1;
+    }
+  }
+
+  // Start at the SRDF default state
+  robot_model_loader::RobotModelLoader robot_model_loader("robot_description");
+  moveit::core::RobotState initial_state(robot_model_loader.getModel());
+  initial_state.setToDefaultValues();
+
+  picknik_main::SimulatedController controller(initial_state, real_time_factor, update_rate,
+                                               publish_clock);
+
+  // Load controllers
+  XmlRpc::XmlRpcValue controller_list;
+  if (!nh.getParam(controller_list_param, controller_list) ||
+      controller_list.getType() != XmlRpc::XmlRpcValue::TypeArray)
+  {
+    ROS_ERROR_STREAM_NAMED("simulated_controller", "No controller list found on parameter "
+                                                       << nh.resolveName(controller_list_param));
+    return 1;
+  }
+  for (int i = 0; i < controller_list.size(); ++i)
+  {
+    XmlRpc::XmlRpcValue& entry = controller_list[i];
+    if (!entry.hasMember("name") || !entry.hasMember("joints") ||
+        entry["joints"].getType() != XmlRpc::XmlRpcValue::TypeArray)
+    {
+      ROS_ERROR_STREAM_NAMED("simulated_controller", "Controller entry " << i
+                                                                         << " needs name and joints");
+      return 1;
+    }
+    const std::string action_ns =
+        entry.hasMember("action_ns") ? std::string(entry["action_ns"]) : "follow_joint_trajectory";
+
+    std::vector<std::string> joints;
+    for (int j = 0; j < entry["joints"].size(); ++j)
+      joints.push_back(std::string(entry["joints"][j]));
+
+    if (!controller.addController(std::string(entry["name"]), action_ns, joints))
+      return 1;
+  }
+
+  controller.start();
+  ros::spin();
+  controller.stop();
+
+  return 0;
+}
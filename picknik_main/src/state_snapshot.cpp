@@ -0,0 +1,87 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Latest joint positions published by the state monitor, readable without the scene lock
+*/
+
+// PickNik
+#include <picknik_main/state_snapshot.h>
+
+namespace picknik_main
+{
+StateSnapshot::StateSnapshot(const std::vector<std::string>& variable_names,
+                             const std::vector<double>& initial_positions)
+  : variable_count_(variable_names.size())
+  , sequence_(0)
+  , positions_(new std::atomic<double>[variable_names.size()])
+  , stamp_nsec_(0)
+  , read_retries_(0)
+{
+  for (std::size_t i = 0; i < variable_count_; ++i)
+  {
+    variable_indices_[variable_names[i]] = i;
+    positions_[i].store(i < initial_positions.size() ? initial_positions[i] : 0.0,
+                        std::memory_order_relaxed);
+  }
+}
+
+void StateSnapshot::update(const sensor_msgs::JointStateConstPtr& joint_state)
+{
+  boost::mutex::scoped_lock lock(write_mutex_);
+
+  // Mark write in progress
+  const std::size_t sequence = sequence_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  const std::size_t count = std::min(joint_state->name.size(), joint_state->position.size());
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::map<std::string, std::size_t>::const_iterator it =
+        variable_indices_.find(joint_state->name[i]);
+    if (it == variable_indices_.end())
+      continue;
+    positions_[it->second].store(joint_state->position[i], std::memory_order_relaxed);
+  }
+  stamp_nsec_.store(joint_state->header.stamp.toNSec(), std::memory_order_relaxed);
+
+  // Mark write done
+  sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+bool StateSnapshot::read(std::vector<double>& positions, ros::Time& stamp) const
+{
+  positions.resize(variable_count_);
+
+  while (true)
+  {
+    const std::size_t before = sequence_.load(std::memory_order_acquire);
+    if (before == 0)
+      return false;  // nothing published yet
+
+    if (before % 2 == 0)
+    {
+      for (std::size_t i = 0; i < variable_count_; ++i)
+        positions[i] = positions_[i].load(std::memory_order_relaxed);
+      int64_t stamp_nsec = stamp_nsec_.load(std::memory_order_relaxed);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == before)
+      {
+        stamp.fromNSec(stamp_nsec);
+        return true;
+      }
+    }
+    read_retries_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+}  // end namespace
@@ -19,15 +19,59 @@
 #include <std_msgs/Bool.h>
 #include <std_msgs/Float64MultiArray.h>
 
+// Boost
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+// C++
+#include <algorithm>
+
 namespace picknik_main
 {
+// Samples of history kept for consumers that look at a window
+static const std::size_t TACTILE_HISTORY_SIZE = 1024;
+
 TactileFeedback::TactileFeedback(ManipulationDataPtr config)
-  : sheer_theta_(0.0)
-  , end_effector_data_cached_(ALWAYS_AT_END, 0.0)  // initial dummy data
+  : tactile_ring_(new TactileRing(TACTILE_HISTORY_SIZE))
+  , visualization_rate_(config->tactile_visualization_rate_)
+  , running_(true)
+  , reset_filter_(false)
 {
+  // Load filter
+  TactileFilterSettings filter_settings;
+  if (!TactileFilter::parseType(config->tactile_filter_type_, filter_settings.type_))
+    ROS_ERROR_STREAM_NAMED("tactile_feedback", "Unknown tactile filter type '"
+                                                   << config->tactile_filter_type_
+                                                   << "', not filtering");
+  filter_settings.median_window_ = config->tactile_filter_median_window_;
+  filter_settings.ema_alpha_ = config->tactile_filter_ema_alpha_;
+  filter_settings.one_euro_min_cutoff_ = config->tactile_filter_one_euro_min_cutoff_;
+  filter_settings.one_euro_beta_ = config->tactile_filter_one_euro_beta_;
+  filter_settings.one_euro_d_cutoff_ = config->tactile_filter_one_euro_d_cutoff_;
+  filter_settings.kalman_process_noise_ = config->tactile_filter_kalman_process_noise_;
+  filter_settings.kalman_measurement_noise_ = config->tactile_filter_kalman_measurement_noise_;
+  tactile_filter_.reset(new TactileFilter(filter_settings));
+  ROS_INFO_STREAM_NAMED("tactile_feedback", "Filtering tactile data with '"
+                                                << config->tactile_filter_type_ << "', latency about "
+                                                << tactile_filter_->getLatencySamples()
+                                                << " samples");
+
   // Load visual tools
   visual_tools_.reset(new rviz_visual_tools::RvizVisualTools(config->robot_base_frame_,
                                                              "/picknik_main/tactile_feedback"));
+  visualization_thread_ = boost::thread(boost::bind(&TactileFeedback::visualizationThread, this));
+
+  // Save raw data for offline tuning with tactile_replay_node
+  if (config->tactile_record_)
+  {
+    namespace fs = boost::filesystem;
+    fs::path directory(config->package_path_ + "/trajectories/analysis/");
+    boost::system::error_code returned_error;
+    fs::create_directories(directory, returned_error);
+    const std::string file_name =
+        "tactile_" + boost::lexical_cast<std::string>(ros::WallTime::now().sec) + ".bin";
+    tactile_recorder_.reset(new TactileRecorder((directory / file_name).string()));
+  }
 
   const std::size_t queue_size = 1;
   end_effector_data_sub_ =
@@ -36,11 +80,23 @@ TactileFeedback::TactileFeedback(ManipulationDataPtr config)
   tactile_calibration_pub_ = nh_.advertise<std_msgs::Bool>("/calibrate_tactile_sensor", queue_size);
 }
 
+TactileFeedback::~TactileFeedback()
+{
+  end_effector_data_sub_.shutdown();
+  running_ = false;
+  visualization_thread_.join();
+  tactile_filter_->printStats();
+  tactile_recorder_.reset();
+}
+
 void TactileFeedback::recalibrateTactileSensor()
 {
   ROS_INFO_STREAM_NAMED("tactile_feedback", "Recalibrating");
   std_msgs::Bool msg;
   tactile_calibration_pub_.publish(msg);
+
+  // Old history is relative to the previous calibration
+  reset_filter_ = true;
 }
 
 void TactileFeedback::dataCallback(const std_msgs::Float64MultiArray::ConstPtr& msg)
@@ -54,29 +110,161 @@ void TactileFeedback::dataCallback(const std_msgs::Float64MultiArray::ConstPtr&
     return;
   }
 
-  // Save latest data
-  end_effector_data_cached_ = msg->data;
+  addSample(ros::Time::now(), &msg->data[0]);
+}
+
+void TactileFeedback::addSample(const ros::Time& stamp, const double* data)
+{
+  if (tactile_recorder_)
+    tactile_recorder_->recordSample(stamp, data);
+
+  // Save latest data, without allocating
+  TactileSample sample;
+  sample.stamp_ = stamp;
+  std::copy(data, data + ALWAYS_AT_END, sample.data_);
+
+  // Reduce noise
+  if (reset_filter_.exchange(false))
+    tactile_filter_->reset();
+  tactile_filter_->filter(sample);
 
-  // displayLineDirection();
-  displaySheerForce();
+  sample.sheer_theta_ = computeSheerTheta(sample);
+  tactile_ring_->push(sample);
 
   // Do callback if provided
   if (end_effector_data_callback_)
     end_effector_data_callback_();
 }
 
-void TactileFeedback::displayLineDirection()
+void TactileFeedback::recordCommand(const Eigen::Affine3d& pose, double duration)
+{
+  if (tactile_recorder_)
+    tactile_recorder_->recordCommand(ros::Time::now(), pose, duration);
+}
+
+bool TactileFeedback::computeInsertionRotation(double sheer_torque, double torque_min,
+                                               double torque_max, double torque_scale,
+                                               double& rotation)
+{
+  // Max threshold, absolute
+  double torque = std::max(std::min(sheer_torque, torque_max), -torque_max);
+
+  // Min threshold, absolute
+  if (fabs(torque) < torque_min)
+  {
+    rotation = 0.0;
+    return false;
+  }
+
+  // Remove bottom of torque so that there are no jumps after the min
+  if (torque > 0)
+    torque -= torque_min;
+  else
+    torque += torque_min;
+
+  // Scale torque to output rotation
+  rotation = torque * torque_scale;
+  return true;
+}
+
+bool TactileFeedback::isSheerForceSteady(const ros::Time& since, const ros::Duration& window,
+                                         double threshold)
+{
+  // Without a sensor, or one that has gone quiet, there is nothing to wait for
+  TactileSample latest;
+  if (!tactile_ring_->getLatest(latest) || latest.stamp_ < since)
+    return true;
+
+  // The window must lie entirely after since
+  const ros::Time window_start = latest.stamp_ - window;
+  if (window_start < since)
+    return false;
+
+  // Read more history until it reaches back past the window
+  std::size_t count = 32;
+  while (true)
+  {
+    tactile_ring_->getWindow(count, steady_samples_);
+    if (steady_samples_.front().stamp_ < window_start || steady_samples_.size() < count ||
+        count >= tactile_ring_->getCapacity())
+      break;
+    count *= 2;
+  }
+
+  double min_force = latest.data_[SHEER_FORCE];
+  double max_force = min_force;
+  for (std::size_t i = steady_samples_.size(); i-- > 0;)
+  {
+    if (steady_samples_[i].stamp_ < window_start)
+      break;
+    min_force = std::min(min_force, steady_samples_[i].data_[SHEER_FORCE]);
+    max_force = std::max(max_force, steady_samples_[i].data_[SHEER_FORCE]);
+  }
+  return max_force - min_force <= threshold;
+}
+
+double TactileFeedback::getLatestValue(std::size_t field)
+{
+  TactileSample sample;
+  if (!tactile_ring_->getLatest(sample))
+    return 0.0;
+  return field == ALWAYS_AT_END ? sample.sheer_theta_ : sample.data_[field];
+}
+
+double TactileFeedback::computeSheerTheta(const TactileSample& sample)
+{
+  const double& image_height = sample.data_[IMAGE_HEIGHT];
+  const double& image_width = sample.data_[IMAGE_WIDTH];
+
+  // From the center of the sensor to the sheer displacement
+  geometry_msgs::Pose pt1;
+  pt1.position.x = image_height / 2.0;
+  pt1.position.y = image_width / 2.0;
+  geometry_msgs::Pose pt2;
+  pt2.position.x = sample.data_[SHEER_DISPLACEMENT_X];
+  pt2.position.y = sample.data_[SHEER_DISPLACEMENT_Y];
+
+  // Convert to meters
+  convertPixelToMeters(pt1, image_height, image_width);
+  convertPixelToMeters(pt2, image_height, image_width);
+
+  // Find the angle between the line and the horizontal (x) axis
+  double delta_y = pt2.position.y - pt1.position.y;
+  double delta_x = pt2.position.x - pt1.position.x;
+  return atan2(delta_y, delta_x);  // radians
+}
+
+void TactileFeedback::visualizationThread()
+{
+  std::size_t displayed_count = 0;
+  ros::WallRate rate(visualization_rate_);
+  while (running_ && ros::ok())
+  {
+    // Only draw when there is something new
+    TactileSample sample;
+    const std::size_t push_count = tactile_ring_->getPushCount();
+    if (push_count != displayed_count && tactile_ring_->getLatest(sample))
+    {
+      displayed_count = push_count;
+      // displayLineDirection(sample);
+      displaySheerForce(sample);
+    }
+    rate.sleep();
+  }
+}
+
+void TactileFeedback::displayLineDirection(const TactileSample& sample)
 {
   bool verbose = false;
 
   // Unpack vector to variable names
-  const double& pt1_x = end_effector_data_cached_[LINE_CENTER_X];
-  const double& pt1_y = end_effector_data_cached_[LINE_CENTER_Y];
-  const double& eigen_vec_x = end_effector_data_cached_[LINE_EIGEN_VEC_X];
-  const double& eigen_vec_y = end_effector_data_cached_[LINE_EIGEN_VEC_Y];
-  const double& eigen_vec_val = end_effector_data_cached_[LINE_EIGEN_VAL];
-  const double& image_height = end_effector_data_cached_[IMAGE_HEIGHT];
-  const double& image_width = end_effector_data_cached_[IMAGE_WIDTH];
+  const double& pt1_x = sample.data_[LINE_CENTER_X];
+  const double& pt1_y = sample.data_[LINE_CENTER_Y];
+  const double& eigen_vec_x = sample.data_[LINE_EIGEN_VEC_X];
+  const double& eigen_vec_y = sample.data_[LINE_EIGEN_VEC_Y];
+  const double& eigen_vec_val = sample.data_[LINE_EIGEN_VAL];
+  const double& image_height = sample.data_[IMAGE_HEIGHT];
+  const double& image_width = sample.data_[IMAGE_WIDTH];
 
   // Calculate point 2
   const double distance_between_points = 2000;
@@ -141,12 +329,12 @@ void TactileFeedback::displayLineDirection()
   visual_tools_->publishArrow(pose_msg, rvt::GREY, rvt::SMALL, length, id);
 }
 
-void TactileFeedback::displaySheerForce()
+void TactileFeedback::displaySheerForce(const TactileSample& sample)
 {
-  const double& sheer_displacement_x = end_effector_data_cached_[SHEER_DISPLACEMENT_X];
-  const double& sheer_displacement_y = end_effector_data_cached_[SHEER_DISPLACEMENT_Y];
-  const double& image_height = end_effector_data_cached_[IMAGE_HEIGHT];
-  const double& image_width = end_effector_data_cached_[IMAGE_WIDTH];
+  const double& sheer_displacement_x = sample.data_[SHEER_DISPLACEMENT_X];
+  const double& sheer_displacement_y = sample.data_[SHEER_DISPLACEMENT_Y];
+  const double& image_height = sample.data_[IMAGE_HEIGHT];
+  const double& image_width = sample.data_[IMAGE_WIDTH];
 
   // Convert to ROS msg
   geometry_msgs::PoseStamped pt1;
@@ -172,15 +360,8 @@ void TactileFeedback::displaySheerForce()
   // Visualize tool always pointing down away from gripper
   Eigen::Affine3d eigen_pose = visual_tools_->convertPose(pt1.pose);
 
-  // Find the angle between the line and the horizontal (x) axis
-  double delta_y = pt2.pose.position.y - pt1.pose.position.y;
-  double delta_x = pt2.pose.position.x - pt1.pose.position.x;
-
-  // Save for later use
-  sheer_theta_ = atan2(delta_y, delta_x);  // radians
-
   // Create new pose
-  eigen_pose = eigen_pose * Eigen::AngleAxisd(sheer_theta_, Eigen::Vector3d::UnitZ());
+  eigen_pose = eigen_pose * Eigen::AngleAxisd(sample.sheer_theta_, Eigen::Vector3d::UnitZ());
 
   geometry_msgs::PoseStamped pose_msg;
   pose_msg.header.frame_id = ATTACH_FRAME;
@@ -190,7 +371,7 @@ void TactileFeedback::displaySheerForce()
   static const double VISUAL_MAX_LENGTH = 0.5;  // based on personal visual preferance
   static const double SHEER_FORCE_MAX = 20;     // ignore sheer force higher than this
   static const double SHEER_RATIO = VISUAL_MAX_LENGTH / SHEER_FORCE_MAX;
-  double sheer_force = std::min(SHEER_FORCE_MAX, getSheerForce());
+  double sheer_force = std::min(SHEER_FORCE_MAX, sample.data_[SHEER_FORCE]);
   const double length = sheer_force * SHEER_RATIO;
   const int id = 1;
   visual_tools_->publishArrow(pose_msg, rvt::RED, rvt::REGULAR, length, id);
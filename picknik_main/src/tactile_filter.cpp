@@ -0,0 +1,244 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Per channel noise filtering of tactile sensor data before controllers react to it
+*/
+
+// PickNik
+#include <picknik_main/tactile_filter.h>
+
+// C++
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace picknik_main
+{
+namespace
+{
+// Used for the first sample and when stamps do not move forward
+const double DEFAULT_DT = 0.01;
+
+// Low pass weight of the newest sample for a cutoff frequency
+double smoothingFactor(double dt, double cutoff)
+{
+  const double tau = 1.0 / (2.0 * M_PI * cutoff);
+  return 1.0 / (1.0 + tau / dt);
+}
+}  // end anonymous namespace
+
+const std::size_t TactileFilter::MAX_MEDIAN_WINDOW;
+
+TactileFilterSettings::TactileFilterSettings()
+  : type_(TACTILE_FILTER_NONE)
+  , median_window_(5)
+  , ema_alpha_(0.3)
+  , one_euro_min_cutoff_(1.0)
+  , one_euro_beta_(0.05)
+  , one_euro_d_cutoff_(1.0)
+  , kalman_process_noise_(1.0)
+  , kalman_measurement_noise_(1.0)
+{
+}
+
+TactileFilter::TactileFilter(const TactileFilterSettings& settings)
+  : settings_(settings), samples_(0), cost_sum_nsec_(0), cost_max_nsec_(0)
+{
+  // Keep the median window odd and within the fixed storage
+  int window = std::max(1, std::min(settings_.median_window_, int(MAX_MEDIAN_WINDOW)));
+  if (window % 2 == 0)
+    window--;
+  if (window != settings_.median_window_ && settings_.type_ == TACTILE_FILTER_MEDIAN)
+    ROS_WARN_STREAM_NAMED("tactile_filter", "Median window changed from "
+                                                << settings_.median_window_ << " to " << window);
+  settings_.median_window_ = window;
+  settings_.ema_alpha_ = std::max(0.0, std::min(1.0, settings_.ema_alpha_));
+
+  reset();
+}
+
+bool TactileFilter::parseType(const std::string& name, TactileFilterType& type)
+{
+  if (name == "none")
+    type = TACTILE_FILTER_NONE;
+  else if (name == "median")
+    type = TACTILE_FILTER_MEDIAN;
+  else if (name == "ema")
+    type = TACTILE_FILTER_EMA;
+  else if (name == "one_euro")
+    type = TACTILE_FILTER_ONE_EURO;
+  else if (name == "kalman")
+    type = TACTILE_FILTER_KALMAN;
+  else
+    return false;
+  return true;
+}
+
+void TactileFilter::reset()
+{
+  initialized_ = false;
+  median_count_ = 0;
+  median_next_ = 0;
+  std::fill(estimate_, estimate_ + ALWAYS_AT_END, 0.0);
+  std::fill(derivative_, derivative_ + ALWAYS_AT_END, 0.0);
+  std::fill(variance_, variance_ + ALWAYS_AT_END, 0.0);
+}
+
+void TactileFilter::filter(TactileSample& sample)
+{
+  if (settings_.type_ == TACTILE_FILTER_NONE)
+    return;
+
+  const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+  double dt = DEFAULT_DT;
+  if (initialized_ && sample.stamp_ > last_stamp_)
+    dt = (sample.stamp_ - last_stamp_).toSec();
+  last_stamp_ = sample.stamp_;
+
+  // Start from the first measurement rather than pulling up from zero
+  if (!initialized_)
+  {
+    for (std::size_t i = 0; i < ALWAYS_AT_END; ++i)
+    {
+      estimate_[i] = sample.data_[i];
+      variance_[i] = settings_.kalman_measurement_noise_;
+    }
+  }
+
+  for (std::size_t i = 0; i < ALWAYS_AT_END; ++i)
+  {
+    if (!isFiltered(i))
+      continue;
+
+    switch (settings_.type_)
+    {
+      case TACTILE_FILTER_MEDIAN:
+        sample.data_[i] = filterMedian(i, sample.data_[i]);
+        break;
+      case TACTILE_FILTER_EMA:
+        sample.data_[i] = filterEMA(i, sample.data_[i]);
+        break;
+      case TACTILE_FILTER_ONE_EURO:
+        sample.data_[i] = filterOneEuro(i, sample.data_[i], dt);
+        break;
+      case TACTILE_FILTER_KALMAN:
+        sample.data_[i] = filterKalman(i, sample.data_[i], dt);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Median history advances once for all channels
+  if (settings_.type_ == TACTILE_FILTER_MEDIAN)
+  {
+    median_next_ = (median_next_ + 1) % settings_.median_window_;
+    median_count_ = std::min(median_count_ + 1, std::size_t(settings_.median_window_));
+  }
+  initialized_ = true;
+
+  // Measure cost
+  const int64_t cost = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start_time).count();
+  samples_++;
+  cost_sum_nsec_ += cost;
+  if (cost > cost_max_nsec_)
+    cost_max_nsec_ = cost;
+}
+
+double TactileFilter::filterMedian(std::size_t channel, double value)
+{
+  median_history_[channel][median_next_] = value;
+  const std::size_t count = std::min(median_count_ + 1, std::size_t(settings_.median_window_));
+
+  double sorted[MAX_MEDIAN_WINDOW];
+  std::copy(median_history_[channel], median_history_[channel] + count, sorted);
+  std::nth_element(sorted, sorted + count / 2, sorted + count);
+  return sorted[count / 2];
+}
+
+double TactileFilter::filterEMA(std::size_t channel, double value)
+{
+  estimate_[channel] += settings_.ema_alpha_ * (value - estimate_[channel]);
+  return estimate_[channel];
+}
+
+double TactileFilter::filterOneEuro(std::size_t channel, double value, double dt)
+{
+  // Smoothed speed of the signal
+  const double speed = (value - estimate_[channel]) / dt;
+  derivative_[channel] +=
+      smoothingFactor(dt, settings_.one_euro_d_cutoff_) * (speed - derivative_[channel]);
+
+  // Faster signals get a higher cutoff, i.e. less lag
+  const double cutoff =
+      settings_.one_euro_min_cutoff_ + settings_.one_euro_beta_ * fabs(derivative_[channel]);
+  estimate_[channel] += smoothingFactor(dt, cutoff) * (value - estimate_[channel]);
+  return estimate_[channel];
+}
+
+double TactileFilter::filterKalman(std::size_t channel, double value, double dt)
+{
+  // Predict
+  variance_[channel] += settings_.kalman_process_noise_ * dt;
+
+  // Update
+  const double gain = variance_[channel] / (variance_[channel] + settings_.kalman_measurement_noise_);
+  estimate_[channel] += gain * (value - estimate_[channel]);
+  variance_[channel] *= 1.0 - gain;
+  return estimate_[channel];
+}
+
+double TactileFilter::getLatencySamples() const
+{
+  switch (settings_.type_)
+  {
+    case TACTILE_FILTER_MEDIAN:
+      return (settings_.median_window_ - 1) / 2.0;
+    case TACTILE_FILTER_EMA:
+      // Mean delay of the exponential weights
+      return settings_.ema_alpha_ > 0.0 ? (1.0 - settings_.ema_alpha_) / settings_.ema_alpha_ : 0.0;
+    case TACTILE_FILTER_ONE_EURO:
+    {
+      // Worst case, when the signal is still and the cutoff is lowest
+      const double alpha = smoothingFactor(DEFAULT_DT, settings_.one_euro_min_cutoff_);
+      return (1.0 - alpha) / alpha;
+    }
+    case TACTILE_FILTER_KALMAN:
+    {
+      // Steady state gain of the scalar filter
+      const double q = settings_.kalman_process_noise_ * DEFAULT_DT;
+      const double r = settings_.kalman_measurement_noise_;
+      const double prior = (q + sqrt(q * q + 4.0 * q * r)) / 2.0;
+      const double gain = prior / (prior + r);
+      return gain > 0.0 ? (1.0 - gain) / gain : 0.0;
+    }
+    default:
+      return 0.0;
+  }
+}
+
+void TactileFilter::printStats() const
+{
+  ROS_INFO_STREAM_NAMED("tactile_filter", "Filtered " << samples_ << " samples, cost mean "
+                                                      << getMeanCostNSec() / 1000.0 << " us, max "
+                                                      << cost_max_nsec_ / 1000.0
+                                                      << " us, latency about "
+                                                      << getLatencySamples() << " samples");
+}
+
+bool TactileFilter::isFiltered(std::size_t channel)
+{
+  return channel != IMAGE_HEIGHT && channel != IMAGE_WIDTH;
+}
+
+}  // end namespace
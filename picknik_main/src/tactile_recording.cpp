@@ -0,0 +1,248 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Record raw tactile data and commanded poses to a compact binary file, and play it back
+           at any speed so that insertion tuning can be done offline
+*/
+
+// PickNik
+#include <picknik_main/tactile_recording.h>
+
+// C++
+#include <chrono>
+#include <thread>
+
+namespace picknik_main
+{
+namespace
+{
+// File layout, host byte order:
+//   uint32 magic, uint32 version,
+//   per record: uint8 type, int64 stamp nsec, uint8 value count, doubles
+const uint32_t FILE_MAGIC = 0x5454504e;  // "NPTT"
+const uint32_t FILE_VERSION = 1;
+
+// Records that can wait for the writer, about ten seconds of sensor data
+const std::size_t QUEUE_CAPACITY = 4096;
+
+// Milliseconds between flushes by the writer
+const int WRITE_PERIOD_MS = 50;
+
+template <typename T>
+void write(std::ostream& output, const T& value)
+{
+  output.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool read(std::istream& input, T& value)
+{
+  return static_cast<bool>(input.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+}  // end anonymous namespace
+
+TactileRecorder::TactileRecorder(const std::string& file_path)
+  : file_path_(file_path)
+  , queue_(QUEUE_CAPACITY)
+  , running_(true)
+  , recorded_(0)
+  , dropped_(0)
+  , written_bytes_(0)
+{
+  output_file_.open(file_path_.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!output_file_.is_open())
+    ROS_ERROR_STREAM_NAMED("tactile_recording", "Unable to open tactile recording " << file_path_);
+  else
+  {
+    write(output_file_, FILE_MAGIC);
+    write(output_file_, FILE_VERSION);
+    ROS_INFO_STREAM_NAMED("tactile_recording", "Recording tactile data to " << file_path_);
+  }
+
+  writer_thread_ = boost::thread(boost::bind(&TactileRecorder::writerThread, this));
+}
+
+TactileRecorder::~TactileRecorder()
+{
+  running_ = false;
+  writer_thread_.join();
+  printStats();
+}
+
+void TactileRecorder::recordSample(const ros::Time& stamp, const double* data)
+{
+  TactileRecord record;
+  record.type_ = TACTILE_RECORD_SAMPLE;
+  record.stamp_nsec_ = stamp.toNSec();
+  std::copy(data, data + ALWAYS_AT_END, record.values_);
+  push(record);
+}
+
+void TactileRecorder::recordCommand(const ros::Time& stamp, const Eigen::Affine3d& pose,
+                                    double duration)
+{
+  const Eigen::Quaterniond rotation(pose.rotation());
+
+  TactileRecord record;
+  record.type_ = TACTILE_RECORD_COMMAND;
+  record.stamp_nsec_ = stamp.toNSec();
+  record.values_[0] = pose.translation().x();
+  record.values_[1] = pose.translation().y();
+  record.values_[2] = pose.translation().z();
+  record.values_[3] = rotation.x();
+  record.values_[4] = rotation.y();
+  record.values_[5] = rotation.z();
+  record.values_[6] = rotation.w();
+  record.values_[7] = duration;
+  push(record);
+}
+
+void TactileRecorder::push(const TactileRecord& record)
+{
+  recorded_++;
+  if (!queue_.bounded_push(record))
+    dropped_++;
+}
+
+void TactileRecorder::printStats() const
+{
+  ROS_INFO_STREAM_NAMED("tactile_recording", "Tactile recording " << file_path_ << ": "
+                                                                  << recorded_ << " recorded, "
+                                                                  << written_bytes_
+                                                                  << " bytes written, " << dropped_
+                                                                  << " dropped");
+}
+
+void TactileRecorder::writerThread()
+{
+  while (running_)
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(WRITE_PERIOD_MS));
+    drain();
+  }
+
+  // Anything pushed before shutdown
+  drain();
+}
+
+void TactileRecorder::drain()
+{
+  TactileRecord record;
+  bool wrote = false;
+  while (queue_.pop(record))
+  {
+    if (!output_file_.is_open())
+      continue;
+
+    const uint8_t count = record.getValueCount();
+    write(output_file_, record.type_);
+    write(output_file_, record.stamp_nsec_);
+    write(output_file_, count);
+    output_file_.write(reinterpret_cast<const char*>(record.values_), count * sizeof(double));
+    written_bytes_ += sizeof(record.type_) + sizeof(record.stamp_nsec_) + sizeof(count) +
+                      count * sizeof(double);
+    wrote = true;
+  }
+  if (wrote)
+    output_file_.flush();
+}
+
+bool TactileRecorder::readFile(const std::string& file_path, std::vector<TactileRecord>& records)
+{
+  std::ifstream input(file_path.c_str(), std::ios::in | std::ios::binary);
+  if (!input.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("tactile_recording", "Unable to open " << file_path);
+    return false;
+  }
+
+  uint32_t magic;
+  uint32_t version;
+  if (!read(input, magic) || !read(input, version) || magic != FILE_MAGIC ||
+      version != FILE_VERSION)
+  {
+    ROS_ERROR_STREAM_NAMED("tactile_recording", file_path << " is not a tactile recording");
+    return false;
+  }
+
+  records.clear();
+  TactileRecord record;
+  uint8_t count;
+  while (read(input, record.type_) && read(input, record.stamp_nsec_) && read(input, count))
+  {
+    if (count != record.getValueCount() ||
+        !input.read(reinterpret_cast<char*>(record.values_), count * sizeof(double)))
+    {
+      ROS_WARN_STREAM_NAMED("tactile_recording", "Recording truncated after " << records.size()
+                                                                              << " records");
+      break;
+    }
+    records.push_back(record);
+  }
+  return true;
+}
+
+void TactileRecorder::getCommandPose(const TactileRecord& record, Eigen::Affine3d& pose,
+                                     double& duration)
+{
+  const double* values = record.values_;
+  pose = Eigen::Translation3d(values[0], values[1], values[2]) *
+         Eigen::Quaterniond(values[6], values[3], values[4], values[5]);
+  duration = values[7];
+}
+
+TactileReplay::TactileReplay(const std::vector<TactileRecord>& records) : records_(records) {}
+
+bool TactileReplay::play(double speed, const SampleCallback& sample_callback,
+                         const CommandCallback& command_callback)
+{
+  if (records_.empty())
+    return true;
+
+  // Schedule against the start so that callback time does not accumulate as drift
+  const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+  const int64_t first_stamp = records_.front().stamp_nsec_;
+
+  ros::Time stamp;
+  Eigen::Affine3d pose;
+  double duration;
+  for (std::size_t i = 0; i < records_.size(); ++i)
+  {
+    const TactileRecord& record = records_[i];
+
+    if (speed > 0)
+    {
+      if (!ros::ok())
+        return false;
+      const int64_t offset = (record.stamp_nsec_ - first_stamp) / speed;
+      std::this_thread::sleep_until(start_time + std::chrono::nanoseconds(offset));
+    }
+
+    stamp.fromNSec(record.stamp_nsec_);
+    if (record.type_ == TACTILE_RECORD_SAMPLE)
+      sample_callback(stamp, record.values_);
+    else if (command_callback)
+    {
+      TactileRecorder::getCommandPose(record, pose, duration);
+      command_callback(stamp, pose, duration);
+    }
+  }
+  return true;
+}
+
+double TactileReplay::getDuration() const
+{
+  if (records_.empty())
+    return 0.0;
+  return (records_.back().stamp_nsec_ - records_.front().stamp_nsec_) / 1e9;
+}
+
+}  // end namespace
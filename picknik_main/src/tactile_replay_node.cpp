@@ -0,0 +1,322 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Play back a tactile recording. By default the insertion torque controller is run
+           against it headlessly, as fast as possible, to compare filter and gain settings. With
+           ~publish the raw data is sent on /end_effector_data instead, for running the full
+           pipeline against e.g. the simulated controller. Filter and insertion settings must be
+           loaded from the picknik config, there are no defaults
+*/
+
+// PickNik
+#include <picknik_main/tactile_recording.h>
+#include <picknik_main/tactile_filter.h>
+#include <picknik_main/insertion_controller.h>
+
+// Parameter loading
+#include <ros_param_utilities/ros_param_utilities.h>
+
+// ROS
+#include <std_msgs/Float64MultiArray.h>
+
+// C++
+#include <chrono>
+
+namespace picknik_main
+{
+/** \brief Result of running the insertion controller over a recording */
+struct ReplayResult
+{
+  ReplayResult()
+    : samples_(0)
+    , insertions_(0)
+    , time_to_depth_(0)
+    , steps_(0)
+    , corrections_(0)
+    , stale_samples_(0)
+    , travelled_(0)
+    , net_rotation_(0)
+    , max_rotation_(0)
+  {
+  }
+
+  std::size_t samples_;
+  std::size_t insertions_;  // goals that reached full depth
+  double time_to_depth_;    // seconds, summed over completed goals
+  std::size_t steps_;
+  std::size_t corrections_;
+  std::size_t stale_samples_;  // ticks where the newest sample was too old to use
+  double travelled_;           // meters
+  double net_rotation_;  // radians about the tool y axis
+  double max_rotation_;  // largest single correction
+};
+
+/**
+ * \brief Runs the same InsertionStepper as InsertionController, ticking on recorded commands or a
+ *        fixed period instead of a clock. A new goal starts whenever the last reached full depth
+ */
+class HeadlessInsertion
+{
+public:
+  /**
+   * \brief Constructor
+   * \param step_duration - seconds between ticks, 0 to tick when the recording has a command
+   */
+  HeadlessInsertion(const InsertionGoal& goal, TactileFilterPtr filter, double step_duration)
+    : goal_(goal), filter_(filter), step_duration_(step_duration), has_sample_(false)
+  {
+  }
+
+  void sampleCallback(const ros::Time& stamp, const double* data)
+  {
+    std::copy(data, data + ALWAYS_AT_END, latest_.data_);
+    latest_.stamp_ = stamp;
+    filter_->filter(latest_);
+    has_sample_ = true;
+    result_.samples_++;
+
+    // Fixed step rate instead of the recorded commands
+    if (step_duration_ > 0)
+    {
+      if (next_step_.isZero())
+        next_step_ = stamp;
+      while (stamp >= next_step_)
+      {
+        step(next_step_);
+        next_step_ += ros::Duration(step_duration_);
+      }
+    }
+  }
+
+  void commandCallback(const ros::Time& stamp, const Eigen::Affine3d& pose, double duration)
+  {
+    if (step_duration_ <= 0)
+      step(stamp);
+  }
+
+  /** \brief Include the goal still running when the recording ended */
+  const ReplayResult& finish()
+  {
+    if (!goal_start_.isZero())
+      addStepperResult();
+    goal_start_ = ros::Time();
+    return result_;
+  }
+
+private:
+  /** \brief One tick of the control loop */
+  void step(const ros::Time& stamp)
+  {
+    if (!has_sample_)
+      return;
+
+    if (goal_start_.isZero())
+    {
+      stepper_.reset(goal_);
+      goal_start_ = stamp;
+    }
+
+    stepper_.step(stepper_.needsTactile() ? &latest_ : NULL, stamp);
+
+    if (stepper_.isDone())
+    {
+      result_.insertions_++;
+      result_.time_to_depth_ += (stamp - goal_start_).toSec();
+      addStepperResult();
+      goal_start_ = ros::Time();
+    }
+  }
+
+  void addStepperResult()
+  {
+    result_.steps_ += stepper_.getSteps();
+    result_.corrections_ += stepper_.getCorrections();
+    result_.stale_samples_ += stepper_.getStaleSamples();
+    result_.travelled_ += stepper_.getTravelled();
+    result_.net_rotation_ += stepper_.getNetRotation();
+    result_.max_rotation_ = std::max(result_.max_rotation_, stepper_.getMaxRotation());
+  }
+
+  InsertionGoal goal_;
+  InsertionStepper stepper_;
+  TactileFilterPtr filter_;
+  double step_duration_;
+
+  TactileSample latest_;
+  bool has_sample_;
+  ros::Time next_step_;
+  ros::Time goal_start_;  // zero between goals
+  ReplayResult result_;
+};
+
+}  // end namespace
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "tactile_replay");
+  ros::NodeHandle nh("~");
+
+  using namespace picknik_main;
+
+  std::string file_path;
+  double speed;
+  bool publish;
+  nh.param("file", file_path, std::string());
+  nh.param("speed", speed, 0.0);
+  nh.param("publish", publish, false);
+
+  std::vector<TactileRecord> records;
+  if (file_path.empty() || !TactileRecorder::readFile(file_path, records))
+  {
+    ROS_ERROR_STREAM_NAMED("tactile_replay", "Set ~file to a recording made with tactile_record");
+    return 1;
+  }
+  TactileReplay replay(records);
+  ROS_INFO_STREAM_NAMED("tactile_replay", "Loaded " << records.size() << " records covering "
+                                                    << replay.getDuration() << " seconds");
+
+  const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+  // Feed the live pipeline
+  if (publish)
+  {
+    if (speed <= 0)
+      ROS_WARN_STREAM_NAMED("tactile_replay", "Publishing without waiting, subscribers with a "
+                                              "small queue will miss most samples");
+
+    ros::Publisher end_effector_data_pub =
+        nh.advertise<std_msgs::Float64MultiArray>("/end_effector_data", 100);
+    ros::Duration(1.0).sleep();  // let subscribers connect
+
+    std_msgs::Float64MultiArray msg;
+    msg.data.resize(ALWAYS_AT_END);
+    replay.play(speed, [&](const ros::Time& stamp, const double* data)
+                {
+                  std::copy(data, data + ALWAYS_AT_END, msg.data.begin());
+                  end_effector_data_pub.publish(msg);
+                });
+    return 0;
+  }
+
+  // Load the same settings the robot uses, from the picknik config loaded into this namespace
+  const std::string parent_name = "tactile_replay";
+  std::string filter_type;
+  TactileFilterSettings filter_settings;
+  double steps_per_meter, insertion_duration;
+  InsertionGoal goal;
+  if (!ros_param_utilities::getStringParameter(parent_name, nh, "tactile_filter/type",
+                                               filter_type) ||
+      !ros_param_utilities::getIntParameter(parent_name, nh, "tactile_filter/median_window",
+                                            filter_settings.median_window_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "tactile_filter/ema_alpha",
+                                               filter_settings.ema_alpha_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh,
+                                               "tactile_filter/one_euro_min_cutoff",
+                                               filter_settings.one_euro_min_cutoff_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "tactile_filter/one_euro_beta",
+                                               filter_settings.one_euro_beta_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "tactile_filter/one_euro_d_cutoff",
+                                               filter_settings.one_euro_d_cutoff_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh,
+                                               "tactile_filter/kalman_process_noise",
+                                               filter_settings.kalman_process_noise_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh,
+                                               "tactile_filter/kalman_measurement_noise",
+                                               filter_settings.kalman_measurement_noise_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_distance",
+                                               goal.distance_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_steps_per_meter",
+                                               steps_per_meter) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_duration",
+                                               insertion_duration) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_torque_min",
+                                               goal.torque_min_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_torque_max",
+                                               goal.torque_max_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_torque_scale",
+                                               goal.torque_scale_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_alter_pause",
+                                               goal.correction_pause_) ||
+      !ros_param_utilities::getBoolParameter(parent_name, nh, "insertion_adaptive_step",
+                                             goal.adaptive_step_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_step_min",
+                                               goal.min_step_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_step_max",
+                                               goal.max_step_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_contact_force",
+                                               goal.contact_force_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_contact_torque",
+                                               goal.contact_torque_) ||
+      !ros_param_utilities::getDoubleParameter(parent_name, nh, "insertion_max_sample_age",
+                                               goal.max_sample_age_))
+  {
+    ROS_ERROR_STREAM_NAMED("tactile_replay", "Missing parameters, load the picknik config into "
+                                             "this node's namespace");
+    return 1;
+  }
+  if (!TactileFilter::parseType(filter_type, filter_settings.type_))
+  {
+    ROS_ERROR_STREAM_NAMED("tactile_replay", "Unknown tactile filter type " << filter_type);
+    return 1;
+  }
+
+  // Same goal as Manipulation::executeInsertionClosedLoop, in the tool frame
+  double step_duration;
+  // 0 to step whenever the recording has a command, as it did on the robot
+  nh.param("step_duration", step_duration, 0.0);
+  goal.num_steps_ = goal.distance_ * steps_per_meter;
+  if (!goal.num_steps_)
+  {
+    ROS_ERROR_STREAM_NAMED("tactile_replay", "Insertion has no steps, check insertion_distance and "
+                                             "insertion_steps_per_meter");
+    return 1;
+  }
+  goal.direction_in_ = true;
+  goal.step_duration_ =
+      step_duration > 0 ? step_duration : insertion_duration / double(goal.num_steps_);
+  goal.use_tactile_ = true;
+
+  TactileFilterPtr filter(new TactileFilter(filter_settings));
+  HeadlessInsertion insertion(goal, filter, step_duration);
+  if (!replay.play(speed,
+                   std::bind(&HeadlessInsertion::sampleCallback, &insertion, std::placeholders::_1,
+                             std::placeholders::_2),
+                   std::bind(&HeadlessInsertion::commandCallback, &insertion,
+                             std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)))
+    return 1;
+
+  const double wall_time =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  const ReplayResult& result = insertion.finish();
+
+  ROS_INFO_STREAM_NAMED("tactile_replay", "Replayed " << result.samples_ << " samples in "
+                                                      << wall_time << " s ("
+                                                      << replay.getDuration() / wall_time
+                                                      << "x real time)");
+  ROS_INFO_STREAM_NAMED("tactile_replay", "Filter '" << filter_type << "': " << result.steps_
+                                                     << " steps, " << result.corrections_
+                                                     << " corrections, " << result.stale_samples_
+                                                     << " stale samples, travelled "
+                                                     << result.travelled_ << " m");
+  ROS_INFO_STREAM_NAMED("tactile_replay", "Reached full depth " << result.insertions_ << " times, "
+                                                                << "mean time to depth "
+                                                                << (result.insertions_
+                                                                        ? result.time_to_depth_ /
+                                                                              result.insertions_
+                                                                        : 0)
+                                                                << " s");
+  ROS_INFO_STREAM_NAMED("tactile_replay", "Net rotation " << result.net_rotation_
+                                                          << " rad, max step "
+                                                          << result.max_rotation_ << " rad");
+  filter->printStats();
+
+  return 0;
+}
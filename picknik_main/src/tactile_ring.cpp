@@ -0,0 +1,106 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Lock-free history of tactile sensor samples, written by the sensor callback and read by
+           any number of control and visualization threads
+*/
+
+// PickNik
+#include <picknik_main/tactile_ring.h>
+
+// C++
+#include <algorithm>
+
+namespace picknik_main
+{
+TactileRing::TactileRing(std::size_t capacity) : capacity_(2), write_count_(0)
+{
+  while (capacity_ < capacity)
+    capacity_ *= 2;
+  mask_ = capacity_ - 1;
+
+  slots_.reset(new Slot[capacity_]);
+  for (std::size_t i = 0; i < capacity_; ++i)
+  {
+    slots_[i].stamp_nsec_.store(0, std::memory_order_relaxed);
+    for (std::size_t j = 0; j < ALWAYS_AT_END; ++j)
+      slots_[i].data_[j].store(0.0, std::memory_order_relaxed);
+    slots_[i].sheer_theta_.store(0.0, std::memory_order_relaxed);
+  }
+}
+
+void TactileRing::push(const TactileSample& sample)
+{
+  const std::size_t index = write_count_.load(std::memory_order_relaxed);
+
+  // Any reader that sees part of this write will also see write_count_ >= index afterwards
+  std::atomic_thread_fence(std::memory_order_release);
+
+  Slot& slot = slots_[index & mask_];
+  slot.stamp_nsec_.store(sample.stamp_.toNSec(), std::memory_order_relaxed);
+  for (std::size_t j = 0; j < ALWAYS_AT_END; ++j)
+    slot.data_[j].store(sample.data_[j], std::memory_order_relaxed);
+  slot.sheer_theta_.store(sample.sheer_theta_, std::memory_order_relaxed);
+
+  write_count_.store(index + 1, std::memory_order_release);
+}
+
+bool TactileRing::getLatest(TactileSample& sample) const
+{
+  while (true)
+  {
+    const std::size_t count = write_count_.load(std::memory_order_acquire);
+    if (count == 0)
+      return false;
+
+    readSlot(count - 1, sample);
+
+    // Valid unless the writer has since started on the same slot again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (write_count_.load(std::memory_order_relaxed) < count - 1 + capacity_)
+      return true;
+  }
+}
+
+bool TactileRing::getWindow(std::size_t count, std::vector<TactileSample>& samples) const
+{
+  while (true)
+  {
+    const std::size_t end = write_count_.load(std::memory_order_acquire);
+    if (end == 0)
+    {
+      samples.clear();
+      return false;
+    }
+
+    // Leave a slot of slack so a single write during the copy does not invalidate it
+    const std::size_t available = std::min(end, capacity_ - 1);
+    const std::size_t begin = end - std::min(count, available);
+    samples.resize(end - begin);
+    for (std::size_t i = begin; i < end; ++i)
+      readSlot(i, samples[i - begin]);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (write_count_.load(std::memory_order_relaxed) < begin + capacity_)
+      return true;
+  }
+}
+
+void TactileRing::readSlot(std::size_t index, TactileSample& sample) const
+{
+  const Slot& slot = slots_[index & mask_];
+  sample.stamp_.fromNSec(slot.stamp_nsec_.load(std::memory_order_relaxed));
+  for (std::size_t j = 0; j < ALWAYS_AT_END; ++j)
+    sample.data_[j] = slot.data_[j].load(std::memory_order_relaxed);
+  sample.sheer_theta_ = slot.sheer_theta_.load(std::memory_order_relaxed);
+}
+
+}  // end namespace
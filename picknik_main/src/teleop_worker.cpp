@@ -0,0 +1,146 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Turn interactive marker feedback into robot commands on one thread at a bounded rate,
+           always working on the newest target
+*/
+
+// PickNik
+#include <picknik_main/teleop_worker.h>
+
+// C++
+#include <stdexcept>
+#include <thread>
+
+namespace picknik_main
+{
+TeleopWorker::TeleopWorker(const CommandCallback& callback, double rate)
+  : callback_(callback)
+  , period_(std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / checkRate(rate))))
+  , pending_(false)
+  , shutdown_(false)
+  , world_to_ee_(Eigen::Affine3d::Identity())
+  , move_(false)
+  , received_(0)
+  , dropped_(0)
+  , commanded_(0)
+  , failed_(0)
+  , latency_sum_(0)
+  , latency_max_(0)
+{
+  worker_thread_ = boost::thread(boost::bind(&TeleopWorker::workerThread, this));
+
+  ROS_INFO_STREAM_NAMED("teleop_worker", "Teleoperation commands limited to " << rate << " hz");
+}
+
+double TeleopWorker::checkRate(double rate)
+{
+  if (!(rate > 0))
+    throw std::invalid_argument("TeleopWorker rate must be positive");
+  return rate;
+}
+
+TeleopWorker::~TeleopWorker()
+{
+  {
+    boost::unique_lock<boost::mutex> lock(target_mutex_);
+    shutdown_ = true;
+  }
+  target_condition_.notify_all();
+  worker_thread_.join();
+  printStats();
+}
+
+void TeleopWorker::push(const Eigen::Affine3d& world_to_ee, bool move)
+{
+  {
+    boost::unique_lock<boost::mutex> lock(target_mutex_);
+    received_++;
+    if (pending_)
+    {
+      dropped_++;
+      move_ = move_ || move;
+    }
+    else
+    {
+      // Latency is measured from the oldest target this one replaces
+      receive_time_ = Clock::now();
+      move_ = move;
+    }
+    world_to_ee_ = world_to_ee;
+    pending_ = true;
+  }
+  target_condition_.notify_one();
+}
+
+void TeleopWorker::printStats() const
+{
+  boost::unique_lock<boost::mutex> lock(target_mutex_);
+  const std::size_t commanded = std::max<std::size_t>(1, commanded_ + failed_);
+  ROS_INFO_STREAM_NAMED("teleop_worker", "Received " << received_ << " teleop targets, "
+                                                     << commanded_ << " commanded, " << failed_
+                                                     << " failed, " << dropped_
+                                                     << " superseded and dropped");
+  ROS_INFO_STREAM_NAMED("teleop_worker", "Marker to command latency mean "
+                                             << latency_sum_ / commanded * 1000.0 << " ms, max "
+                                             << latency_max_ * 1000.0 << " ms");
+}
+
+void TeleopWorker::workerThread()
+{
+  Clock::time_point next_allowed = Clock::now();
+
+  while (true)
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(target_mutex_);
+      while (!pending_ && !shutdown_)
+        target_condition_.wait(lock);
+      if (shutdown_)
+        return;
+    }
+
+    // Let more feedback pile up into the slot rather than commanding faster than the rate
+    std::this_thread::sleep_until(next_allowed);
+
+    Eigen::Affine3d world_to_ee;
+    bool move;
+    Clock::time_point receive_time;
+    {
+      boost::unique_lock<boost::mutex> lock(target_mutex_);
+      if (shutdown_)
+        return;
+      world_to_ee = world_to_ee_;
+      move = move_;
+      receive_time = receive_time_;
+      pending_ = false;
+    }
+
+    const Clock::time_point start_time = Clock::now();
+    const bool success = callback_(world_to_ee, move);
+    const double latency = std::chrono::duration<double>(Clock::now() - receive_time).count();
+
+    {
+      boost::unique_lock<boost::mutex> lock(target_mutex_);
+      if (success)
+        commanded_++;
+      else
+        failed_++;
+      latency_sum_ += latency;
+      latency_max_ = std::max(latency_max_, latency);
+    }
+
+    next_allowed = start_time + period_;
+  }
+}
+
+}  // end namespace
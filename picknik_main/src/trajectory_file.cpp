@@ -0,0 +1,318 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Binary, column-major trajectory file that is memory mapped for instant playback
+*/
+
+// PickNik
+#include <picknik_main/trajectory_file.h>
+
+// C++
+#include <cstring>
+#include <fstream>
+
+// Memory mapping
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace picknik_main
+{
+namespace
+{
+const char MAGIC[4] = {'P', 'N', 'T', 'J'};
+const uint32_t VERSION = 2;
+
+struct FileHeader
+{
+  char magic_[4];
+  uint32_t version_;
+  uint64_t robot_model_hash_;
+  double velocity_scaling_factor_;
+  uint64_t source_hash_;
+  uint32_t num_joints_;
+  uint32_t num_points_;
+  uint32_t names_size_;
+  uint32_t reserved_;
+};
+
+void appendName(std::vector<char>& names, const std::string& name)
+{
+  const uint16_t size = name.size();
+  const char* bytes = reinterpret_cast<const char*>(&size);
+  names.insert(names.end(), bytes, bytes + sizeof(size));
+  names.insert(names.end(), name.begin(), name.end());
+}
+
+bool readName(const char*& cursor, const char* end, std::string& name)
+{
+  uint16_t size;
+  if (cursor + sizeof(size) > end)
+    return false;
+  std::memcpy(&size, cursor, sizeof(size));
+  cursor += sizeof(size);
+  if (cursor + size > end)
+    return false;
+  name.assign(cursor, size);
+  cursor += size;
+  return true;
+}
+
+}  // end anonymous namespace
+
+TrajectoryFile::TrajectoryFile()
+  : mapped_data_(NULL)
+  , mapped_size_(0)
+  , robot_model_hash_(0)
+  , velocity_scaling_factor_(0)
+  , source_hash_(0)
+  , num_points_(0)
+  , times_(NULL)
+  , positions_(NULL)
+  , velocities_(NULL)
+  , accelerations_(NULL)
+{
+}
+
+TrajectoryFile::~TrajectoryFile() { unload(); }
+
+bool TrajectoryFile::write(const std::string& file_path,
+                           const robot_trajectory::RobotTrajectory& robot_trajectory,
+                           double velocity_scaling_factor, uint64_t source_hash)
+{
+  const moveit::core::JointModelGroup* jmg = robot_trajectory.getGroup();
+  if (!jmg)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Trajectory has no planning group, unable to save");
+    return false;
+  }
+  const std::vector<std::string>& joint_names = jmg->getVariableNames();
+  const std::vector<int>& variable_indices = jmg->getVariableIndexList();
+  const std::size_t num_joints = joint_names.size();
+  const std::size_t num_points = robot_trajectory.getWayPointCount();
+  if (num_points == 0)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "No trajectory points available to save");
+    return false;
+  }
+
+  // Name block
+  std::vector<char> names;
+  appendName(names, jmg->getName());
+  for (std::size_t j = 0; j < num_joints; ++j)
+    appendName(names, joint_names[j]);
+  names.resize((names.size() + 7) / 8 * 8, 0);
+
+  FileHeader header;
+  std::memcpy(header.magic_, MAGIC, sizeof(MAGIC));
+  header.version_ = VERSION;
+  header.robot_model_hash_ = hashRobotModel(*robot_trajectory.getRobotModel());
+  header.velocity_scaling_factor_ = velocity_scaling_factor;
+  header.source_hash_ = source_hash;
+  header.num_joints_ = num_joints;
+  header.num_points_ = num_points;
+  header.names_size_ = names.size();
+  header.reserved_ = 0;
+
+  // Columns
+  std::vector<double> times(num_points);
+  std::vector<double> positions(num_joints * num_points);
+  std::vector<double> velocities(num_joints * num_points, 0.0);
+  std::vector<double> accelerations(num_joints * num_points, 0.0);
+  double time_from_start = 0;
+  for (std::size_t i = 0; i < num_points; ++i)
+  {
+    const moveit::core::RobotState& waypoint = robot_trajectory.getWayPoint(i);
+    time_from_start += robot_trajectory.getWayPointDurationFromPrevious(i);
+    times[i] = time_from_start;
+
+    for (std::size_t j = 0; j < num_joints; ++j)
+    {
+      const std::size_t index = j * num_points + i;
+      positions[index] = waypoint.getVariablePosition(variable_indices[j]);
+      if (waypoint.hasVelocities())
+        velocities[index] = waypoint.getVariableVelocity(variable_indices[j]);
+      if (waypoint.hasAccelerations())
+        accelerations[index] = waypoint.getVariableAcceleration(variable_indices[j]);
+    }
+  }
+
+  std::ofstream output_file(file_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  output_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output_file.write(&names[0], names.size());
+  output_file.write(reinterpret_cast<const char*>(&times[0]), times.size() * sizeof(double));
+  output_file.write(reinterpret_cast<const char*>(&positions[0]),
+                    positions.size() * sizeof(double));
+  output_file.write(reinterpret_cast<const char*>(&velocities[0]),
+                    velocities.size() * sizeof(double));
+  output_file.write(reinterpret_cast<const char*>(&accelerations[0]),
+                    accelerations.size() * sizeof(double));
+  if (!output_file)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Failed to write trajectory to " << file_path);
+    return false;
+  }
+
+  ROS_DEBUG_STREAM_NAMED("trajectory_file", "Saved " << num_points << " point trajectory to "
+                                                     << file_path);
+  return true;
+}
+
+bool TrajectoryFile::load(const std::string& file_path)
+{
+  unload();
+
+  int file_descriptor = open(file_path.c_str(), O_RDONLY);
+  if (file_descriptor < 0)
+    return false;
+
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) != 0 ||
+      static_cast<std::size_t>(file_stat.st_size) < sizeof(FileHeader))
+  {
+    close(file_descriptor);
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Trajectory file too small: " << file_path);
+    return false;
+  }
+
+  mapped_size_ = file_stat.st_size;
+  mapped_data_ = mmap(NULL, mapped_size_, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);  // mapping stays valid
+  if (mapped_data_ == MAP_FAILED)
+  {
+    mapped_data_ = NULL;
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Unable to memory map " << file_path);
+    return false;
+  }
+
+  // Header
+  const char* data = static_cast<const char*>(mapped_data_);
+  FileHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic_, MAGIC, sizeof(MAGIC)) != 0 || header.version_ != VERSION)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Not a version " << VERSION << " trajectory file: "
+                                                               << file_path);
+    unload();
+    return false;
+  }
+  const std::size_t num_joints = header.num_joints_;
+  const std::size_t column_bytes = header.num_points_ * sizeof(double);
+  if (mapped_size_ !=
+      sizeof(header) + header.names_size_ + column_bytes * (1 + 3 * num_joints))
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Trajectory file is truncated: " << file_path);
+    unload();
+    return false;
+  }
+
+  // Names
+  const char* cursor = data + sizeof(header);
+  const char* names_end = cursor + header.names_size_;
+  joint_names_.resize(num_joints);
+  bool names_ok = readName(cursor, names_end, group_name_);
+  for (std::size_t j = 0; j < num_joints && names_ok; ++j)
+    names_ok = readName(cursor, names_end, joint_names_[j]);
+  if (!names_ok)
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_file", "Corrupt joint names in " << file_path);
+    unload();
+    return false;
+  }
+
+  robot_model_hash_ = header.robot_model_hash_;
+  velocity_scaling_factor_ = header.velocity_scaling_factor_;
+  source_hash_ = header.source_hash_;
+  num_points_ = header.num_points_;
+
+  // Columns, 8 byte aligned because the name block is padded
+  times_ = reinterpret_cast<const double*>(names_end);
+  positions_ = times_ + num_points_;
+  velocities_ = positions_ + num_joints * num_points_;
+  accelerations_ = velocities_ + num_joints * num_points_;
+
+  return true;
+}
+
+void TrajectoryFile::getTrajectoryMsg(moveit_msgs::RobotTrajectory& trajectory_msg) const
+{
+  trajectory_msgs::JointTrajectory& trajectory = trajectory_msg.joint_trajectory;
+  const std::size_t num_joints = joint_names_.size();
+
+  trajectory.joint_names = joint_names_;
+  trajectory.points.resize(num_points_);
+  for (std::size_t i = 0; i < num_points_; ++i)
+  {
+    trajectory_msgs::JointTrajectoryPoint& point = trajectory.points[i];
+    point.positions.resize(num_joints);
+    point.velocities.resize(num_joints);
+    point.accelerations.resize(num_joints);
+    for (std::size_t j = 0; j < num_joints; ++j)
+    {
+      point.positions[j] = getPositions(j)[i];
+      point.velocities[j] = getVelocities(j)[i];
+      point.accelerations[j] = getAccelerations(j)[i];
+    }
+    point.time_from_start = ros::Duration(times_[i]);
+  }
+}
+
+uint64_t TrajectoryFile::hashRobotModel(const moveit::core::RobotModel& robot_model)
+{
+  uint64_t hash = hashData(robot_model.getName().data(), robot_model.getName().size());
+
+  const std::vector<std::string>& variable_names = robot_model.getVariableNames();
+  for (std::size_t i = 0; i < variable_names.size(); ++i)
+  {
+    hash = hashData(variable_names[i].data(), variable_names[i].size(), hash);
+    const moveit::core::VariableBounds& bounds = robot_model.getVariableBounds(variable_names[i]);
+    hash = hashData(&bounds.min_position_, sizeof(bounds.min_position_), hash);
+    hash = hashData(&bounds.max_position_, sizeof(bounds.max_position_), hash);
+  }
+  return hash;
+}
+
+uint64_t TrajectoryFile::hashData(const void* data, std::size_t size, uint64_t hash)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool TrajectoryFile::hashFile(const std::string& file_path, uint64_t& hash)
+{
+  std::ifstream input_file(file_path.c_str(), std::ios::in | std::ios::binary);
+  if (!input_file.is_open())
+    return false;
+
+  hash = hashData(NULL, 0);
+  char buffer[4096];
+  while (input_file.read(buffer, sizeof(buffer)) || input_file.gcount())
+    hash = hashData(buffer, input_file.gcount(), hash);
+  return true;
+}
+
+void TrajectoryFile::unload()
+{
+  if (mapped_data_)
+    munmap(mapped_data_, mapped_size_);
+  mapped_data_ = NULL;
+  mapped_size_ = 0;
+  num_points_ = 0;
+  times_ = positions_ = velocities_ = accelerations_ = NULL;
+}
+
+}  // end namespace
@@ -37,10 +37,13 @@
 */
 
 #include <picknik_main/trajectory_io.h>
+#include <picknik_main/trajectory_file.h>
+#include <picknik_main/joint_state_recorder.h>
 
 // basic file operations
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 // MoveIt
 #include <moveit/robot_state/conversions.h>
@@ -62,6 +65,67 @@ TrajectoryIO::TrajectoryIO(RemoteControlPtr remote_control, VisualsPtr visuals,
 bool TrajectoryIO::playbackTrajectoryFromFile(const std::string& file_name,
                                               JointModelGroup* arm_jmg,
                                               double velocity_scaling_factor)
+{
+  moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
+
+  // Use the binary version if it was made from this CSV for this robot, otherwise parse the CSV
+  // and save a binary version so that the next playback is instant
+  uint64_t csv_hash = 0;
+  TrajectoryFile::hashFile(file_name, csv_hash);  // without a CSV any binary version is used
+  moveit_msgs::RobotTrajectory trajectory_msg;
+  const std::string binary_file_name = getBinaryFilePath(file_name);
+  if (!loadTrajectoryFromBinary(binary_file_name, arm_jmg, velocity_scaling_factor, csv_hash,
+                                trajectory_msg))
+  {
+    robot_trajectory::RobotTrajectoryPtr robot_traj;
+    if (!loadTrajectoryFromCSV(file_name, arm_jmg, velocity_scaling_factor, robot_traj))
+      return false;
+
+    robot_traj->getRobotTrajectoryMsg(trajectory_msg);
+    TrajectoryFile::write(binary_file_name, *robot_traj, velocity_scaling_factor, csv_hash);
+  }
+
+  // Start of trajectory
+  moveit::core::RobotStatePtr start_state = manipulation_->getStatePool()->acquire(*current_state);
+  start_state->setVariablePositions(trajectory_msg.joint_trajectory.joint_names,
+                                    trajectory_msg.joint_trajectory.points.front().positions);
+
+  std::cout << std::endl << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+  std::cout << "MOVING ARM TO START OF TRAJECTORY" << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+
+  // Plan to start state of trajectory
+  bool verbose = true;
+  bool execute_trajectory = true;
+  bool check_validity = true;
+  ROS_INFO_STREAM_NAMED("trajectory_io", "Moving to start state of trajectory");
+  if (!manipulation_->move(current_state, start_state, arm_jmg,
+                           config_->main_velocity_scaling_factor_, verbose, execute_trajectory,
+                           check_validity))
+  {
+    ROS_ERROR_STREAM_NAMED("manipultion", "Unable to plan");
+    return false;
+  }
+
+  std::cout << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+  std::cout << "PLAYING BACK TRAJECTORY" << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+
+  // Execute
+  if (!manipulation_->getExecutionInterface()->executeTrajectory(trajectory_msg, arm_jmg))
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_io", "Failed to execute trajectory");
+    return false;
+  }
+
+  return true;
+}
+
+bool TrajectoryIO::loadTrajectoryFromCSV(const std::string& file_name, JointModelGroup* arm_jmg,
+                                         double velocity_scaling_factor,
+                                         robot_trajectory::RobotTrajectoryPtr& robot_traj)
 {
   std::ifstream input_file;
   input_file.open(file_name.c_str());
@@ -70,15 +134,15 @@ bool TrajectoryIO::playbackTrajectoryFromFile(const std::string& file_name,
   std::string line;
   moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
 
-  robot_trajectory::RobotTrajectoryPtr robot_traj(
-      new robot_trajectory::RobotTrajectory(current_state->getRobotModel(), arm_jmg));
+  robot_traj.reset(new robot_trajectory::RobotTrajectory(current_state->getRobotModel(), arm_jmg));
   double dummy_dt = 1;  // temp value
 
   // Read each line
   while (std::getline(input_file, line))
   {
     // Convert line to a robot state
-    moveit::core::RobotStatePtr new_state(new moveit::core::RobotState(*current_state));
+    moveit::core::RobotStatePtr new_state =
+        manipulation_->getStatePool()->acquire(*current_state);
     moveit::core::streamToRobotState(*new_state, line, ",");
     robot_traj->addSuffixWayPoint(new_state, dummy_dt);
   }
@@ -102,43 +166,162 @@ bool TrajectoryIO::playbackTrajectoryFromFile(const std::string& file_name,
   // Perform iterative parabolic smoothing
   manipulation_->getIterativeSmoother().computeTimeStamps(*robot_traj, velocity_scaling_factor);
 
-  // Convert trajectory to a message
-  moveit_msgs::RobotTrajectory trajectory_msg;
+  return true;
+}
+
+bool TrajectoryIO::loadTrajectoryFromBinary(const std::string& file_name,
+                                            JointModelGroup* arm_jmg,
+                                            double velocity_scaling_factor, uint64_t csv_hash,
+                                            moveit_msgs::RobotTrajectory& trajectory_msg)
+{
+  TrajectoryFile trajectory_file;
+  if (!trajectory_file.load(file_name))
+    return false;
+
+  // Check that the CSV has not been recorded again since
+  if (csv_hash && trajectory_file.getSourceHash() != csv_hash)
+  {
+    ROS_INFO_STREAM_NAMED("trajectory_io", "Binary trajectory " << file_name
+                                                                << " is out of date, ignoring");
+    return false;
+  }
+
+  // Check that this file was made for this robot
+  moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
+  if (trajectory_file.getRobotModelHash() !=
+      TrajectoryFile::hashRobotModel(*current_state->getRobotModel()))
+  {
+    ROS_WARN_STREAM_NAMED("trajectory_io", "Binary trajectory " << file_name
+                                                                << " was made for a different "
+                                                                   "robot model, ignoring");
+    return false;
+  }
+  if (trajectory_file.getGroupName() != arm_jmg->getName() || !trajectory_file.getPointCount())
+  {
+    ROS_WARN_STREAM_NAMED("trajectory_io", "Binary trajectory " << file_name
+                                                                << " is for planning group "
+                                                                << trajectory_file.getGroupName()
+                                                                << ", ignoring");
+    return false;
+  }
+
+  // Timing was precomputed for this speed
+  static const double SCALING_TOLERANCE = 1e-6;
+  if (fabs(trajectory_file.getVelocityScalingFactor() - velocity_scaling_factor) <
+      SCALING_TOLERANCE)
+  {
+    trajectory_file.getTrajectoryMsg(trajectory_msg);
+    return true;
+  }
+
+  // Different speed - waypoints are still valid but need to be re-timed
+  ROS_INFO_STREAM_NAMED("trajectory_io", "Re-timing binary trajectory from velocity scaling "
+                                             << trajectory_file.getVelocityScalingFactor()
+                                             << " to " << velocity_scaling_factor);
+  robot_trajectory::RobotTrajectoryPtr robot_traj(
+      new robot_trajectory::RobotTrajectory(current_state->getRobotModel(), arm_jmg));
+  const std::vector<std::string>& joint_names = trajectory_file.getJointNames();
+  double dummy_dt = 1;  // temp value
+  for (std::size_t i = 0; i < trajectory_file.getPointCount(); ++i)
+  {
+    moveit::core::RobotStatePtr new_state =
+        manipulation_->getStatePool()->acquire(*current_state);
+    for (std::size_t j = 0; j < joint_names.size(); ++j)
+      new_state->setVariablePosition(joint_names[j], trajectory_file.getPositions(j)[i]);
+    robot_traj->addSuffixWayPoint(new_state, dummy_dt);
+  }
+  manipulation_->getIterativeSmoother().computeTimeStamps(*robot_traj, velocity_scaling_factor);
   robot_traj->getRobotTrajectoryMsg(trajectory_msg);
 
-  std::cout << std::endl << std::endl;
-  std::cout << "-------------------------------------------------------" << std::endl;
-  std::cout << "MOVING ARM TO START OF TRAJECTORY" << std::endl;
-  std::cout << "-------------------------------------------------------" << std::endl;
+  return true;
+}
 
-  // Plan to start state of trajectory
-  bool verbose = true;
-  bool execute_trajectory = true;
-  bool check_validity = true;
-  ROS_INFO_STREAM_NAMED("trajectory_io", "Moving to start state of trajectory");
-  if (!manipulation_->move(current_state, robot_traj->getFirstWayPointPtr(), arm_jmg,
-                           config_->main_velocity_scaling_factor_, verbose, execute_trajectory,
-                           check_validity))
+bool TrajectoryIO::convertCSVToBinary(const std::string& file_name, JointModelGroup* arm_jmg,
+                                      double velocity_scaling_factor)
+{
+  uint64_t csv_hash;
+  robot_trajectory::RobotTrajectoryPtr robot_traj;
+  if (!TrajectoryFile::hashFile(file_name, csv_hash) ||
+      !loadTrajectoryFromCSV(file_name, arm_jmg, velocity_scaling_factor, robot_traj))
+    return false;
+
+  const std::string binary_file_name = getBinaryFilePath(file_name);
+  if (!TrajectoryFile::write(binary_file_name, *robot_traj, velocity_scaling_factor, csv_hash))
+    return false;
+
+  ROS_INFO_STREAM_NAMED("trajectory_io", "Converted " << file_name << " to " << binary_file_name);
+  return true;
+}
+
+bool TrajectoryIO::convertBinaryToCSV(const std::string& binary_file_name,
+                                      const std::string& file_name)
+{
+  TrajectoryFile trajectory_file;
+  if (!trajectory_file.load(binary_file_name))
   {
-    ROS_ERROR_STREAM_NAMED("manipultion", "Unable to plan");
+    ROS_ERROR_STREAM_NAMED("trajectory_io", "Unable to load binary trajectory "
+                                                << binary_file_name);
     return false;
   }
 
-  std::cout << std::endl;
-  std::cout << "-------------------------------------------------------" << std::endl;
-  std::cout << "PLAYING BACK TRAJECTORY" << std::endl;
-  std::cout << "-------------------------------------------------------" << std::endl;
+  std::ofstream output_file;
+  output_file.open(file_name.c_str());
 
-  // Execute
-  if (!manipulation_->getExecutionInterface()->executeTrajectory(trajectory_msg, arm_jmg))
+  // Joints outside of the trajectory's group are taken from the current state
+  bool include_header = false;
+  moveit::core::RobotStatePtr state =
+      manipulation_->getStatePool()->acquire(*manipulation_->getCurrentState());
+  const std::vector<std::string>& joint_names = trajectory_file.getJointNames();
+  for (std::size_t i = 0; i < trajectory_file.getPointCount(); ++i)
   {
-    ROS_ERROR_STREAM_NAMED("trajectory_io", "Failed to execute trajectory");
+    for (std::size_t j = 0; j < joint_names.size(); ++j)
+      state->setVariablePosition(joint_names[j], trajectory_file.getPositions(j)[i]);
+    moveit::core::robotStateToStream(*state, output_file, include_header);
+  }
+
+  output_file.close();
+  return true;
+}
+
+bool TrajectoryIO::convertAllCSVToBinary(JointModelGroup* arm_jmg, double velocity_scaling_factor)
+{
+  namespace fs = boost::filesystem;
+
+  const fs::path path(config_->package_path_ + "/trajectories");
+  if (!fs::is_directory(path))
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_io", "No trajectory directory " << path.string());
     return false;
   }
 
+  std::size_t converted = 0;
+  std::size_t skipped = 0;
+  for (fs::directory_iterator it(path); it != fs::directory_iterator(); ++it)
+  {
+    if (it->path().extension() != ".csv")
+      continue;
+    if (!isRobotStateCSV(it->path().string()))
+    {
+      ROS_DEBUG_STREAM_NAMED("trajectory_io", "Skipping " << it->path().string()
+                                                          << ", not a robot state trajectory");
+      skipped++;
+      continue;
+    }
+    if (convertCSVToBinary(it->path().string(), arm_jmg, velocity_scaling_factor))
+      converted++;
+  }
+
+  ROS_INFO_STREAM_NAMED("trajectory_io", "Converted " << converted
+                                                      << " CSV trajectories to binary, skipped "
+                                                      << skipped << " other CSV files");
   return true;
 }
 
+std::string TrajectoryIO::getBinaryFilePath(const std::string& file_path) const
+{
+  return boost::filesystem::path(file_path).replace_extension(".traj").string();
+}
+
 bool TrajectoryIO::playbackWaypointsFromFile(const std::string& file_name, JointModelGroup* arm_jmg,
                                              double velocity_scaling_factor)
 {
@@ -147,11 +330,15 @@ bool TrajectoryIO::playbackWaypointsFromFile(const std::string& file_name, Joint
   input_file.open(file_name.c_str());
   ROS_DEBUG_STREAM_NAMED("manipultion", "Loading waypoints from file " << file_name);
 
+  // Read whole file so that its contents can identify a cached solution
+  std::stringstream file_contents;
+  file_contents << input_file.rdbuf();
+
   // Create desired trajectory
   EigenSTL::vector_Affine3d waypoints;
 
   // Read each line
-  while (std::getline(input_file, line))
+  while (std::getline(file_contents, line))
   {
     // Convert line to a robot state
     Eigen::Affine3d pose;
@@ -199,25 +386,108 @@ bool TrajectoryIO::playbackWaypointsFromFile(const std::string& file_name, Joint
     visuals_->visual_tools_->triggerBatchPublishAndDisable();
   }
 
+  // Reuse the joint solution of a previous run if it is still collision free
+  const std::string cache_file_name =
+      getWaypointCachePath(file_name, file_contents.str(), arm_jmg);
+  std::vector<moveit::core::RobotStatePtr> solved_path;
+  if (loadSolvedWaypointPath(cache_file_name, arm_jmg, solved_path))
+  {
+    if (manipulation_->checkSolvedWaypointPath(arm_jmg, solved_path))
+    {
+      ROS_INFO_STREAM_NAMED("trajectory_io", "Using cached waypoint solution " << cache_file_name);
+      if (!manipulation_->moveSolvedWaypointPath(arm_jmg, solved_path))
+      {
+        ROS_ERROR_STREAM_NAMED("trajectory_io", "Error executing path");
+        return false;
+      }
+      return true;
+    }
+    ROS_WARN_STREAM_NAMED("trajectory_io", "Cached waypoint solution is no longer valid, "
+                                           "re-solving");
+  }
+
   // Plan and move
-  if (!manipulation_->moveCartesianWaypointPath(arm_jmg, waypoints))
+  if (!manipulation_->moveCartesianWaypointPath(arm_jmg, waypoints, solved_path))
   {
     ROS_ERROR_STREAM_NAMED("trajectory_io", "Error executing path");
     return false;
   }
 
+  // Save solution for next time
+  robot_trajectory::RobotTrajectory robot_traj(solved_path.front()->getRobotModel(), arm_jmg);
+  double dummy_dt = 1;  // path is re-timed when executed
+  for (std::size_t i = 0; i < solved_path.size(); ++i)
+    robot_traj.addSuffixWayPoint(solved_path[i], dummy_dt);
+  TrajectoryFile::write(cache_file_name, robot_traj, 0.0);
+
   return true;
 }
 
-bool TrajectoryIO::recordTrajectoryToFile(const std::string& file_path)
+std::string TrajectoryIO::getWaypointCachePath(const std::string& file_name,
+                                               const std::string& file_contents,
+                                               JointModelGroup* arm_jmg)
 {
-  bool include_header = false;
+  namespace fs = boost::filesystem;
 
-  std::ofstream output_file;
-  output_file.open(file_path.c_str());
-  ROS_DEBUG_STREAM_NAMED("trajectory_io", "Saving bin trajectory to file " << file_path);
+  // IK seeds from the current state, so a different start region can give a different solution
+  static const double START_REGION_RESOLUTION = 0.25;  // radians
+  moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
+  std::vector<double> start_positions;
+  current_state->copyJointGroupPositions(arm_jmg, start_positions);
+  std::vector<int64_t> start_region(start_positions.size());
+  for (std::size_t i = 0; i < start_positions.size(); ++i)
+    start_region[i] = static_cast<int64_t>(floor(start_positions[i] / START_REGION_RESOLUTION));
+
+  // Key on contents, robot and start region
+  uint64_t key = TrajectoryFile::hashData(file_contents.data(), file_contents.size());
+  const uint64_t model_hash = TrajectoryFile::hashRobotModel(*current_state->getRobotModel());
+  key = TrajectoryFile::hashData(&model_hash, sizeof(model_hash), key);
+  key = TrajectoryFile::hashData(arm_jmg->getName().data(), arm_jmg->getName().size(), key);
+  if (!start_region.empty())
+    key = TrajectoryFile::hashData(&start_region[0], start_region.size() * sizeof(int64_t), key);
+
+  fs::path path(config_->package_path_ + "/trajectories/cache");
+  boost::system::error_code returned_error;
+  fs::create_directories(path, returned_error);
+
+  std::stringstream cache_name;
+  cache_name << fs::path(file_name).stem().string() << "_" << std::hex << key << ".traj";
+  return (path / fs::path(cache_name.str())).string();
+}
 
-  remote_control_->waitForNextStep("record trajectory");
+bool TrajectoryIO::loadSolvedWaypointPath(const std::string& file_name, JointModelGroup* arm_jmg,
+                                          std::vector<moveit::core::RobotStatePtr>& solved_path)
+{
+  TrajectoryFile trajectory_file;
+  if (!trajectory_file.load(file_name))
+    return false;
+
+  moveit::core::RobotStatePtr current_state = manipulation_->getCurrentState();
+  if (trajectory_file.getRobotModelHash() !=
+          TrajectoryFile::hashRobotModel(*current_state->getRobotModel()) ||
+      trajectory_file.getGroupName() != arm_jmg->getName())
+    return false;
+
+  solved_path.clear();
+  const std::vector<std::string>& joint_names = trajectory_file.getJointNames();
+  for (std::size_t i = 0; i < trajectory_file.getPointCount(); ++i)
+  {
+    moveit::core::RobotStatePtr state = manipulation_->getStatePool()->acquire(*current_state);
+    for (std::size_t j = 0; j < joint_names.size(); ++j)
+      state->setVariablePosition(joint_names[j], trajectory_file.getPositions(j)[i]);
+    solved_path.push_back(state);
+  }
+  return !solved_path.empty();
+}
+
+bool TrajectoryIO::recordTrajectoryToFile(const std::string& file_path)
+{
+  // Subscribe to joint states directly so that every sample is captured with its time stamp
+  JointStateRecorder recorder(config_->joint_state_topic_, *manipulation_->getCurrentState(),
+                              config_->joint_state_record_threshold_,
+                              config_->joint_state_record_max_interval_);
+
+  remote_control_->waitForNextStep("record trajectory", __FILE__, __LINE__);
 
   std::cout << std::endl << std::endl << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
@@ -225,21 +495,26 @@ bool TrajectoryIO::recordTrajectoryToFile(const std::string& file_path)
   std::cout << "Press stop button to end recording " << std::endl;
   std::cout << "-------------------------------------------------------" << std::endl;
 
-  std::size_t counter = 0;
+  if (!recorder.start(file_path))
+    return false;
+
+  // Only waits for the stop button, recording happens on its own threads
   while (ros::ok() && !remote_control_->getStop())
   {
-    ROS_INFO_STREAM_THROTTLE_NAMED(1, "trajectory_io", "Recording waypoint #" << counter++);
+    ROS_INFO_STREAM_THROTTLE_NAMED(1, "trajectory_io", "Recorded " << recorder.getRecordedCount()
+                                                                   << " waypoints");
+    ros::Duration(0.1).sleep();
+  }
 
-    moveit::core::robotStateToStream(*manipulation_->getCurrentState(), output_file,
-                                     include_header);
+  recorder.stop();
 
-    ros::Duration(0.25).sleep();
-  }
+  // The binary version was made from the old recording
+  boost::system::error_code error;
+  boost::filesystem::remove(getBinaryFilePath(file_path), error);
 
   // Reset the stop button
   remote_control_->setStop(false);
 
-  output_file.close();
   return true;
 }
 
@@ -269,6 +544,29 @@ bool TrajectoryIO::getFilePath(std::string& file_path, const std::string& file_n
   return true;
 }
 
+bool TrajectoryIO::isRobotStateCSV(const std::string& file_name) const
+{
+  std::ifstream input_file(file_name.c_str());
+  std::string line;
+  if (!std::getline(input_file, line))
+    return false;
+
+  // Same layout as moveit::core::robotStateToStream without header
+  std::stringstream line_stream(line);
+  std::string cell;
+  std::size_t columns = 0;
+  while (std::getline(line_stream, cell, ','))
+  {
+    char* end;
+    strtod(cell.c_str(), &end);
+    if (end == cell.c_str())
+      return false;
+    columns++;
+  }
+
+  return columns == manipulation_->getCurrentState()->getVariableCount();
+}
+
 bool TrajectoryIO::streamToAffine3d(Eigen::Affine3d& pose, const std::string& line,
                                     const std::string& separator)
 {
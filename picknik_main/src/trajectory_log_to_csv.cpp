@@ -0,0 +1,60 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Export a binary trajectory log to one CSV per trajectory for offline analysis, e.g.
+           trajectories/analyze_trajectory.m
+*/
+
+// PickNik
+#include <picknik_main/trajectory_logger.h>
+
+// Boost
+#include <boost/filesystem.hpp>
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    std::cout << "Usage: trajectory_log_to_csv LOG_FILE [OUTPUT_DIRECTORY]" << std::endl;
+    return 1;
+  }
+
+  namespace fs = boost::filesystem;
+  const fs::path log_path(argv[1]);
+  const fs::path output_path = argc > 2 ? fs::path(argv[2]) : log_path.parent_path();
+
+  std::ifstream input_file(log_path.string().c_str(), std::ios::in | std::ios::binary);
+  if (!input_file.is_open())
+  {
+    std::cout << "Unable to open " << log_path.string() << std::endl;
+    return 1;
+  }
+
+  boost::system::error_code returned_error;
+  fs::create_directories(output_path, returned_error);
+
+  picknik_main::TrajectoryLogRecord record;
+  std::size_t count = 0;
+  while (picknik_main::TrajectoryLogger::readRecord(input_file, record))
+  {
+    const fs::path file_path = output_path / fs::path(record.name_ + ".csv");
+    std::ofstream output_file(file_path.string().c_str());
+    if (!picknik_main::TrajectoryLogger::writeCSV(record, output_file))
+    {
+      std::cout << "Failed to write " << file_path.string() << std::endl;
+      return 1;
+    }
+    count++;
+  }
+
+  std::cout << "Exported " << count << " trajectories to " << output_path.string() << std::endl;
+  return 0;
+}
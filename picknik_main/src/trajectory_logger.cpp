@@ -0,0 +1,319 @@
+/*********************************************************************
+ * Software License Agreement
+ *
+ *  Copyright (c) 2015, Dave Coleman <dave@dav.ee>
+ *  All rights reserved.
+ *
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ *********************************************************************/
+
+/* Author: Dave Coleman <dave@dav.ee>
+   Desc:   Save executed trajectories to disk on a background thread in a compact binary format
+*/
+
+// PickNik
+#include <picknik_main/trajectory_logger.h>
+
+// C++
+#include <cstring>
+
+namespace picknik_main
+{
+namespace
+{
+// Record layout, host byte order:
+//   uint32 magic, uint32 body size,
+//   uint16 name length, name,
+//   uint32 joint count, { uint16 length, joint name } per joint,
+//   uint32 point count, uint8 flags,
+//   per point: double time, positions, [velocities], [accelerations]
+const uint32_t RECORD_MAGIC = 0x4c54504e;  // "NPTL"
+const uint8_t HAS_VELOCITIES = 1;
+const uint8_t HAS_ACCELERATIONS = 2;
+const std::size_t HEADER_SIZE = 2 * sizeof(uint32_t);
+
+template <typename T>
+void append(std::vector<char>& buffer, const T& value)
+{
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void appendString(std::vector<char>& buffer, const std::string& value)
+{
+  append(buffer, static_cast<uint16_t>(value.size()));
+  buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+// Write a value, or zero if this point is missing it
+void appendValue(std::vector<char>& buffer, const std::vector<double>& values, std::size_t index)
+{
+  append(buffer, index < values.size() ? values[index] : 0.0);
+}
+
+template <typename T>
+bool read(std::istream& input, T& value)
+{
+  return static_cast<bool>(input.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool readString(std::istream& input, std::string& value)
+{
+  uint16_t size;
+  if (!read(input, size))
+    return false;
+  value.resize(size);
+  return size == 0 || static_cast<bool>(input.read(&value[0], size));
+}
+
+bool readValues(std::istream& input, std::vector<double>& values, std::size_t count)
+{
+  const std::size_t start = values.size();
+  values.resize(start + count);
+  return static_cast<bool>(
+      input.read(reinterpret_cast<char*>(&values[start]), count * sizeof(double)));
+}
+}  // end anonymous namespace
+
+TrajectoryLogger::TrajectoryLogger(const std::string& file_path, std::size_t max_buffered_bytes)
+  : file_path_(file_path)
+  , queued_bytes_(0)
+  , max_buffered_bytes_(max_buffered_bytes)
+  , shutdown_(false)
+  , logged_(0)
+  , dropped_(0)
+  , written_(0)
+  , written_bytes_(0)
+{
+  output_file_.open(file_path_.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+  if (!output_file_.is_open())
+    ROS_ERROR_STREAM_NAMED("trajectory_logger", "Unable to open trajectory log " << file_path_);
+
+  writer_thread_ = boost::thread(boost::bind(&TrajectoryLogger::writerThread, this));
+}
+
+TrajectoryLogger::~TrajectoryLogger()
+{
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    shutdown_ = true;
+  }
+  queue_condition_.notify_one();
+  writer_thread_.join();
+
+  for (std::size_t i = 0; i < free_buffers_.size(); ++i)
+    delete free_buffers_[i];
+
+  printStats();
+}
+
+bool TrajectoryLogger::log(const std::string& name,
+                           const moveit_msgs::RobotTrajectory& trajectory_msg)
+{
+  const trajectory_msgs::JointTrajectory& trajectory = trajectory_msg.joint_trajectory;
+  logged_++;
+
+  // Error check
+  if (trajectory.points.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_logger", "No trajectory points available to save");
+    return false;
+  }
+
+  const std::size_t num_joints = trajectory.joint_names.size();
+  uint8_t flags = 0;
+  if (!trajectory.points[0].velocities.empty())
+    flags |= HAS_VELOCITIES;
+  if (!trajectory.points[0].accelerations.empty())
+    flags |= HAS_ACCELERATIONS;
+  const std::size_t values_per_point =
+      1 + num_joints * (1 + (flags & HAS_VELOCITIES ? 1 : 0) + (flags & HAS_ACCELERATIONS ? 1 : 0));
+  const std::size_t estimated_size =
+      HEADER_SIZE + 64 * (num_joints + 1) + trajectory.points.size() * values_per_point * 8;
+
+  // Reserve room in the buffer and get recycled memory
+  std::vector<char>* buffer;
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    if (queued_bytes_ + estimated_size > max_buffered_bytes_)
+    {
+      dropped_++;
+      return false;
+    }
+    queued_bytes_ += estimated_size;
+
+    if (free_buffers_.empty())
+      buffer = new std::vector<char>();
+    else
+    {
+      buffer = free_buffers_.back();
+      free_buffers_.pop_back();
+    }
+  }
+
+  // Encode outside of the lock
+  buffer->clear();
+  buffer->reserve(estimated_size);
+  append(*buffer, RECORD_MAGIC);
+  append(*buffer, static_cast<uint32_t>(0));  // body size, filled in below
+  appendString(*buffer, name);
+  append(*buffer, static_cast<uint32_t>(num_joints));
+  for (std::size_t j = 0; j < num_joints; ++j)
+    appendString(*buffer, trajectory.joint_names[j]);
+  append(*buffer, static_cast<uint32_t>(trajectory.points.size()));
+  append(*buffer, flags);
+
+  for (std::size_t i = 0; i < trajectory.points.size(); ++i)
+  {
+    const trajectory_msgs::JointTrajectoryPoint& point = trajectory.points[i];
+    append(*buffer, point.time_from_start.toSec());
+    for (std::size_t j = 0; j < num_joints; ++j)
+      appendValue(*buffer, point.positions, j);
+    if (flags & HAS_VELOCITIES)
+      for (std::size_t j = 0; j < num_joints; ++j)
+        appendValue(*buffer, point.velocities, j);
+    if (flags & HAS_ACCELERATIONS)
+      for (std::size_t j = 0; j < num_joints; ++j)
+        appendValue(*buffer, point.accelerations, j);
+  }
+  const uint32_t body_size = buffer->size() - HEADER_SIZE;
+  std::memcpy(&(*buffer)[sizeof(uint32_t)], &body_size, sizeof(uint32_t));
+
+  // Hand off to writer
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    queued_bytes_ += buffer->size();
+    queued_bytes_ -= estimated_size;
+    queue_.push_back(buffer);
+  }
+  queue_condition_.notify_one();
+
+  return true;
+}
+
+void TrajectoryLogger::writerThread()
+{
+  while (true)
+  {
+    std::vector<char>* buffer;
+    {
+      boost::mutex::scoped_lock lock(queue_mutex_);
+      while (queue_.empty() && !shutdown_)
+        queue_condition_.wait(lock);
+
+      if (queue_.empty())  // only possible on shutdown
+        return;
+
+      buffer = queue_.front();
+      queue_.pop_front();
+    }
+
+    // Disk access happens without holding the lock
+    if (output_file_.is_open())
+    {
+      output_file_.write(&(*buffer)[0], buffer->size());
+      output_file_.flush();
+      written_++;
+      written_bytes_ += buffer->size();
+    }
+
+    // Recycle
+    {
+      boost::mutex::scoped_lock lock(queue_mutex_);
+      queued_bytes_ -= buffer->size();
+      free_buffers_.push_back(buffer);
+    }
+  }
+}
+
+void TrajectoryLogger::printStats() const
+{
+  ROS_INFO_STREAM_NAMED("trajectory_logger", "Trajectory log " << file_path_ << ": " << logged_
+                                                               << " logged, " << written_
+                                                               << " written (" << written_bytes_
+                                                               << " bytes), " << dropped_
+                                                               << " dropped");
+}
+
+bool TrajectoryLogger::readRecord(std::istream& input, TrajectoryLogRecord& record)
+{
+  uint32_t magic;
+  uint32_t body_size;
+  if (!read(input, magic))
+    return false;  // end of file
+  if (magic != RECORD_MAGIC || !read(input, body_size))
+  {
+    ROS_ERROR_STREAM_NAMED("trajectory_logger", "Corrupt record in trajectory log");
+    return false;
+  }
+
+  uint32_t num_joints;
+  if (!readString(input, record.name_) || !read(input, num_joints))
+    return false;
+  record.joint_names_.resize(num_joints);
+  for (std::size_t j = 0; j < num_joints; ++j)
+    if (!readString(input, record.joint_names_[j]))
+      return false;
+
+  uint32_t num_points;
+  uint8_t flags;
+  if (!read(input, num_points) || !read(input, flags))
+    return false;
+  record.has_velocities_ = flags & HAS_VELOCITIES;
+  record.has_accelerations_ = flags & HAS_ACCELERATIONS;
+
+  record.times_.clear();
+  record.positions_.clear();
+  record.velocities_.clear();
+  record.accelerations_.clear();
+  for (std::size_t i = 0; i < num_points; ++i)
+  {
+    double time;
+    if (!read(input, time) || !readValues(input, record.positions_, num_joints))
+      return false;
+    record.times_.push_back(time);
+    if (record.has_velocities_ && !readValues(input, record.velocities_, num_joints))
+      return false;
+    if (record.has_accelerations_ && !readValues(input, record.accelerations_, num_joints))
+      return false;
+  }
+  return true;
+}
+
+bool TrajectoryLogger::writeCSV(const TrajectoryLogRecord& record, std::ostream& output)
+{
+  const std::size_t num_joints = record.joint_names_.size();
+
+  // Output header -------------------------------------------------------
+  output << "time_from_start,";
+  for (std::size_t j = 0; j < num_joints; ++j)
+  {
+    output << record.joint_names_[j] << "_pos," << record.joint_names_[j] << "_vel,";
+    if (record.has_accelerations_)
+      output << record.joint_names_[j] << "_acc,";
+  }
+  output << std::endl;
+
+  // Output data ------------------------------------------------------
+  for (std::size_t i = 0; i < record.times_.size(); ++i)
+  {
+    // Timestamp
+    output.precision(20);
+    output << record.times_[i] << ",";
+    output.precision(5);
+    // Output entire trajectory to single line
+    for (std::size_t j = 0; j < num_joints; ++j)
+    {
+      const std::size_t index = i * num_joints + j;
+      output << record.positions_[index] << ","
+             << (record.has_velocities_ ? record.velocities_[index] : 0.0) << ",";
+      if (record.has_accelerations_)
+        output << record.accelerations_[index] << ",";
+    }
+    output << std::endl;
+  }
+  return static_cast<bool>(output);
+}
+
+}  // end namespace
@@ -0,0 +1,129 @@
+/*
+  Author: Dave Coleman <dave@dav.ee>
+  Desc:   Measure how long it takes to read the current joint values while a 1 kHz joint state
+          stream is being written, comparing the seqlock snapshot against a mutex-guarded copy
+*/
+
+#include <ros/ros.h>
+#include <picknik_main/state_snapshot.h>
+
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <atomic>
+
+static const std::size_t NUM_VARIABLES = 20;
+static const double WRITE_RATE = 1000;  // hz, same as the joint_states stream on the real robot
+
+void printLatencies(const std::string& name, std::vector<double>& latencies, std::size_t retries)
+{
+  std::sort(latencies.begin(), latencies.end());
+  double sum = 0;
+  for (std::size_t i = 0; i < latencies.size(); ++i)
+    sum += latencies[i];
+
+  ROS_INFO_STREAM_NAMED("benchmark",
+                        name << ": " << latencies.size() << " reads, mean "
+                             << sum / latencies.size() * 1e9 << " ns, median "
+                             << latencies[latencies.size() / 2] * 1e9 << " ns, p99 "
+                             << latencies[latencies.size() * 99 / 100] * 1e9 << " ns, max "
+                             << latencies.back() * 1e9 << " ns, retries " << retries);
+}
+
+sensor_msgs::JointStatePtr createJointState(const std::vector<std::string>& names)
+{
+  sensor_msgs::JointStatePtr msg(new sensor_msgs::JointState());
+  msg->name = names;
+  msg->position.resize(names.size(), 0.0);
+  return msg;
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "state_snapshot_benchmark");
+
+  const std::size_t num_reads = argc > 1 ? atoi(argv[1]) : 1000000;
+
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < NUM_VARIABLES; ++i)
+    names.push_back("joint_" + boost::lexical_cast<std::string>(i));
+
+  // Seqlock snapshot ---------------------------------------------------------------------
+  {
+    picknik_main::StateSnapshot snapshot(names, std::vector<double>(NUM_VARIABLES, 0.0));
+    std::atomic<bool> done(false);
+
+    boost::thread writer([&]()
+                         {
+                           sensor_msgs::JointStatePtr msg = createJointState(names);
+                           ros::WallRate rate(WRITE_RATE);
+                           while (!done)
+                           {
+                             for (std::size_t i = 0; i < NUM_VARIABLES; ++i)
+                               msg->position[i] += 0.001;
+                             msg->header.stamp.fromNSec(ros::WallTime::now().toNSec());
+                             snapshot.update(msg);
+                             rate.sleep();
+                           }
+                         });
+
+    std::vector<double> positions;
+    std::vector<double> latencies(num_reads);
+    ros::Time stamp;
+    while (!snapshot.read(positions, stamp))
+      ros::WallDuration(0.001).sleep();
+
+    for (std::size_t i = 0; i < num_reads; ++i)
+    {
+      ros::WallTime start = ros::WallTime::now();
+      snapshot.read(positions, stamp);
+      latencies[i] = (ros::WallTime::now() - start).toSec();
+    }
+    done = true;
+    writer.join();
+
+    printLatencies("seqlock snapshot", latencies, snapshot.getReadRetries());
+  }
+
+  // Mutex guarded copy, how getCurrentState() used to work --------------------------------
+  {
+    boost::mutex mutex;
+    std::vector<double> shared_positions(NUM_VARIABLES, 0.0);
+    std::atomic<bool> done(false);
+
+    boost::thread writer([&]()
+                         {
+                           sensor_msgs::JointStatePtr msg = createJointState(names);
+                           ros::WallRate rate(WRITE_RATE);
+                           while (!done)
+                           {
+                             for (std::size_t i = 0; i < NUM_VARIABLES; ++i)
+                               msg->position[i] += 0.001;
+                             {
+                               boost::mutex::scoped_lock lock(mutex);
+                               shared_positions = msg->position;
+                             }
+                             rate.sleep();
+                           }
+                         });
+
+    std::vector<double> positions;
+    std::vector<double> latencies(num_reads);
+    for (std::size_t i = 0; i < num_reads; ++i)
+    {
+      ros::WallTime start = ros::WallTime::now();
+      {
+        boost::mutex::scoped_lock lock(mutex);
+        positions = shared_positions;
+      }
+      latencies[i] = (ros::WallTime::now() - start).toSec();
+    }
+    done = true;
+    writer.join();
+
+    printLatencies("mutex copy", latencies, 0);
+  }
+
+  return 0;
+}